@@ -0,0 +1,195 @@
+#include "dbexecutor.h"
+#include "globalobjects.h"
+
+namespace
+{
+    //waits longer than this are logged in debug builds, us
+    const qint64 SlowWaitThreshold=100*1000;
+    //per thread, the key is the db index followed by the statement
+    QThreadStorage<QHash<QString,QSqlQuery> > queryCache;
+}
+
+class DBExecutor::WorkerThread : public QThread
+{
+public:
+    WorkerThread(const QString &name, std::function<void()> &&loop):body(loop)
+    {
+        setObjectName(name);
+    }
+protected:
+    void run() override
+    {
+        GlobalObjects::addThreadDatabase(objectName());
+        body();
+        DBExecutor::clearCachedQueries();
+        GlobalObjects::removeThreadDatabase(objectName());
+    }
+private:
+    std::function<void()> body;
+};
+
+DBExecutor::DBExecutor(int readerCount):writesSubmitted(0),writesCommitted(0),barrierReads(0),stopped(false)
+{
+    memset(&stats,0,sizeof(stats));
+    clock.start();
+    for(int i=0;i<qMax(1,readerCount);++i)
+    {
+        QThread *reader=new WorkerThread(QString("dbReader%1").arg(i),[this](){readLoop();});
+        readers.append(reader);
+        reader->start();
+    }
+    writer=new WorkerThread(QStringLiteral("dbWriter"),[this](){writeLoop();});
+    writer->start();
+}
+
+DBExecutor::~DBExecutor()
+{
+    stop();
+}
+
+void DBExecutor::stop()
+{
+    {
+        QMutexLocker locker(&lock);
+        if(stopped) return;
+        stopped=true;
+        readCondition.wakeAll();
+        writeCondition.wakeAll();
+    }
+    //queued tasks are still run, writes must not be lost
+    writer->wait();
+    for(QThread *reader:readers)
+        reader->wait();
+    qDeleteAll(readers);
+    readers.clear();
+    delete writer;
+    writer=nullptr;
+}
+
+DBExecutor::Metrics DBExecutor::metrics() const
+{
+    QMutexLocker locker(&lock);
+    return stats;
+}
+
+bool DBExecutor::isExecutorThread() const
+{
+    QThread *current=QThread::currentThread();
+    return current==writer || readers.contains(current);
+}
+
+QSqlQuery &DBExecutor::cachedQuery(int db, const QString &sql)
+{
+    QHash<QString,QSqlQuery> &cache=queryCache.localData();
+    const QString key(QString::number(db)+sql);
+    auto iter=cache.find(key);
+    if(iter==cache.end())
+    {
+        QSqlQuery query(GlobalObjects::getDB(db));
+        query.prepare(sql);
+        iter=cache.insert(key,query);
+    }
+    return iter.value();
+}
+
+void DBExecutor::clearCachedQueries()
+{
+    if(queryCache.hasLocalData())
+        queryCache.localData().clear();
+}
+
+void DBExecutor::enqueueRead(Priority priority, std::function<void()> &&run, bool afterWrites)
+{
+    QMutexLocker locker(&lock);
+    //nothing to wait for if the writer is idle
+    const quint64 writeBarrier=(afterWrites && writesSubmitted>writesCommitted)?writesSubmitted:0;
+    if(writeBarrier>0) ++barrierReads;
+    readQueue[priority].enqueue({std::move(run),clock.nsecsElapsed()/1000,writeBarrier});
+    QueueMetrics &queueStats=stats.read[priority];
+    queueStats.depth=readQueue[priority].count();
+    queueStats.maxDepth=qMax(queueStats.maxDepth,queueStats.depth);
+    readCondition.wakeOne();
+}
+
+void DBExecutor::enqueueWrite(std::function<void()> &&run)
+{
+    QMutexLocker locker(&lock);
+    writeQueue.enqueue({std::move(run),clock.nsecsElapsed()/1000,++writesSubmitted});
+    stats.write.depth=writeQueue.count();
+    stats.write.maxDepth=qMax(stats.write.maxDepth,stats.write.depth);
+    writeCondition.wakeOne();
+}
+
+void DBExecutor::readLoop()
+{
+    QMutexLocker locker(&lock);
+    while(true)
+    {
+        //reads still waiting for writes are passed over, they must not hold a reader
+        int priority=0, index=-1;
+        bool queued=false;
+        for(;priority<PriorityCount;++priority)
+        {
+            const QQueue<Task> &queue=readQueue[priority];
+            queued=queued || !queue.isEmpty();
+            for(int i=0;i<queue.count() && index<0;++i)
+            {
+                if(queue.at(i).writeBarrier<=writesCommitted) index=i;
+            }
+            if(index>=0) break;
+        }
+        if(index<0)
+        {
+            if(stopped && !queued) return;
+            readCondition.wait(&lock);
+            continue;
+        }
+        Task task(readQueue[priority].takeAt(index));
+        stats.read[priority].depth=readQueue[priority].count();
+        if(task.writeBarrier>0) --barrierReads;
+        const qint64 startTime=clock.nsecsElapsed()/1000;
+        locker.unlock();
+        task.run();
+        const qint64 endTime=clock.nsecsElapsed()/1000;
+        locker.relock();
+        finishTask(stats.read[priority],startTime-task.submitTime,endTime-startTime);
+    }
+}
+
+void DBExecutor::writeLoop()
+{
+    QMutexLocker locker(&lock);
+    while(true)
+    {
+        if(writeQueue.isEmpty())
+        {
+            if(stopped) return;
+            writeCondition.wait(&lock);
+            continue;
+        }
+        Task task(writeQueue.dequeue());
+        stats.write.depth=writeQueue.count();
+        const qint64 startTime=clock.nsecsElapsed()/1000;
+        locker.unlock();
+        task.run();
+        const qint64 endTime=clock.nsecsElapsed()/1000;
+        locker.relock();
+        writesCommitted=task.writeBarrier;
+        if(barrierReads>0) readCondition.wakeAll();
+        finishTask(stats.write,startTime-task.submitTime,endTime-startTime);
+    }
+}
+
+void DBExecutor::finishTask(QueueMetrics &queueStats, qint64 waitTime, qint64 runTime)
+{
+    ++queueStats.tasks;
+    queueStats.totalWait+=waitTime;
+    queueStats.maxWait=qMax(queueStats.maxWait,waitTime);
+    queueStats.totalRun+=runTime;
+#ifdef QT_DEBUG
+    if(waitTime>SlowWaitThreshold)
+        qDebug()<<"db task waited"<<waitTime/1000<<"ms on"<<QThread::currentThread()->objectName()<<", run:"<<runTime/1000<<"ms";
+#else
+    Q_UNUSED(SlowWaitThreshold)
+#endif
+}
@@ -0,0 +1,138 @@
+#ifndef DBEXECUTOR_H
+#define DBEXECUTOR_H
+#include <QtCore>
+#include <QSqlQuery>
+#include <functional>
+/*
+ * Runs database tasks on threads with their own connections (see GlobalObjects::getDB).
+ * Reads go to a small pool of reader threads and are taken by priority, writes go to one
+ * writer thread in submission order, SQLite allows one writer anyway and WAL lets the readers
+ * go on meanwhile. A read submitted with afterWrites=true starts only after the writes
+ * submitted before it are committed, it stays queued meanwhile and the readers take other reads.
+ * Results come as QFuture: wait on them from worker code, or use then() to get a callback
+ * on the thread of a QObject instead of spinning a nested event loop.
+ * Tasks submitted from a thread of the executor run inline.
+ */
+class DBExecutor
+{
+public:
+    enum Priority
+    {
+        Interactive,    //the user is waiting for it
+        Normal,
+        Background,     //prefetching, maintenance
+        PriorityCount
+    };
+    struct QueueMetrics
+    {
+        int depth, maxDepth;
+        qint64 tasks;
+        qint64 totalWait, maxWait;  //us from submission to start
+        qint64 totalRun;            //us
+    };
+    struct Metrics
+    {
+        QueueMetrics read[PriorityCount];
+        QueueMetrics write;
+    };
+
+    explicit DBExecutor(int readerCount);
+    ~DBExecutor();
+    void stop();
+
+    template<typename Func>
+    auto read(Priority priority, Func task, bool afterWrites=false) -> QFuture<decltype(task())>
+    {
+        using T=decltype(task());
+        QFutureInterface<T> fi;
+        fi.reportStarted();
+        if(isExecutorThread())
+        {
+            Runner<T>::run(fi,task);
+            return fi.future();
+        }
+        enqueueRead(priority,[fi,task]() mutable {Runner<T>::run(fi,task);},afterWrites);
+        return fi.future();
+    }
+    template<typename Func>
+    auto write(Func task) -> QFuture<decltype(task())>
+    {
+        using T=decltype(task());
+        QFutureInterface<T> fi;
+        fi.reportStarted();
+        if(QThread::currentThread()==writer)
+        {
+            Runner<T>::run(fi,task);
+            return fi.future();
+        }
+        enqueueWrite([fi,task]() mutable {Runner<T>::run(fi,task);});
+        return fi.future();
+    }
+    //callback(future) is called on the thread of context, call it from that thread
+    template<typename T, typename Callback>
+    static void then(const QFuture<T> &future, QObject *context, Callback callback)
+    {
+        QFutureWatcher<T> *watcher=new QFutureWatcher<T>(context);
+        QObject::connect(watcher,&QFutureWatcherBase::finished,context,[watcher,callback](){
+            callback(watcher->future());
+            watcher->deleteLater();
+        });
+        watcher->setFuture(future);
+    }
+
+    Metrics metrics() const;
+    bool isExecutorThread() const;
+
+    //statement prepared once on the calling thread's connection to db (GlobalObjects::Comment_DB...)
+    static QSqlQuery &cachedQuery(int db, const QString &sql);
+    //before the connections of the thread are removed
+    static void clearCachedQueries();
+private:
+    template<typename T>
+    struct Runner
+    {
+        template<typename Func>
+        static void run(QFutureInterface<T> &fi, Func &task)
+        {
+            fi.reportResult(task());
+            fi.reportFinished();
+        }
+    };
+    struct Task
+    {
+        std::function<void()> run;
+        qint64 submitTime;
+        quint64 writeBarrier;
+    };
+    class WorkerThread;
+
+    mutable QMutex lock;
+    QWaitCondition readCondition, writeCondition;
+    QQueue<Task> readQueue[PriorityCount];
+    QQueue<Task> writeQueue;
+    QList<QThread *> readers;
+    QThread *writer;
+    QElapsedTimer clock;
+    quint64 writesSubmitted, writesCommitted;
+    int barrierReads;   //queued reads waiting for writes
+    bool stopped;
+    Metrics stats;
+
+    void enqueueRead(Priority priority, std::function<void()> &&run, bool afterWrites);
+    void enqueueWrite(std::function<void()> &&run);
+    void readLoop();
+    void writeLoop();
+    void finishTask(QueueMetrics &queueStats, qint64 waitTime, qint64 runTime);
+};
+
+template<>
+struct DBExecutor::Runner<void>
+{
+    template<typename Func>
+    static void run(QFutureInterface<void> &fi, Func &task)
+    {
+        task();
+        fi.reportFinished();
+    }
+};
+#endif // DBEXECUTOR_H
@@ -0,0 +1,89 @@
+#ifndef HASH64_H
+#define HASH64_H
+#include <QtGlobal>
+#include <cstring>
+/*
+ * XXH64, fast non-cryptographic 64-bit hash for in-memory keys.
+ * Results depend on the byte order, never store them.
+ */
+namespace Hash64
+{
+    const quint64 Prime1=11400714785074694791ULL;
+    const quint64 Prime2=14029467366897019727ULL;
+    const quint64 Prime3=1609587929392839161ULL;
+    const quint64 Prime4=9650029242287828579ULL;
+    const quint64 Prime5=2870177450012600261ULL;
+
+    inline quint64 rotl(quint64 x, int r) {return (x<<r)|(x>>(64-r));}
+    inline quint64 read64(const uchar *p) {quint64 v; memcpy(&v,p,8); return v;}
+    inline quint32 read32(const uchar *p) {quint32 v; memcpy(&v,p,4); return v;}
+    inline quint64 accumulate(quint64 acc, quint64 input)
+    {
+        acc+=input*Prime2;
+        acc=rotl(acc,31);
+        return acc*Prime1;
+    }
+    inline quint64 mergeRound(quint64 acc, quint64 val)
+    {
+        acc^=accumulate(0,val);
+        return acc*Prime1+Prime4;
+    }
+    inline quint64 avalanche(quint64 h)
+    {
+        h^=h>>33;
+        h*=Prime2;
+        h^=h>>29;
+        h*=Prime3;
+        h^=h>>32;
+        return h;
+    }
+
+    inline quint64 hash(const void *data, size_t len, quint64 seed=0)
+    {
+        const uchar *p=static_cast<const uchar *>(data);
+        const uchar *end=p+len;
+        quint64 h;
+        if(len>=32)
+        {
+            const uchar *limit=end-32;
+            quint64 v1=seed+Prime1+Prime2, v2=seed+Prime2, v3=seed, v4=seed-Prime1;
+            do
+            {
+                v1=accumulate(v1,read64(p)); p+=8;
+                v2=accumulate(v2,read64(p)); p+=8;
+                v3=accumulate(v3,read64(p)); p+=8;
+                v4=accumulate(v4,read64(p)); p+=8;
+            } while(p<=limit);
+            h=rotl(v1,1)+rotl(v2,7)+rotl(v3,12)+rotl(v4,18);
+            h=mergeRound(h,v1);
+            h=mergeRound(h,v2);
+            h=mergeRound(h,v3);
+            h=mergeRound(h,v4);
+        }
+        else
+        {
+            h=seed+Prime5;
+        }
+        h+=quint64(len);
+        while(p+8<=end)
+        {
+            h^=accumulate(0,read64(p));
+            h=rotl(h,27)*Prime1+Prime4;
+            p+=8;
+        }
+        if(p+4<=end)
+        {
+            h^=quint64(read32(p))*Prime1;
+            h=rotl(h,23)*Prime2+Prime3;
+            p+=4;
+        }
+        while(p<end)
+        {
+            h^=(*p)*Prime5;
+            h=rotl(h,11)*Prime1;
+            ++p;
+        }
+        return avalanche(h);
+    }
+}
+#endif // HASH64_H
@@ -5,8 +5,11 @@
 namespace
 {
     QMap<QThread *,QNetworkAccessManager *> managerMap;
+    QMutex managerLock;
     QNetworkAccessManager *getManager()
     {
+        //requests may come from several threads at once, see RefreshScheduler
+        QMutexLocker locker(&managerLock);
         QNetworkAccessManager *manager=managerMap.value(QThread::currentThread());
         if(!manager)
         {
@@ -48,17 +48,23 @@ SOURCES += \
     UI/mainwindow.cpp \
     UI/framelesswindow.cpp \
     Play/Danmu/Layouts/bottomlayout.cpp \
+    Play/Danmu/Layouts/danmuarray.cpp \
     Play/Danmu/Layouts/rolllayout.cpp \
     Play/Danmu/Layouts/toplayout.cpp \
+    Play/Danmu/Layouts/trackindex.cpp \
     Play/Danmu/danmupool.cpp \
+    Play/Danmu/danmupoolworker.cpp \
+    Play/Danmu/danmustore.cpp \
     globalobjects.cpp \
     Play/Playlist/playlist.cpp \
     Play/Video/mpvplayer.cpp \
+    Play/Video/framepacer.cpp \
     UI/list.cpp \
     UI/player.cpp \
     UI/pooleditor.cpp \
     UI/framelessdialog.cpp \
     Play/Danmu/Provider/localprovider.cpp \
+    Play/Danmu/Provider/xmldanmuparser.cpp \
     UI/adddanmu.cpp \
     UI/matcheditor.cpp \
     Play/Danmu/Provider/bilibiliprovider.cpp \
@@ -95,6 +101,7 @@ SOURCES += \
     UI/checkupdate.cpp \
     Play/Danmu/Provider/iqiyiprovider.cpp \
     Common/flowlayout.cpp \
+    Common/dbexecutor.cpp \
     UI/animedetailinfo.cpp \
     UI/timelineedit.cpp \
     Play/Danmu/Provider/acfunprovider.cpp \
@@ -106,6 +113,10 @@ SOURCES += \
     Play/Playlist/playlistitem.cpp \
     Play/Playlist/playlistprivate.cpp \
     Play/Danmu/Render/cacheworker.cpp \
+    Play/Danmu/Render/glyphatlas.cpp \
+    Play/Danmu/Render/textureatlas.cpp \
+    Play/Danmu/Render/danmubatch.cpp \
+    Play/Danmu/Render/danmubenchmark.cpp \
     Play/Danmu/Render/danmurender.cpp \
     Play/Danmu/Manager/danmumanager.cpp \
     Play/Danmu/Manager/nodeinfo.cpp \
@@ -125,6 +136,12 @@ SOURCES += \
     UI/managescript.cpp \
     Play/Danmu/Provider/pptvprovider.cpp \
     Play/Danmu/Manager/pool.cpp \
+    Play/Danmu/Manager/danmublock.cpp \
+    Play/Danmu/Manager/poolloader.cpp \
+    Play/Danmu/Manager/fingerprintindex.cpp \
+    Play/Danmu/Manager/refreshscheduler.cpp \
+    Play/Danmu/Manager/danmuimporter.cpp \
+    Play/Danmu/mergewindow.cpp \
     MediaLibrary/capturelistmodel.cpp \
     UI/captureview.cpp \
     UI/tip.cpp
@@ -142,23 +159,30 @@ HEADERS += \
     UI/mainwindow.h \
     UI/framelesswindow.h \
     Play/Danmu/Layouts/bottomlayout.h \
+    Play/Danmu/Layouts/danmuarray.h \
     Play/Danmu/Layouts/danmulayout.h \
     Play/Danmu/Layouts/rolllayout.h \
     Play/Danmu/Layouts/toplayout.h \
+    Play/Danmu/Layouts/trackindex.h \
     Play/Danmu/danmupool.h \
+    Play/Danmu/danmupoolworker.h \
+    Play/Danmu/danmustore.h \
     UI/widgets/clickslider.h \
     UI/widgets/dialogtip.h \
     UI/widgets/fonticontoolbutton.h \
     globalobjects.h \
     Play/Playlist/playlist.h \
     Play/Video/mpvplayer.h \
+    Play/Video/framepacer.h \
     UI/list.h \
     UI/player.h \
     UI/pooleditor.h \
     UI/framelessdialog.h \
     Play/Danmu/Provider/localprovider.h \
+    Play/Danmu/Provider/xmldanmuparser.h \
     UI/adddanmu.h \
     Play/Danmu/common.h \
+    Play/Danmu/objectpool.h \
     UI/matcheditor.h \
     Play/Danmu/Provider/bilibiliprovider.h \
     Play/Danmu/Provider/info.h \
@@ -209,6 +233,11 @@ HEADERS += \
     Play/Playlist/playlistitem.h \
     Play/Playlist/playlistprivate.h \
     Play/Danmu/Render/cacheworker.h \
+    Play/Danmu/Render/glyphatlas.h \
+    Play/Danmu/Render/textureatlas.h \
+    Play/Danmu/Render/drawinfotable.h \
+    Play/Danmu/Render/danmubatch.h \
+    Play/Danmu/Render/danmubenchmark.h \
     Play/Danmu/Render/danmurender.h \
     Play/Danmu/Manager/danmumanager.h \
     Play/Danmu/Manager/nodeinfo.h \
@@ -228,7 +257,15 @@ HEADERS += \
     UI/managescript.h \
     Play/Danmu/Provider/pptvprovider.h \
     Play/Danmu/Manager/pool.h \
+    Play/Danmu/Manager/danmublock.h \
+    Play/Danmu/Manager/poolloader.h \
+    Play/Danmu/Manager/fingerprintindex.h \
+    Play/Danmu/Manager/refreshscheduler.h \
+    Play/Danmu/Manager/danmuimporter.h \
+    Play/Danmu/mergewindow.h \
     Common/threadtask.h \
+    Common/hash64.h \
+    Common/dbexecutor.h \
     MediaLibrary/capturelistmodel.h \
     UI/captureview.h \
     UI/tip.h
@@ -8,62 +8,52 @@ BottomLayout::BottomLayout(DanmuRender *render):DanmuLayout(render),life_time(50
 void BottomLayout::addDanmu(QSharedPointer<DanmuComment> danmu, DanmuDrawInfo *drawInfo)
 {
     const QRectF rect=render->surfaceRect;
-    float currentY=rect.bottom()-margin_y;
+    if(rect!=spaceRect) resetSpace(rect);
     float dm_height=drawInfo->height;
-    float top=rect.top();
     DanmuObject *dmobj=new DanmuObject;
     dmobj->src=danmu;
     dmobj->drawInfo=drawInfo;
     dmobj->extraData=life_time;
     dmobj->x=(rect.width()-drawInfo->width)/2;
-    bool success=false;
-    float maxSpace(0.f),dsY(0.f),cY(rect.bottom());
-    QLinkedList<DanmuObject *>::Iterator msPos=bottomdanmu.begin();
-    for(auto iter=bottomdanmu.begin();iter!=bottomdanmu.end();++iter)
+    do
     {
-        if(currentY-(*iter)->y-(*iter)->drawInfo->height-margin_y>=dm_height)
+        //rows count from the bottom, the lowest free run is the one closest to the bottom
+        int row=space.findFree(qCeil(dm_height+margin_y));
+        if(row>=0)
         {
-            dmobj->y=currentY;
-            bottomdanmu.insert(iter,dmobj);
-            success=true;
+            dmobj->y=rect.bottom()-margin_y-row-dm_height;
+            addObject(dmobj);
             break;
         }
-        //for dense layout-----
-        float tmp(cY-(*iter)->y);
-        if(tmp>maxSpace)
+        if(render->dense>0)
         {
-            maxSpace=tmp;
-            dsY=cY-tmp/2;
-            msPos=iter;
-        }
-        //--------
-        cY=(*iter)->y-margin_y;
-        currentY=cY-dm_height;
-        if(currentY<=top)
-            break;
-    }
-    if(!success)
-    {
-        do
-        {
-            if(currentY>top)
+            //no room left, insert between two adjacent danmu, find the largest spacing
+            float maxSpace(0.f),dsY(0.f),cY(rect.bottom());
+            for(auto iter=bottomdanmu.cend();iter!=bottomdanmu.cbegin();)
             {
-                dmobj->y=currentY-(bottomdanmu.isEmpty()?dm_height:0);
-                bottomdanmu.append(dmobj);
-                break;
+                --iter;
+                float tmp(cY-iter.key());
+                if(tmp>maxSpace)
+                {
+                    maxSpace=tmp;
+                    dsY=cY-tmp/2;
+                }
+                cY=iter.key()-margin_y;
+                if(cY-dm_height<=rect.top())
+                    break;
             }
             if((render->dense==1 && maxSpace>=dm_height) || render->dense==2)
             {
                 dmobj->y=dsY;
-                bottomdanmu.insert(msPos,dmobj);
+                addObject(dmobj);
                 break;
             }
+        }
 #ifdef QT_DEBUG
-            qDebug()<<"bottom lost: "<<danmu->text<<",send time:"<<danmu->date;
+        qDebug()<<"bottom lost: "<<danmu->text<<",send time:"<<danmu->date;
 #endif
-            delete dmobj;
-        }while(false);
-    }
+        delete dmobj;
+    }while(false);
 }
 
 void BottomLayout::moveLayout(float step)
@@ -80,6 +70,7 @@ void BottomLayout::moveLayout(float step)
         }
         else
         {
+            releaseRows(current);
             delete current;
             iter=bottomdanmu.erase(iter);
         }
@@ -111,6 +102,7 @@ void BottomLayout::cleanup()
 {
     qDeleteAll(bottomdanmu);
     bottomdanmu.clear();
+    space.reset(space.rows());
 }
 
 BottomLayout::~BottomLayout()
@@ -124,6 +116,7 @@ void BottomLayout::removeBlocked()
     {
         if((*iter)->src->blockBy!=-1)
         {
+            releaseRows(*iter);
             delete *iter;
             iter=bottomdanmu.erase(iter);
         }
@@ -134,4 +127,36 @@ void BottomLayout::removeBlocked()
     }
 }
 
+void BottomLayout::resetSpace(const QRectF &rect)
+{
+    spaceRect=rect;
+    space.reset(qFloor(rect.height()));
+    for(auto iter=bottomdanmu.cbegin();iter!=bottomdanmu.cend();++iter)
+    {
+        int begin,end;
+        danmuRows(*iter,begin,end);
+        space.occupy(begin,end);
+    }
+}
+
+void BottomLayout::danmuRows(const DanmuObject *obj, int &begin, int &end) const
+{
+    //rows count from the bottom of the surface
+    begin=qFloor(spaceRect.bottom()-obj->y-obj->drawInfo->height);
+    end=qCeil(spaceRect.bottom()-obj->y);
+}
 
+void BottomLayout::addObject(DanmuObject *obj)
+{
+    bottomdanmu.insert(obj->y,obj);
+    int begin,end;
+    danmuRows(obj,begin,end);
+    space.occupy(begin,end);
+}
+
+void BottomLayout::releaseRows(const DanmuObject *obj)
+{
+    int begin,end;
+    danmuRows(obj,begin,end);
+    space.release(begin,end);
+}
@@ -1,6 +1,7 @@
 #ifndef BOTTOMLAYOUT_H
 #define BOTTOMLAYOUT_H
 #include "Play/Danmu/Render/danmurender.h"
+#include "trackindex.h"
 
 class BottomLayout : public DanmuLayout
 {
@@ -17,7 +18,15 @@ public:
     virtual void removeBlocked();
 private:
     float life_time;
-    QLinkedList<DanmuObject *> bottomdanmu;    
+    //ordered by y
+    QMultiMap<float,DanmuObject *> bottomdanmu;
+    SpaceTree space;
+    QRectF spaceRect;
+
+    void resetSpace(const QRectF &rect);
+    inline void danmuRows(const DanmuObject *obj, int &begin, int &end) const;
+    inline void addObject(DanmuObject *obj);
+    inline void releaseRows(const DanmuObject *obj);
 };
 
 #endif // BOTTOMLAYOUT_H
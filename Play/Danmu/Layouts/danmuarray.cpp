@@ -0,0 +1,116 @@
+#include "danmuarray.h"
+#include "Play/Danmu/Render/danmurender.h"
+
+RollDanmuArray::~RollDanmuArray()
+{
+    qDeleteAll(objs);
+}
+
+void RollDanmuArray::append(DanmuObject *obj)
+{
+    xs.append(obj->x);
+    ys.append(obj->y);
+    speeds.append(obj->extraData);
+    widths.append(obj->drawInfo->width);
+    heights.append(obj->drawInfo->height);
+    objs.append(obj);
+}
+
+void RollDanmuArray::move(float step)
+{
+    const int n=xs.count();
+    if(n==0) return;
+    float *x=xs.data();
+    const float *speed=speeds.constData();
+    for(int i=0;i<n;++i)
+        x[i]-=step*speed[i];
+    for(int i=0;i<xs.count();)
+    {
+        if(xs.at(i)+widths.at(i)>0)
+        {
+            ++i;
+        }
+        else
+        {
+            delete objs.at(i);
+            swapRemove(i);
+        }
+    }
+}
+
+void RollDanmuArray::draw(DanmuRender *render) const
+{
+    const int n=objs.count();
+    for(int i=0;i<n;++i)
+        render->drawDanmuTexture(xs.at(i),ys.at(i),objs.at(i)->drawInfo);
+}
+
+QSharedPointer<DanmuComment> RollDanmuArray::danmuAt(QPointF point) const
+{
+    const int n=objs.count();
+    for(int i=0;i<n;++i)
+    {
+        if(xs.at(i)<point.x() && xs.at(i)+widths.at(i)>point.x() &&
+                ys.at(i)<point.y() && ys.at(i)+heights.at(i)>point.y())
+            return objs.at(i)->src;
+    }
+    return nullptr;
+}
+
+void RollDanmuArray::setSpeed(float baseSpeed)
+{
+    const int n=objs.count();
+    for(int i=0;i<n;++i)
+    {
+        speeds[i]=(objs.at(i)->drawInfo->width/5+baseSpeed)/1000;
+        objs.at(i)->extraData=speeds.at(i);
+    }
+}
+
+void RollDanmuArray::removeBlocked()
+{
+    for(int i=0;i<objs.count();)
+    {
+        if(objs.at(i)->src->blockBy!=-1)
+        {
+            delete objs.at(i);
+            swapRemove(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+void RollDanmuArray::clear()
+{
+    qDeleteAll(objs);
+    //resize keeps the capacity
+    xs.resize(0);
+    ys.resize(0);
+    speeds.resize(0);
+    widths.resize(0);
+    heights.resize(0);
+    objs.resize(0);
+}
+
+void RollDanmuArray::swapRemove(int i)
+{
+    const int last=objs.count()-1;
+    if(i!=last)
+    {
+        xs[i]=xs.at(last);
+        ys[i]=ys.at(last);
+        speeds[i]=speeds.at(last);
+        widths[i]=widths.at(last);
+        heights[i]=heights.at(last);
+        objs[i]=objs.at(last);
+    }
+    xs.removeLast();
+    ys.removeLast();
+    speeds.removeLast();
+    widths.removeLast();
+    heights.removeLast();
+    objs.removeLast();
+}
@@ -0,0 +1,31 @@
+#ifndef DANMUARRAY_H
+#define DANMUARRAY_H
+#include <QtCore>
+#include "Play/Danmu/common.h"
+class DanmuRender;
+/*
+ * Rolling danmu kept in parallel arrays, one per field. Moving is one pass over x and speed
+ * the compiler can vectorize, danmu out of the left edge are swap-removed, the order is not kept.
+ * The DanmuObject stays as the handle(src, drawInfo), its x is not updated once it is here.
+ */
+class RollDanmuArray
+{
+public:
+    ~RollDanmuArray();
+    inline int count() const {return objs.count();}
+    //takes the object with its current x, y and speed(extraData)
+    void append(DanmuObject *obj);
+    //moves every danmu by step ms, the ones fully out of the left edge are deleted
+    void move(float step);
+    void draw(DanmuRender *render) const;
+    QSharedPointer<DanmuComment> danmuAt(QPointF point) const;
+    void setSpeed(float baseSpeed);
+    void removeBlocked();
+    void clear();
+private:
+    QVector<float> xs, ys, speeds, widths, heights;
+    QVector<DanmuObject *> objs;
+
+    void swapRemove(int i);
+};
+#endif // DANMUARRAY_H
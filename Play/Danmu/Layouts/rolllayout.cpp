@@ -1,6 +1,12 @@
 #include "rolllayout.h"
 
-RollLayout::RollLayout(DanmuRender *render):DanmuLayout(render),base_speed(200)
+namespace
+{
+    //x is moved frame by frame, the free-at time may be a little later than the real one
+    const double freeAtSlack=1.0;
+}
+
+RollLayout::RollLayout(DanmuRender *render):DanmuLayout(render),clock(0),base_speed(200)
 {
 
 }
@@ -8,135 +14,142 @@ RollLayout::RollLayout(DanmuRender *render):DanmuLayout(render),base_speed(200)
 void RollLayout::addDanmu(QSharedPointer<DanmuComment> danmu, DanmuDrawInfo *drawInfo)
 {
     const QRectF rect=render->surfaceRect;
+    if(rect!=laneRect) resetLanes(rect);
 
     float speed=(drawInfo->width/5+base_speed)/1000;
-    float currentY=margin_y+rect.top();
     float dm_height=drawInfo->height;
     DanmuObject *dmobj=new DanmuObject();
     dmobj->src=danmu;
     dmobj->drawInfo=drawInfo;
     dmobj->extraData=speed;
     dmobj->x=rect.width();
-    bool success=false;
-    float maxChaseSpace(rect.width()/2),maxSpace(0.f),dsY1(0.f),dsY2(0.f),cY(rect.top());
-    QLinkedList<DanmuObject *>::Iterator msPos1,msPos2= lastcol.begin();
-    for(auto iter=lastcol.begin();iter!=lastcol.end();++iter)
+    //lanes below the first one without room for the danmu under it are not tried
+    const int laneCount=lastcol.count();
+    const int end=qMin(lastcol.findBottom(rect.bottom()-dm_height)+1,laneCount);
+    for(int i=lastcol.findCandidate(0,end,dm_height,clock+freeAtSlack);i>=0;
+        i=lastcol.findCandidate(i+1,end,dm_height,clock+freeAtSlack))
     {
-        float cur_height=(*iter)->drawInfo->height;
-        if((*iter)->y-currentY-margin_y>=dm_height)
+        DanmuObject *last=lastcol.at(i).last;
+        float currentY=i>0?lastcol.bottom(i-1)+margin_y:margin_y+rect.top();
+        if(last->y-currentY-margin_y>=dm_height)
         {
             dmobj->y=currentY;
-            lastcol.insert(iter,dmobj);
-            success=true;
-            break;
+            lastcol.insert(i,{dmobj,freeAt(dmobj)});
+            return;
         }
-        if(!isCollided((*iter),dmobj))
+        if(!isCollided(last,dmobj))
         {
             dmobj->y=currentY;
-            rolldanmu.append(*iter);
-            *iter=dmobj;
-            success=true;
-            break;
-        }
-        //for dense layout-----
-        //Although overlays occur, they do not occur until some time later
-        float chaseSpace(dmobj->x-(*iter)->x-(*iter)->drawInfo->width);
-        if(chaseSpace>maxChaseSpace)
-        {
-            maxChaseSpace=chaseSpace;//(*iter)->x;
-            msPos1=iter;
-            dsY1=currentY;
-        }
-        //Insert between two adjacent danmu, find the largest spacing
-        float tmp((*iter)->y-cY);
-        if(tmp>maxSpace)
-        {
-            maxSpace=tmp;
-            dsY2=cY+tmp/2;
-            msPos2=iter;
+            rolldanmu.append(last);
+            lastcol.replace(i,{dmobj,freeAt(dmobj)});
+            return;
         }
-        //--------
-        cY=(*iter)->y+margin_y;
-        currentY=cY+cur_height;
-        if(currentY+dm_height>=rect.bottom())
-            break;
     }
-    if(!success)
+    do
     {
-        do
+        float currentY=end>0?lastcol.bottom(end-1)+margin_y:margin_y+rect.top();
+        if(currentY+dm_height<rect.bottom())
         {
-            if(currentY+dm_height<rect.bottom())
-            {
-                dmobj->y=currentY;
-                lastcol.append(dmobj);
-                break;
-            }
-            if(render->dense>0)
+            dmobj->y=currentY;
+            lastcol.insert(laneCount,{dmobj,freeAt(dmobj)});
+            break;
+        }
+        if(render->dense>0)
+        {
+            //no lane is free, dense layout only happens when the surface is full
+            float maxChaseSpace(rect.width()/2),maxSpace(0.f),dsY1(0.f),dsY2(0.f),cY(rect.top());
+            int msPos1(-1),msPos2(0);
+            currentY=margin_y+rect.top();
+            for(int i=0;i<end;++i)
             {
-                if(msPos1.i)
+                const DanmuObject *last=lastcol.at(i).last;
+                //Although overlays occur, they do not occur until some time later
+                float chaseSpace(dmobj->x-last->x-last->drawInfo->width);
+                if(chaseSpace>maxChaseSpace)
                 {
-                    dmobj->y=dsY1;
-                    rolldanmu.append(*msPos1);
-                    *msPos1=dmobj;
-                    break;
+                    maxChaseSpace=chaseSpace;
+                    msPos1=i;
+                    dsY1=currentY;
                 }
-                else
+                //Insert between two adjacent danmu, find the largest spacing
+                float tmp(last->y-cY);
+                if(tmp>maxSpace)
                 {
-                    if((render->dense==1 && maxSpace>=dm_height) || render->dense==2)
-                    {
-                        dmobj->y=dsY2;
-                        lastcol.insert(msPos2,dmobj);
-                        break;
-                    }
-                }   
+                    maxSpace=tmp;
+                    dsY2=cY+tmp/2;
+                    msPos2=i;
+                }
+                cY=last->y+margin_y;
+                currentY=cY+last->drawInfo->height;
+            }
+            if(msPos1>=0)
+            {
+                dmobj->y=dsY1;
+                rolldanmu.append(lastcol.at(msPos1).last);
+                lastcol.replace(msPos1,{dmobj,freeAt(dmobj)});
+                break;
+            }
+            if((render->dense==1 && maxSpace>=dm_height) || render->dense==2)
+            {
+                dmobj->y=dsY2;
+                lastcol.insert(msPos2,{dmobj,freeAt(dmobj)});
+                break;
             }
+        }
 #ifdef QT_DEBUG
-            qDebug()<<"roll lost: "<<danmu->text<<",send time:"<<danmu->date;
+        qDebug()<<"roll lost: "<<danmu->text<<",send time:"<<danmu->date;
 #endif
-            delete dmobj;
-        }while (false);
-    }
+        delete dmobj;
+    }while (false);
 }
 
 void RollLayout::moveLayout(float step)
 {
-    moveLayoutList(rolldanmu,step);
-    moveLayoutList(lastcol,step);
+    clock+=step;
+    rolldanmu.move(step);
+    lastcol.removeIf([step](DanmuObject *current){
+        current->x-=step*current->extraData;
+        if(current->x+current->drawInfo->width>0) return false;
+        delete current;
+        return true;
+    });
 }
 
 void RollLayout::drawLayout()
 {
-    for(auto current:rolldanmu)
-    {
-        //painter.drawImage(current->x,current->y,*current->drawInfo->img);
-        render->drawDanmuTexture(current);
-    }
-    for(auto current:lastcol)
+    rolldanmu.draw(render);
+    for(const auto &lane:lastcol.laneList())
     {
-        render->drawDanmuTexture(current);
+        render->drawDanmuTexture(lane.last);
         //painter.drawImage(current->x,current->y,*current->drawInfo->img);
     }
 }
 
 RollLayout::~RollLayout()
 {
-    qDeleteAll(rolldanmu);
-    qDeleteAll(lastcol);
+    for(const auto &lane:lastcol.laneList())
+        delete lane.last;
 }
 
 QSharedPointer<DanmuComment> RollLayout::danmuAt(QPointF point)
 {
-    auto ret=danmuAtList(point,rolldanmu);
+    auto ret=rolldanmu.danmuAt(point);
     if(!ret.isNull())
         return ret;
-    ret=danmuAtList(point,lastcol);
-    return ret;
+    for(const auto &lane:lastcol.laneList())
+    {
+        DanmuObject *curDMObj=lane.last;
+        if(curDMObj->x<point.x() && curDMObj->x+curDMObj->drawInfo->width>point.x() &&
+                curDMObj->y<point.y() && curDMObj->y+curDMObj->drawInfo->height>point.y())
+            return curDMObj->src;
+    }
+    return nullptr;
 }
 
 void RollLayout::cleanup()
 {
-    qDeleteAll(lastcol);
-    qDeleteAll(rolldanmu);
+    for(const auto &lane:lastcol.laneList())
+        delete lane.last;
     lastcol.clear();
     rolldanmu.clear();
 }
@@ -144,73 +157,39 @@ void RollLayout::cleanup()
 void RollLayout::setSpeed(float speed)
 {
     base_speed=speed;
-    for(auto iter=rolldanmu.cbegin();iter!=rolldanmu.cend();++iter)
+    rolldanmu.setSpeed(base_speed);
+    for(const auto &lane:lastcol.laneList())
     {
-        (*iter)->extraData=((*iter)->drawInfo->width/5+base_speed)/1000;
-    }
-    for(auto iter=lastcol.cbegin();iter!=lastcol.cend();++iter)
-    {
-        (*iter)->extraData=((*iter)->drawInfo->width/5+base_speed)/1000;
+        lane.last->extraData=(lane.last->drawInfo->width/5+base_speed)/1000;
     }
+    //the lanes are free at other times now
+    resetLanes(laneRect);
 }
 
 void RollLayout::removeBlocked()
 {
-    for(auto iter=rolldanmu.begin();iter!=rolldanmu.end();)
-    {
-        if((*iter)->src->blockBy!=-1)
-        {
-            delete *iter;
-            iter=rolldanmu.erase(iter);
-        }
-        else
-        {
-            ++iter;
-        }
-    }
-    for(auto iter=lastcol.begin();iter!=lastcol.end();)
-    {
-        if((*iter)->src->blockBy!=-1)
-        {
-            delete *iter;
-            iter=lastcol.erase(iter);
-        }
-        else
-        {
-            ++iter;
-        }
-    }
+    rolldanmu.removeBlocked();
+    lastcol.removeIf([](DanmuObject *current){
+        if(current->src->blockBy==-1) return false;
+        delete current;
+        return true;
+    });
 }
 
-void RollLayout::moveLayoutList(QLinkedList<DanmuObject *> &list, float step)
+void RollLayout::resetLanes(const QRectF &rect)
 {
-    for(auto iter=list.begin();iter!=list.end();)
-    {
-        DanmuObject *current=(*iter);
-        DanmuDrawInfo *current_drawInfo=current->drawInfo;
-        current->x-=step*current->extraData;
-        if(current->x+current_drawInfo->width>0)
-        {
-            ++iter;
-        }
-        else
-        {
-            delete current;
-            iter=list.erase(iter);
-        }
-    }
+    laneRect=rect;
+    QVector<LaneTree::Lane> lanes(lastcol.laneList());
+    for(auto &lane:lanes)
+        lane.freeAt=freeAt(lane.last);
+    lastcol.reset(rect.top()+margin_y,lanes);
 }
 
-QSharedPointer<DanmuComment> RollLayout::danmuAtList(QPointF point, QLinkedList<DanmuObject *> &list)
+double RollLayout::freeAt(const DanmuObject *obj) const
 {
-    for(auto iter=list.cbegin();iter!=list.cend();++iter)
-    {
-        DanmuObject *curDMObj=*iter;
-        if(curDMObj->x<point.x() && curDMObj->x+curDMObj->drawInfo->width>point.x() &&
-                curDMObj->y<point.y() && curDMObj->y+curDMObj->drawInfo->height>point.y())
-            return curDMObj->src;
-    }
-    return nullptr;
+    //new danmu start at the right edge, the lane is never free before the tail gets there
+    float outside=obj->x+obj->drawInfo->width-laneRect.width();
+    return outside>0?clock+outside/obj->extraData:clock;
 }
 
 bool RollLayout::isCollided(const DanmuObject *d1, const DanmuObject *d2)
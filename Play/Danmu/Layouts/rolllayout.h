@@ -1,6 +1,8 @@
 #ifndef ROLLLAYOUT_H
 #define ROLLLAYOUT_H
 #include "Play/Danmu/Render/danmurender.h"
+#include "trackindex.h"
+#include "danmuarray.h"
 class RollLayout : public DanmuLayout
 {
 public:
@@ -17,11 +19,17 @@ public:
     virtual void removeBlocked();
 
 private:
-    QLinkedList<DanmuObject *> rolldanmu,lastcol;
+    //danmu that are no longer the latest of their lane
+    RollDanmuArray rolldanmu;
+    //the latest danmu of every lane
+    LaneTree lastcol;
+    QRectF laneRect;
+    //ms moved since the layout was created, free-at times of the lanes are on it
+    double clock;
     float base_speed;
 
-    inline void moveLayoutList(QLinkedList<DanmuObject *> &list, float step);
-    QSharedPointer<DanmuComment> danmuAtList(QPointF point,QLinkedList<DanmuObject *> &list);
+    void resetLanes(const QRectF &rect);
+    inline double freeAt(const DanmuObject *obj) const;
     inline bool isCollided(const DanmuObject *d1, const DanmuObject *d2);
 };
 
@@ -8,61 +8,51 @@ TopLayout::TopLayout(DanmuRender *render):DanmuLayout(render),life_time(5000)
 void TopLayout::addDanmu(QSharedPointer<DanmuComment> danmu, DanmuDrawInfo *drawInfo)
 {
     const QRectF rect=render->surfaceRect;
-    float currentY=margin_y+rect.top();
+    if(rect!=spaceRect) resetSpace(rect);
     float dm_height=drawInfo->height;
     DanmuObject *dmobj=new DanmuObject;
     dmobj->src=danmu;
     dmobj->drawInfo=drawInfo;
     dmobj->extraData=life_time;
     dmobj->x=(rect.width()-drawInfo->width)/2;
-    bool success=false;
-    float maxSpace(0.f),dsY(0.f),cY(rect.top());
-    QLinkedList<DanmuObject *>::Iterator msPos = topdanmu.begin();
-    for(auto iter=topdanmu.begin();iter!=topdanmu.end();++iter)
+    do
     {
-        if((*iter)->y-currentY-margin_y>=dm_height)
-        {         
-            dmobj->y=currentY;
-            topdanmu.insert(iter,dmobj);
-            success=true;
-            break;
-        }
-        //for dense layout-----
-        float tmp((*iter)->y-cY);
-        if(tmp>maxSpace)
+        //the lowest free run, the scan from the top stopped at the same place
+        int row=space.findFree(qCeil(dm_height+margin_y));
+        if(row>=0)
         {
-            maxSpace=tmp;
-            dsY=cY+tmp/2;
-            msPos=iter;
-        }
-        //--------
-        cY=(*iter)->y+margin_y;
-        currentY=cY+(*iter)->drawInfo->height;
-        if(currentY+dm_height>=rect.bottom())
+            dmobj->y=rect.top()+margin_y+row;
+            addObject(dmobj);
             break;
-    }
-    if(!success)
-    {
-        do
+        }
+        if(render->dense>0)
         {
-            if(currentY+dm_height<rect.bottom())
+            //no room left, insert between two adjacent danmu, find the largest spacing
+            float maxSpace(0.f),dsY(0.f),cY(rect.top());
+            for(auto iter=topdanmu.cbegin();iter!=topdanmu.cend();++iter)
             {
-                dmobj->y=currentY;
-                topdanmu.append(dmobj);
-                break;
+                float tmp(iter.key()-cY);
+                if(tmp>maxSpace)
+                {
+                    maxSpace=tmp;
+                    dsY=cY+tmp/2;
+                }
+                cY=iter.key()+margin_y;
+                if(cY+(*iter)->drawInfo->height+dm_height>=rect.bottom())
+                    break;
             }
             if((render->dense==1 && maxSpace>=dm_height) || render->dense==2)
             {
                 dmobj->y=dsY;
-                topdanmu.insert(msPos,dmobj);
+                addObject(dmobj);
                 break;
             }
+        }
 #ifdef QT_DEBUG
-            qDebug()<<"top lost: "<<danmu->text<<",send time:"<<danmu->date;
+        qDebug()<<"top lost: "<<danmu->text<<",send time:"<<danmu->date;
 #endif
-            delete dmobj;
-        }while(false);
-    }
+        delete dmobj;
+    }while(false);
 }
 
 void TopLayout::moveLayout(float step)
@@ -79,6 +69,7 @@ void TopLayout::moveLayout(float step)
         }
         else
         {
+            releaseRows(current);
             delete current;
             iter=topdanmu.erase(iter);
         }
@@ -110,6 +101,7 @@ void TopLayout::cleanup()
 {
     qDeleteAll(topdanmu);
     topdanmu.clear();
+    space.reset(space.rows());
 }
 
 void TopLayout::removeBlocked()
@@ -118,6 +110,7 @@ void TopLayout::removeBlocked()
     {
         if((*iter)->src->blockBy!=-1)
         {
+            releaseRows(*iter);
             delete *iter;
             iter=topdanmu.erase(iter);
         }
@@ -133,3 +126,36 @@ TopLayout::~TopLayout()
     qDeleteAll(topdanmu);
 }
 
+void TopLayout::resetSpace(const QRectF &rect)
+{
+    spaceRect=rect;
+    space.reset(qFloor(rect.height()));
+    for(auto iter=topdanmu.cbegin();iter!=topdanmu.cend();++iter)
+    {
+        int begin,end;
+        danmuRows(*iter,begin,end);
+        space.occupy(begin,end);
+    }
+}
+
+void TopLayout::danmuRows(const DanmuObject *obj, int &begin, int &end) const
+{
+    //rows count from the top of the surface
+    begin=qFloor(obj->y-spaceRect.top());
+    end=qCeil(obj->y+obj->drawInfo->height-spaceRect.top());
+}
+
+void TopLayout::addObject(DanmuObject *obj)
+{
+    topdanmu.insert(obj->y,obj);
+    int begin,end;
+    danmuRows(obj,begin,end);
+    space.occupy(begin,end);
+}
+
+void TopLayout::releaseRows(const DanmuObject *obj)
+{
+    int begin,end;
+    danmuRows(obj,begin,end);
+    space.release(begin,end);
+}
@@ -1,6 +1,7 @@
 #ifndef TOPLAYOUT_H
 #define TOPLAYOUT_H
 #include "Play/Danmu/Render/danmurender.h"
+#include "trackindex.h"
 
 class TopLayout : public DanmuLayout
 {
@@ -17,7 +18,15 @@ public:
     virtual ~TopLayout();
 private:
     float life_time;
-    QLinkedList<DanmuObject *> topdanmu;
+    //ordered by y
+    QMultiMap<float,DanmuObject *> topdanmu;
+    SpaceTree space;
+    QRectF spaceRect;
+
+    void resetSpace(const QRectF &rect);
+    inline void danmuRows(const DanmuObject *obj, int &begin, int &end) const;
+    inline void addObject(DanmuObject *obj);
+    inline void releaseRows(const DanmuObject *obj);
 };
 
 #endif // TOPLAYOUT_H
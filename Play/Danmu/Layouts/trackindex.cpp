@@ -0,0 +1,199 @@
+#include "trackindex.h"
+
+void SpaceTree::reset(int rows)
+{
+    size=qMax(rows,0);
+    nodes.resize(size>0?4*size:0);
+    if(size>0) build(1,0,size);
+}
+
+int SpaceTree::findFree(int len) const
+{
+    if(len<=0) return 0;
+    if(size==0 || nodes[1].best<len) return -1;
+    //a node with a free run has no cover, the run is in a child or across the middle
+    int node=1,l=0,r=size;
+    while(r-l>1)
+    {
+        const int mid=(l+r)/2;
+        const Node &left=nodes[2*node],&right=nodes[2*node+1];
+        if(left.best>=len)
+        {
+            node=2*node;
+            r=mid;
+        }
+        else if(left.suffix+right.prefix>=len)
+        {
+            return mid-left.suffix;
+        }
+        else
+        {
+            node=2*node+1;
+            l=mid;
+        }
+    }
+    return l;
+}
+
+void SpaceTree::build(int node, int l, int r)
+{
+    nodes[node].cover=0;
+    if(r-l>1)
+    {
+        const int mid=(l+r)/2;
+        build(2*node,l,mid);
+        build(2*node+1,mid,r);
+    }
+    pull(node,l,r);
+}
+
+void SpaceTree::update(int node, int l, int r, int begin, int end, int delta)
+{
+    if(end<=l || r<=begin || begin>=end) return;
+    if(begin<=l && r<=end)
+    {
+        //covers are added and removed with the same range, they never need to be pushed down
+        nodes[node].cover+=delta;
+        pull(node,l,r);
+        return;
+    }
+    const int mid=(l+r)/2;
+    update(2*node,l,mid,begin,end,delta);
+    update(2*node+1,mid,r,begin,end,delta);
+    pull(node,l,r);
+}
+
+void SpaceTree::pull(int node, int l, int r)
+{
+    Node &cur=nodes[node];
+    if(cur.cover>0)
+    {
+        cur.prefix=cur.suffix=cur.best=0;
+    }
+    else if(r-l==1)
+    {
+        cur.prefix=cur.suffix=cur.best=1;
+    }
+    else
+    {
+        const int mid=(l+r)/2;
+        const Node &left=nodes[2*node],&right=nodes[2*node+1];
+        cur.prefix=left.prefix==mid-l?mid-l+right.prefix:left.prefix;
+        cur.suffix=right.suffix==r-mid?r-mid+left.suffix:right.suffix;
+        cur.best=qMax(qMax(left.best,right.best),left.suffix+right.prefix);
+    }
+}
+
+void LaneTree::reset(float surfaceTop, const QVector<Lane> &laneList)
+{
+    top=surfaceTop;
+    lanes=laneList;
+    rebuild();
+}
+
+void LaneTree::clear()
+{
+    lanes.clear();
+    nodes.clear();
+}
+
+void LaneTree::insert(int i, const Lane &lane)
+{
+    lanes.insert(i,lane);
+    rebuild();
+}
+
+void LaneTree::replace(int i, const Lane &lane)
+{
+    lanes[i]=lane;
+    //the room above the next lane is measured from this one
+    update(1,0,lanes.count(),i);
+    if(i+1<lanes.count()) update(1,0,lanes.count(),i+1);
+}
+
+int LaneTree::findCandidate(int from, int to, float height, double clock) const
+{
+    if(from>=qMin(to,lanes.count())) return -1;
+    return find(1,0,lanes.count(),from,to,height,clock);
+}
+
+int LaneTree::findBottom(float y) const
+{
+    if(lanes.isEmpty() || nodes[1].maxBottom<y) return lanes.count();
+    int node=1,l=0,r=lanes.count();
+    while(r-l>1)
+    {
+        const int mid=(l+r)/2;
+        if(nodes[2*node].maxBottom>=y)
+        {
+            node=2*node;
+            r=mid;
+        }
+        else
+        {
+            node=2*node+1;
+            l=mid;
+        }
+    }
+    return l;
+}
+
+void LaneTree::rebuild()
+{
+    nodes.resize(lanes.isEmpty()?0:4*lanes.count());
+    if(!lanes.isEmpty()) build(1,0,lanes.count());
+}
+
+void LaneTree::build(int node, int l, int r)
+{
+    if(r-l==1)
+    {
+        setLeaf(node,l);
+        return;
+    }
+    const int mid=(l+r)/2;
+    build(2*node,l,mid);
+    build(2*node+1,mid,r);
+    pull(node);
+}
+
+void LaneTree::update(int node, int l, int r, int i)
+{
+    if(r-l==1)
+    {
+        setLeaf(node,i);
+        return;
+    }
+    const int mid=(l+r)/2;
+    if(i<mid) update(2*node,l,mid,i);
+    else update(2*node+1,mid,r,i);
+    pull(node);
+}
+
+void LaneTree::setLeaf(int node, int i)
+{
+    Node &leaf=nodes[node];
+    leaf.maxGap=lanes.at(i).last->y-(i>0?bottom(i-1):top);
+    leaf.maxBottom=bottom(i);
+    leaf.minFreeAt=lanes.at(i).freeAt;
+}
+
+void LaneTree::pull(int node)
+{
+    Node &cur=nodes[node];
+    const Node &left=nodes[2*node],&right=nodes[2*node+1];
+    cur.maxGap=qMax(left.maxGap,right.maxGap);
+    cur.maxBottom=qMax(left.maxBottom,right.maxBottom);
+    cur.minFreeAt=qMin(left.minFreeAt,right.minFreeAt);
+}
+
+int LaneTree::find(int node, int l, int r, int from, int to, float height, double clock) const
+{
+    if(r<=from || to<=l) return -1;
+    const Node &cur=nodes[node];
+    if(cur.maxGap<height && cur.minFreeAt>clock) return -1;
+    if(r-l==1) return l;
+    const int mid=(l+r)/2;
+    const int ret=find(2*node,l,mid,from,to,height,clock);
+    return ret>=0?ret:find(2*node+1,mid,r,from,to,height,clock);
+}
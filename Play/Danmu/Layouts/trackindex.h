@@ -0,0 +1,102 @@
+#ifndef TRACKINDEX_H
+#define TRACKINDEX_H
+#include <QtCore>
+#include <algorithm>
+#include "Play/Danmu/common.h"
+/*
+ * Occupancy indexes of the layouts, placing a danmu no longer walks everything on the surface.
+ */
+
+/*
+ * Rows of the surface covered by static(top/bottom) danmu.
+ * A segment tree over the rows: every node keeps how many danmu cover all of it and the longest
+ * free run inside it, so occupy/release and finding the lowest free run are O(log rows).
+ * Danmu may overlap(dense layout), a row is free only when nothing covers it.
+ */
+class SpaceTree
+{
+public:
+    SpaceTree():size(0){}
+    //all rows free
+    void reset(int rows);
+    inline int rows() const {return size;}
+    //[begin, end), clipped to the rows
+    void occupy(int begin, int end){update(1,0,size,qMax(begin,0),qMin(end,size),1);}
+    void release(int begin, int end){update(1,0,size,qMax(begin,0),qMin(end,size),-1);}
+    //the lowest row of a free run of at least len rows, -1 if there is none
+    int findFree(int len) const;
+private:
+    struct Node
+    {
+        int cover;      //danmu covering the whole node
+        int prefix;     //free rows from the start of the node
+        int suffix;     //free rows up to the end of the node
+        int best;       //the longest free run in the node
+    };
+    QVector<Node> nodes;
+    int size;
+
+    void build(int node, int l, int r);
+    void update(int node, int l, int r, int begin, int end, int delta);
+    void pull(int node, int l, int r);
+};
+
+/*
+ * Lanes of the roll layout ordered by y, each one keeps its latest danmu.
+ * A lane takes a new danmu when there is room above it or when its latest danmu is no longer in
+ * the way(RollLayout::isCollided). The second can not be known without the new danmu, but it is
+ * never the case before the tail of the latest one has entered the surface, so every lane keeps
+ * that moment as its free-at time on the layout clock. It does not change while the danmu moves.
+ * A segment tree over the lanes keeps the largest room above a lane, the earliest free-at time and
+ * the lowest bottom, the layout jumps to the lanes that may take the danmu in O(log lanes).
+ */
+class LaneTree
+{
+public:
+    struct Lane
+    {
+        DanmuObject *last;
+        double freeAt;
+    };
+    LaneTree():top(0.f){}
+    //top: the first lane measures its room from here
+    void reset(float surfaceTop, const QVector<Lane> &laneList);
+    void clear();
+    inline int count() const {return lanes.count();}
+    inline const Lane &at(int i) const {return lanes.at(i);}
+    inline const QVector<Lane> &laneList() const {return lanes;}
+    inline float bottom(int i) const {return lanes.at(i).last->y+lanes.at(i).last->drawInfo->height;}
+    void insert(int i, const Lane &lane);
+    void replace(int i, const Lane &lane);
+    //the lanes pred returns true for are dropped in one pass, pred is called once for every lane
+    template<typename Pred>
+    void removeIf(Pred pred)
+    {
+        auto end=std::remove_if(lanes.begin(),lanes.end(),[&pred](const Lane &lane){return pred(lane.last);});
+        if(end==lanes.end()) return;
+        lanes.erase(end,lanes.end());
+        rebuild();
+    }
+    //the first lane in [from, to) with at least height room above it or free at clock, -1 if none
+    int findCandidate(int from, int to, float height, double clock) const;
+    //the first lane with the bottom not above y, count() if none
+    int findBottom(float y) const;
+private:
+    struct Node
+    {
+        float maxGap;
+        float maxBottom;
+        double minFreeAt;
+    };
+    QVector<Lane> lanes;
+    QVector<Node> nodes;
+    float top;
+
+    void rebuild();
+    void build(int node, int l, int r);
+    void update(int node, int l, int r, int i);
+    void setLeaf(int node, int i);
+    void pull(int node);
+    int find(int node, int l, int r, int from, int to, float height, double clock) const;
+};
+#endif // TRACKINDEX_H
@@ -0,0 +1,295 @@
+#include "danmublock.h"
+#include "../common.h"
+#include <algorithm>
+
+namespace
+{
+    const char BlockMagic[]={'K','D','B'};
+    const char BlockVersion=1;
+
+    class Writer
+    {
+    public:
+        explicit Writer(QByteArray &buffer):buf(buffer){}
+        void putVarint(quint64 val)
+        {
+            while(val>=0x80)
+            {
+                buf.append(char((val&0x7f)|0x80));
+                val>>=7;
+            }
+            buf.append(char(val));
+        }
+        inline void putSigned(qint64 val) {putVarint((quint64(val)<<1)^quint64(val>>63));}
+        inline void putByte(quint8 val) {buf.append(char(val));}
+        inline void putBytes(const QByteArray &bytes) {putVarint(bytes.size());buf.append(bytes);}
+    private:
+        QByteArray &buf;
+    };
+
+    class Reader
+    {
+    public:
+        Reader(const char *begin, const char *end):p(reinterpret_cast<const uchar *>(begin)),
+            e(reinterpret_cast<const uchar *>(end)),ok(true){}
+        quint64 varint()
+        {
+            quint64 val=0;
+            for(int shift=0;shift<64;shift+=7)
+            {
+                if(p>=e) break;
+                const uchar b=*p++;
+                val|=quint64(b&0x7f)<<shift;
+                if(!(b&0x80)) return val;
+            }
+            ok=false;
+            return 0;
+        }
+        inline qint64 signedVarint() {quint64 v=varint(); return qint64(v>>1)^-qint64(v&1);}
+        inline quint8 byte()
+        {
+            if(p>=e) {ok=false; return 0;}
+            return *p++;
+        }
+        const char *bytes(int len)
+        {
+            if(len<0 || e-p<len) {ok=false; return nullptr;}
+            const char *ret=reinterpret_cast<const char *>(p);
+            p+=len;
+            return ret;
+        }
+        inline bool good() const {return ok;}
+        inline const char *pos() const {return reinterpret_cast<const char *>(p);}
+    private:
+        const uchar *p, *e;
+        bool ok;
+    };
+
+    void encodeSegment(QList<DanmuComment *>::const_iterator begin, QList<DanmuComment *>::const_iterator end, QByteArray &buf)
+    {
+        Writer writer(buf);
+        const int count=end-begin;
+        writer.putVarint(count);
+        int lastTime=0;
+        qint64 lastDate=0;
+        for(auto iter=begin;iter!=end;++iter)
+        {
+            writer.putSigned(qint64((*iter)->originTime)-lastTime);
+            lastTime=(*iter)->originTime;
+        }
+        for(auto iter=begin;iter!=end;++iter)
+        {
+            writer.putSigned((*iter)->date-lastDate);
+            lastDate=(*iter)->date;
+        }
+        QHash<int,int> colorIds;
+        QVector<int> colors;
+        QVector<int> colorIndex;
+        colorIndex.reserve(count);
+        for(auto iter=begin;iter!=end;++iter)
+        {
+            auto cIter=colorIds.constFind((*iter)->color);
+            if(cIter==colorIds.cend())
+            {
+                cIter=colorIds.insert((*iter)->color,colors.count());
+                colors.append((*iter)->color);
+            }
+            colorIndex.append(cIter.value());
+        }
+        writer.putVarint(colors.count());
+        for(int color:colors) writer.putVarint(quint32(color));
+        for(int index:colorIndex) writer.putVarint(index);
+        for(auto iter=begin;iter!=end;++iter)
+            writer.putByte(quint8((*iter)->type)|(quint8((*iter)->fontSizeLevel)<<2));
+        QHash<QString,int> senderIds;
+        QStringList senders;
+        QVector<int> senderIndex;
+        senderIndex.reserve(count);
+        for(auto iter=begin;iter!=end;++iter)
+        {
+            auto sIter=senderIds.constFind((*iter)->sender);
+            if(sIter==senderIds.cend())
+            {
+                sIter=senderIds.insert((*iter)->sender,senders.count());
+                senders.append((*iter)->sender);
+            }
+            senderIndex.append(sIter.value());
+        }
+        writer.putVarint(senders.count());
+        for(const QString &sender:senders) writer.putBytes(sender.toUtf8());
+        for(int index:senderIndex) writer.putVarint(index);
+        QByteArray texts;
+        for(auto iter=begin;iter!=end;++iter)
+        {
+            const QByteArray text((*iter)->text.toUtf8());
+            writer.putVarint(text.size());
+            texts.append(text);
+        }
+        writer.putBytes(qCompress(texts));
+    }
+
+    bool decodeSegmentData(const char *begin, const char *end, int source, QList<DanmuComment *> &outList)
+    {
+        Reader reader(begin,end);
+        const int count=int(reader.varint());
+        if(!reader.good() || count<0 || count>end-begin) return false;
+        QVector<DanmuComment *> comments(count);
+        for(int i=0;i<count;++i)
+        {
+            DanmuComment *danmu=new DanmuComment;
+            danmu->source=source;
+            comments[i]=danmu;
+        }
+        int lastTime=0;
+        qint64 lastDate=0;
+        for(DanmuComment *danmu:comments)
+        {
+            lastTime+=int(reader.signedVarint());
+            danmu->originTime=danmu->time=lastTime;
+        }
+        for(DanmuComment *danmu:comments)
+        {
+            lastDate+=reader.signedVarint();
+            danmu->date=lastDate;
+        }
+        const int colorCount=int(reader.varint());
+        if(!reader.good() || colorCount<0 || colorCount>end-begin)
+        {
+            qDeleteAll(comments);
+            return false;
+        }
+        QVector<int> colors(colorCount);
+        for(int &color:colors) color=int(quint32(reader.varint()));
+        for(DanmuComment *danmu:comments)
+        {
+            const int index=int(reader.varint());
+            danmu->color=(index>=0 && index<colors.count())?colors.at(index):0xffffff;
+        }
+        for(DanmuComment *danmu:comments)
+        {
+            const quint8 attr=reader.byte();
+            const int type=attr&0x3, size=attr>>2;
+            danmu->type=DanmuComment::DanmuType(type<3?type:0);
+            danmu->fontSizeLevel=DanmuComment::FontSizeLevel(size<3?size:0);
+        }
+        QStringList senders;
+        const int senderCount=int(reader.varint());
+        for(int i=0;i<senderCount && reader.good();++i)
+        {
+            const int len=int(reader.varint());
+            const char *str=reader.bytes(len);
+            senders.append(str?QString::fromUtf8(str,len):QString());
+        }
+        for(DanmuComment *danmu:comments)
+        {
+            const int index=int(reader.varint());
+            if(index>=0 && index<senders.count()) danmu->sender=senders.at(index);
+        }
+        QVector<int> textLengths(count);
+        for(int &len:textLengths) len=int(reader.varint());
+        const int compressedSize=int(reader.varint());
+        const char *compressed=reader.bytes(compressedSize);
+        if(!reader.good() || !compressed)
+        {
+            qDeleteAll(comments);
+            return false;
+        }
+        const QByteArray texts(qUncompress(reinterpret_cast<const uchar *>(compressed),compressedSize));
+        const char *text=texts.constData(), *textEnd=text+texts.size();
+        for(int i=0;i<count;++i)
+        {
+            if(textLengths.at(i)<0 || textEnd-text<textLengths.at(i))
+            {
+                qDeleteAll(comments);
+                return false;
+            }
+            comments[i]->text=QString::fromUtf8(text,textLengths.at(i));
+            text+=textLengths.at(i);
+        }
+        for(DanmuComment *danmu:comments)
+            outList.append(danmu);
+        return true;
+    }
+}
+
+QByteArray DanmuBlock::encode(const QList<DanmuComment *> &comments)
+{
+    QList<DanmuComment *> sorted;
+    sorted.reserve(comments.count());
+    for(DanmuComment *danmu:comments)
+    {
+        if(!danmu->text.isEmpty()) sorted.append(danmu);
+    }
+    std::stable_sort(sorted.begin(),sorted.end(),[](const DanmuComment *dm1, const DanmuComment *dm2){
+        return dm1->originTime<dm2->originTime;
+    });
+    QVector<QByteArray> bodies;
+    for(int i=0;i<sorted.count();i+=SegmentSize)
+    {
+        QByteArray body;
+        encodeSegment(sorted.cbegin()+i,sorted.cbegin()+qMin(i+SegmentSize,sorted.count()),body);
+        bodies.append(body);
+    }
+    QByteArray buf;
+    Writer writer(buf);
+    buf.append(BlockMagic,sizeof(BlockMagic));
+    writer.putByte(BlockVersion);
+    writer.putVarint(sorted.count());
+    writer.putVarint(bodies.count());
+    for(int i=0;i<bodies.count();++i)
+    {
+        const int first=i*SegmentSize, last=qMin(first+SegmentSize,sorted.count())-1;
+        writer.putSigned(sorted.at(first)->originTime);
+        writer.putSigned(sorted.at(last)->originTime);
+        writer.putVarint(last-first+1);
+        writer.putVarint(bodies.at(i).size());
+    }
+    for(const QByteArray &body:bodies)
+        buf.append(body);
+    return buf;
+}
+
+DanmuBlock::DanmuBlock(const QByteArray &data):data(data),total(0),valid(false)
+{
+    if(data.size()<int(sizeof(BlockMagic))+1 || memcmp(data.constData(),BlockMagic,sizeof(BlockMagic))!=0) return;
+    Reader reader(data.constData()+sizeof(BlockMagic),data.constData()+data.size());
+    if(reader.byte()!=BlockVersion) return;
+    total=int(reader.varint());
+    const int segCount=int(reader.varint());
+    if(!reader.good() || segCount<0 || segCount>data.size()) return;
+    segs.resize(segCount);
+    int bodySize=0;
+    for(Segment &seg:segs)
+    {
+        seg.startTime=int(reader.signedVarint());
+        seg.endTime=int(reader.signedVarint());
+        seg.count=int(reader.varint());
+        seg.size=int(reader.varint());
+        seg.offset=bodySize;
+        bodySize+=seg.size;
+    }
+    if(!reader.good()) return;
+    const int bodyBegin=reader.pos()-data.constData();
+    if(data.size()-bodyBegin<bodySize) return;
+    for(Segment &seg:segs)
+        seg.offset+=bodyBegin;
+    valid=true;
+}
+
+bool DanmuBlock::decodeSegment(int index, int source, QList<DanmuComment *> &outList) const
+{
+    if(!valid || index<0 || index>=segs.count()) return false;
+    const Segment &seg=segs.at(index);
+    return decodeSegmentData(data.constData()+seg.offset,data.constData()+seg.offset+seg.size,source,outList);
+}
+
+bool DanmuBlock::decode(int source, QList<DanmuComment *> &outList) const
+{
+    if(!valid) return false;
+    outList.reserve(outList.count()+total);
+    for(int i=0;i<segs.count();++i)
+    {
+        if(!decodeSegment(i,source,outList)) return false;
+    }
+    return true;
+}
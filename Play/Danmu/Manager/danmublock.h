@@ -0,0 +1,42 @@
+#ifndef DANMUBLOCK_H
+#define DANMUBLOCK_H
+#include <QtCore>
+class DanmuComment;
+/*
+ * Columnar binary format for the comments of one pool source, stored as one danmu_block record.
+ * Comments are sorted by time and split into segments of at most SegmentSize comments,
+ * every segment can be decoded alone:
+ *   times/dates        zigzag varint deltas
+ *   colors, senders    dictionary + varint index
+ *   type, font size    one byte
+ *   texts              varint UTF-8 lengths + one qCompress'ed block
+ * The header keeps the time range and size of every segment, so a time window
+ * can be decoded without touching the rest. Decoding reads the buffer in place.
+ */
+class DanmuBlock
+{
+public:
+    struct Segment
+    {
+        int startTime, endTime; //originTime of the first/last comment
+        int count;
+        int offset, size;
+    };
+    static const int SegmentSize=2048;
+    //comments with empty text are skipped
+    static QByteArray encode(const QList<DanmuComment *> &comments);
+
+    explicit DanmuBlock(const QByteArray &data);
+    inline bool isValid() const {return valid;}
+    inline int count() const {return total;}
+    inline const QVector<Segment> &segments() const {return segs;}
+    //new comments are appended to outList, the caller owns them
+    bool decodeSegment(int index, int source, QList<DanmuComment *> &outList) const;
+    bool decode(int source, QList<DanmuComment *> &outList) const;
+private:
+    QByteArray data;
+    QVector<Segment> segs;
+    int total;
+    bool valid;
+};
+#endif // DANMUBLOCK_H
@@ -0,0 +1,104 @@
+#include "danmuimporter.h"
+#include <QtConcurrent>
+#include "pool.h"
+#include "../blocker.h"
+#include "../Provider/localprovider.h"
+#include "globalobjects.h"
+
+QList<DanmuImporter *> DanmuImporter::running;
+
+DanmuImporter::DanmuImporter(Pool *pool):pool(pool),cancelled(new QAtomicInt(0)),parsedCount(0)
+{
+    running.append(this);
+}
+
+DanmuImporter::~DanmuImporter()
+{
+    running.removeOne(this);
+    for(auto &danmuList:results)
+        qDeleteAll(danmuList);
+}
+
+bool DanmuImporter::isSupported(const QString &fileName)
+{
+    return QFileInfo(fileName).suffix().compare("xml",Qt::CaseInsensitive)==0;
+}
+
+void DanmuImporter::start(const QStringList &files)
+{
+    fileList=files;
+    results.resize(files.count());
+    if(files.isEmpty())
+    {
+        merge();
+        return;
+    }
+    QSharedPointer<QAtomicInt> cancelFlag(cancelled);
+    for(int i=0;i<files.count();++i)
+    {
+        //the importer is not deleted before every file comes back
+        QtConcurrent::run(QThreadPool::globalInstance(),[this,cancelFlag,i](){
+            QList<DanmuComment *> danmuList;
+            if(!cancelFlag->loadAcquire())
+                LocalProvider::LoadXmlDanmuFile(fileList.at(i),danmuList);
+            QMetaObject::invokeMethod(this,[this,i,danmuList](){
+                onFileParsed(i,danmuList);
+            },Qt::QueuedConnection);
+        });
+    }
+}
+
+void DanmuImporter::cancel()
+{
+    cancelled->storeRelease(1);
+}
+
+void DanmuImporter::cancelAll()
+{
+    for(DanmuImporter *importer:running)
+        importer->cancel();
+}
+
+void DanmuImporter::onFileParsed(int index, const QList<DanmuComment *> &danmuList)
+{
+    results[index]=danmuList;
+    //the rules keep their regexp state, they are only used on one thread
+    GlobalObjects::blocker->preFilter(results[index]);
+    ++parsedCount;
+    emit fileParsed(fileList.at(index),results.at(index).count(),parsedCount,fileList.count());
+    if(parsedCount==fileList.count()) merge();
+}
+
+void DanmuImporter::merge()
+{
+    QList<int> sourceIds;
+    const bool isCancelled=cancelled->loadAcquire() || !pool;
+    if(!isCancelled && !fileList.isEmpty())
+    {
+        QList<DanmuSourceInfo> sourceInfos;
+        QList<QList<DanmuComment *> > danmuLists;
+        for(int i=0;i<fileList.count();++i)
+        {
+            DanmuSourceInfo sourceInfo;
+            sourceInfo.delay=0;
+            sourceInfo.name=QFileInfo(fileList.at(i)).fileName();
+            sourceInfo.show=true;
+            sourceInfo.url=fileList.at(i);
+            sourceInfo.count=results.at(i).count();
+            sourceInfos.append(sourceInfo);
+            danmuLists.append(results.at(i));
+        }
+#ifdef QT_DEBUG
+        QElapsedTimer timer;
+        timer.start();
+#endif
+        sourceIds=pool->addSources(sourceInfos,danmuLists,true);
+#ifdef QT_DEBUG
+        qDebug()<<"import"<<fileList.count()<<"files, merge:"<<timer.elapsed()<<"ms";
+#endif
+        //the pool owns the comments unless it was busy
+        if(!sourceIds.isEmpty()) results.clear();
+    }
+    emit finished(sourceIds,isCancelled);
+    deleteLater();
+}
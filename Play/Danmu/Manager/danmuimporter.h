@@ -0,0 +1,43 @@
+#ifndef DANMUIMPORTER_H
+#define DANMUIMPORTER_H
+#include <QObject>
+#include <QPointer>
+#include "../common.h"
+class Pool;
+/*
+ * Adds local danmu files to a pool as new sources.
+ * The files are parsed on the global thread pool at the same time and prefiltered on the thread
+ * of the importer as they come back. When all are parsed they go into the pool together (Pool::addSources): dedup against
+ * the fingerprint index, one sort and one transaction for all of them.
+ * Signals come on the thread of the importer, it deletes itself after finished().
+ */
+class DanmuImporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DanmuImporter(Pool *pool);
+    ~DanmuImporter();
+    //xml files in the Bilibili format
+    static bool isSupported(const QString &fileName);
+    void start(const QStringList &files);
+    //files not parsed yet are skipped, nothing is added to the pool
+    void cancel();
+    //when the main window closes, the pools are cleaned right after
+    static void cancelAll();
+signals:
+    void fileParsed(const QString &fileName, int count, int parsedFiles, int totalFiles);
+    //sources: ids in the pool, empty if cancelled or the pool is busy
+    void finished(const QList<int> &sources, bool cancelled);
+private:
+    QPointer<Pool> pool;
+    QStringList fileList;
+    QVector<QList<DanmuComment *> > results;
+    QSharedPointer<QAtomicInt> cancelled;
+    int parsedCount;
+    //importers not finished yet, only used on the main thread
+    static QList<DanmuImporter *> running;
+
+    void onFileParsed(int index, const QList<DanmuComment *> &danmuList);
+    void merge();
+};
+#endif // DANMUIMPORTER_H
@@ -6,8 +6,13 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QMessageBox>
+#include <QTimer>
 #include "pool.h"
+#include "danmublock.h"
+#include "poolloader.h"
+#include "refreshscheduler.h"
 #include "Common/threadtask.h"
+#include "Common/dbexecutor.h"
 #include "Common/network.h"
 #include "../common.h"
 #include "../blocker.h"
@@ -15,15 +20,180 @@
 #include "../providermanager.h"
 #include "globalobjects.h"
 
+namespace
+{
+    //comments of a pool source in the DanmuBlock format, databases created before it get the table here
+    const char *createBlockTable=
+            "CREATE TABLE IF NOT EXISTS \"danmu_block\" ("
+            "\"PoolID\"  TEXT(32) NOT NULL,"
+            "\"Source\"  INTEGER NOT NULL,"
+            "\"Count\"  INTEGER,"
+            "\"Data\"  BLOB,"
+            "PRIMARY KEY (\"PoolID\", \"Source\") ON CONFLICT REPLACE,"
+            "CONSTRAINT \"PoolID\" FOREIGN KEY (\"PoolID\") REFERENCES \"pool\" (\"PoolID\") ON DELETE CASCADE ON UPDATE CASCADE"
+            ")";
+    //comment count of every pool source in the danmu_N tables, kept by the triggers below
+    const char *createCountTable=
+            "CREATE TABLE IF NOT EXISTS \"danmu_count\" ("
+            "\"PoolID\"  TEXT(32) NOT NULL,"
+            "\"Source\"  INTEGER NOT NULL,"
+            "\"Count\"  INTEGER,"
+            "PRIMARY KEY (\"PoolID\", \"Source\"),"
+            "CONSTRAINT \"PoolID\" FOREIGN KEY (\"PoolID\") REFERENCES \"pool\" (\"PoolID\") ON DELETE CASCADE ON UPDATE CASCADE"
+            ")";
+    const char *createDanmuTable=
+            "CREATE TABLE IF NOT EXISTS \"danmu_%1\" ("
+            "\"PoolID\"  TEXT(32) NOT NULL,"
+            "\"Time\"  INTEGER,"
+            "\"Date\"  INTEGER,"
+            "\"Color\"  INTEGER,"
+            "\"Mode\"  INTEGER,"
+            "\"Size\"  INTEGER,"
+            "\"Source\"  INTEGER,"
+            "\"User\"  TEXT,"
+            "\"Text\"  TEXT,"
+            "CONSTRAINT \"PoolID\" FOREIGN KEY (\"PoolID\") REFERENCES \"pool\" (\"PoolID\") ON DELETE CASCADE ON UPDATE CASCADE"
+            ")";
+    //loads, source deletes and comment deletes all start with PoolID,Source
+    const char *createDanmuIndex=
+            "CREATE INDEX IF NOT EXISTS \"PoolSourceTime_%1\" ON \"danmu_%1\" (\"PoolID\", \"Source\", \"Time\")";
+    const char *createInsertTrigger=
+            "CREATE TRIGGER IF NOT EXISTS \"danmu_%1_insert\" AFTER INSERT ON \"danmu_%1\" BEGIN "
+            "INSERT OR IGNORE INTO danmu_count(PoolID,Source,Count) VALUES(new.PoolID,new.Source,0); "
+            "UPDATE danmu_count SET Count=Count+1 WHERE PoolID=new.PoolID AND Source=new.Source; "
+            "END";
+    const char *createDeleteTrigger=
+            "CREATE TRIGGER IF NOT EXISTS \"danmu_%1_delete\" AFTER DELETE ON \"danmu_%1\" BEGIN "
+            "UPDATE danmu_count SET Count=Count-1 WHERE PoolID=old.PoolID AND Source=old.Source; "
+            "DELETE FROM danmu_count WHERE PoolID=old.PoolID AND Source=old.Source AND Count<=0; "
+            "END";
+    //PRAGMA user_version of comment.db
+    //1: danmu_block
+    //2: danmu_count, (PoolID,Source,Time) indexes
+    const int CommentDBVersion=2;
+    const int MaxDanmuTableCount=64;
+    //9 values a row, stays under the 999 variables of older SQLite builds
+    const int InsertBatchRows=100;
+
+    void createShard(QSqlQuery &query, int index)
+    {
+        query.exec(QString(createDanmuTable).arg(index));
+        query.exec(QString("DROP INDEX IF EXISTS \"PoolID_%1\"").arg(index));
+        query.exec(QString(createDanmuIndex).arg(index));
+        query.exec(QString(createInsertTrigger).arg(index));
+        query.exec(QString(createDeleteTrigger).arg(index));
+    }
+}
+
 DanmuManager *PoolStateLock::manager=nullptr;
+template<typename Func>
+auto DanmuManager::writePool(const QString &pid, Func task) -> QFuture<decltype(task())>
+{
+    {
+        QMutexLocker locker(&pendingWriteLock);
+        ++pendingPoolWrites[pid];
+    }
+    auto future=GlobalObjects::dbExecutor->write(task);
+    //the writer keeps the order, the count drops once the task is committed
+    GlobalObjects::dbExecutor->write([this,pid](){
+        QMutexLocker locker(&pendingWriteLock);
+        if(--pendingPoolWrites[pid]==0) pendingPoolWrites.remove(pid);
+    });
+    return future;
+}
+
+bool DanmuManager::hasPendingWrites(const QString &pid)
+{
+    QMutexLocker locker(&pendingWriteLock);
+    return pendingPoolWrites.contains(pid);
+}
+
 DanmuManager::DanmuManager(QObject *parent) : QObject(parent),countInited(false)
 {
+    windowedLoad=GlobalObjects::appSetting->value("DanmuManager/WindowedLoad",true).toBool();
     cacheLock = new QMutex(QMutex::Recursive);
     removeLock = new QMutex(QMutex::Recursive);
     PoolStateLock::manager=this;
+    danmuTableCount=qBound(1,GlobalObjects::appSetting->value("DanmuManager/DanmuTableCount",5).toInt(),MaxDanmuTableCount);
+    refreshPool.setMaxThreadCount(qBound(1,GlobalObjects::appSetting->value("DanmuManager/RefreshThreads",6).toInt(),32));
+    refreshPool.setExpiryTimeout(-1);
+    providerRefreshLimit=qMax(1,GlobalObjects::appSetting->value("DanmuManager/ProviderRefreshLimit",2).toInt());
+    upgradeDB();
     loadAllPool();
 }
 
+void DanmuManager::upgradeDB()
+{
+    QSqlDatabase db(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+    QSqlQuery query(db);
+    query.exec("PRAGMA user_version");
+    const int version=query.first()?query.value(0).toInt():0;
+    //the danmu_N tables in the file, may differ from the configured count
+    int fileTableCount=0;
+    query.exec("select name from sqlite_master where type='table' and name like 'danmu_%'");
+    while (query.next())
+    {
+        bool ok=false;
+        const int index=query.value(0).toString().mid(6).toInt(&ok);
+        if(ok) fileTableCount=qMax(fileTableCount,index+1);
+    }
+    if(version>=CommentDBVersion && fileTableCount==danmuTableCount) return;
+#ifdef QT_DEBUG
+    QElapsedTimer timer;
+    timer.start();
+#endif
+    db.transaction();
+    if(version<1)
+    {
+        query.exec(createBlockTable);
+    }
+    if(version<2)
+    {
+        query.exec(createCountTable);
+        for(int i=0;i<fileTableCount;++i)
+            createShard(query,i);
+        for(int i=0;i<fileTableCount;++i)
+            query.exec(QString("insert into danmu_count(PoolID,Source,Count) "
+                               "select PoolID,Source,count(*) from danmu_%1 group by PoolID,Source").arg(i));
+    }
+    for(int i=fileTableCount;i<danmuTableCount;++i)
+        createShard(query,i);
+    if(fileTableCount!=danmuTableCount)
+    {
+        //move the rows of every pool to its new table, the triggers keep danmu_count
+        QSqlQuery moveQuery(db), deleteQuery(db);
+        for(int i=0;i<fileTableCount;++i)
+        {
+            //read the ids first, the table is not changed under an open select
+            QStringList pids;
+            query.exec(QString("select distinct PoolID from danmu_%1").arg(i));
+            while (query.next())
+                pids.append(query.value(0).toString());
+            query.finish();
+            for(const QString &pid:pids)
+            {
+                const int newId=tableId(pid);
+                if(newId==i) continue;
+                moveQuery.prepare(QString("insert into danmu_%1(PoolID,Time,Date,Color,Mode,Size,Source,User,Text) "
+                                          "select PoolID,Time,Date,Color,Mode,Size,Source,User,Text from danmu_%2 where PoolID=?").arg(newId).arg(i));
+                moveQuery.bindValue(0,pid);
+                moveQuery.exec();
+                deleteQuery.prepare(QString("delete from danmu_%1 where PoolID=?").arg(i));
+                deleteQuery.bindValue(0,pid);
+                deleteQuery.exec();
+            }
+        }
+        for(int i=danmuTableCount;i<fileTableCount;++i)
+            query.exec(QString("DROP TABLE IF EXISTS \"danmu_%1\"").arg(i));
+    }
+    query.exec(QString("PRAGMA user_version=%1").arg(CommentDBVersion));
+    db.commit();
+#ifdef QT_DEBUG
+    qDebug()<<"comment db upgraded, version:"<<version<<"->"<<CommentDBVersion<<"tables:"<<fileTableCount<<"->"<<danmuTableCount
+           <<"time:"<<timer.elapsed()<<"ms";
+#endif
+}
+
 DanmuManager::~DanmuManager()
 {
     //poolWorker->deleteLater();
@@ -44,41 +214,96 @@ Pool *DanmuManager::getPool(const QString &pid, bool loadDanmu)
     return pool;
 }
 
+void DanmuManager::getPoolWindowed(const QString &pid, int time, QObject *context, const std::function<void(Pool *)> &callback)
+{
+    QMutexLocker locker(removeLock);
+    Pool *pool=pools.value(pid,nullptr);
+    if(!pool || pool->isLoaded)
+    {
+        if(pool)
+        {
+            pool->load(qMax(time,0));
+            refreshCache(pool);
+        }
+        locker.unlock();
+        callback(pool);
+        return;
+    }
+    QSharedPointer<PoolStateLock> stateLock(new PoolStateLock);
+    if(!stateLock->tryLock(pid))
+    {
+        //busy, e.g. updating, same as a busy getPool
+        refreshCache(pool);
+        locker.unlock();
+        callback(pool);
+        return;
+    }
+    locker.unlock();
+    QPointer<Pool> poolPtr(pool);
+    DBExecutor::then(readPool(pool,qMax(time,0)),context,[this,stateLock,poolPtr,callback](const QFuture<LoadedPool> &future){
+        const LoadedPool loaded(future.result());
+        if(!poolPtr)
+        {
+            //deleted while it was read
+            qDeleteAll(loaded.danmuList);
+            callback(nullptr);
+            return;
+        }
+        QMutexLocker locker(removeLock);
+        applyLoaded(poolPtr,loaded);
+        refreshCache(poolPtr);
+        locker.unlock();
+        callback(poolPtr);
+    });
+}
+
 Pool *DanmuManager::getPool(const QString &animeTitle, const QString &title, bool loadDanmu)
 {
     return getPool(getPoolId(animeTitle,title),loadDanmu);
 }
 
-void DanmuManager::loadPoolInfo(QList<DanmuPoolNode *> &poolNodeList)
+void DanmuManager::loadSourceCounts(QObject *context, const std::function<void()> &done)
 {
-    if(!countInited)
+    if(countInited)
     {
-        ThreadTask task(GlobalObjects::workThread);
-        task.Run([this](){
-            //get danmu count
-            QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-            for (int i = 0; i < DanmuTableCount; ++i)
+        done();
+        return;
+    }
+    QFuture<SourceCounts> counts=GlobalObjects::dbExecutor->read(DBExecutor::Interactive,[](){
+        SourceCounts counts;
+        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        query.exec("select PoolID,Source,Count from danmu_block");
+        while (query.next())
+            counts[query.value(0).toString()][query.value(1).toInt()]=query.value(2).toInt();
+        //rows not compacted into the blocks yet
+        query.exec("select PoolID,Source,Count from danmu_count");
+        while (query.next())
+            counts[query.value(0).toString()][query.value(1).toInt()]+=query.value(2).toInt();
+        return counts;
+    });
+    DBExecutor::then(counts,context,[this,done](const QFuture<SourceCounts> &future){
+        if(!countInited)
+        {
+            const SourceCounts counts(future.result());
+            QMutexLocker locker(removeLock);
+            for(auto iter=counts.cbegin();iter!=counts.cend();++iter)
             {
-                query.exec(QString("select PoolID,Source,count(*) as DanmuCount from danmu_%1 group by PoolID,Source").arg(i));
-                int pidNo = query.record().indexOf("PoolID"),
-                    srcNo = query.record().indexOf("Source"),
-                    countNo=query.record().indexOf("DanmuCount");
-                while (query.next())
+                Pool *pool = pools.value(iter.key(),nullptr);
+                if(!pool) continue;
+                for(auto srcIter=iter.value().cbegin();srcIter!=iter.value().cend();++srcIter)
                 {
-                    Pool *pool = pools.value(query.value(pidNo).toString(),nullptr);
-                    Q_ASSERT(pool);
-                    int src_id=query.value(srcNo).toInt();
-                    if(pool->sourcesTable.contains(src_id))
-                    {
-                        pool->sourcesTable[src_id].count=query.value(countNo).toInt();
-                    }
+                    if(pool->sourcesTable.contains(srcIter.key()))
+                        pool->sourcesTable[srcIter.key()].count=srcIter.value();
                 }
-
             }
-            return 0;
-        });
-        countInited=true;
-    }
+            countInited=true;
+        }
+        done();
+    });
+}
+
+void DanmuManager::loadPoolInfo(QList<DanmuPoolNode *> &poolNodeList)
+{
     qDeleteAll(poolNodeList);
     poolNodeList.clear();
     QMap<QString,DanmuPoolNode *> animeMap;
@@ -220,6 +445,9 @@ int DanmuManager::importKdFile(const QString &fileName, QWidget *parent)
     if(!readContent) return 0;
     ThreadTask task(GlobalObjects::workThread);
     return task.Run([this,&fs](){
+        QElapsedTimer timer;
+        timer.start();
+        qint64 importCount=0;
         QByteArray compressedConent,content;
         fs>>compressedConent;
         if(Network::gzipDecompress(compressedConent,content)!=0) return -2;
@@ -265,10 +493,16 @@ int DanmuManager::importKdFile(const QString &fileName, QWidget *parent)
             int c = 1;
             for(auto &srcItem:danmuInfo)
             {
+                importCount+=srcItem.second.count();
                 pool->addSource(srcItem.first,srcItem.second, c==danmuInfo.size());
                 ++c;
             }
         }
+        //the rows are written on the db writer, wait for them to get the real rate
+        GlobalObjects::dbExecutor->write([](){}).waitForFinished();
+        const qint64 elapsed=qMax<qint64>(timer.elapsed(),1);
+        emit workerStateMessage(tr("Imported %1 comments in %2s, %3 comments/s")
+                                .arg(importCount).arg(elapsed/1000.0,0,'f',1).arg(importCount*1000/elapsed));
         emit workerStateMessage("Done");
         return 1;
     }).toInt();
@@ -276,13 +510,15 @@ int DanmuManager::importKdFile(const QString &fileName, QWidget *parent)
 
 QStringList DanmuManager::getAssociatedFile16Md5(const QString &pid)
 {
-    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-    query.exec(QString("select MD5 from match where PoolID='%1'").arg(pid));
+    QSqlQuery &query=DBExecutor::cachedQuery(GlobalObjects::Comment_DB,"select MD5 from match where PoolID=?");
+    query.bindValue(0,pid);
+    query.exec();
     QStringList md5s;
     while (query.next())
     {
         md5s<<query.value(0).toString();
     }
+    query.finish();
     return md5s;
 }
 
@@ -534,10 +770,13 @@ MatchInfo *DanmuManager::localMatch(const QString &fileName)
 
 MatchInfo *DanmuManager::searchInMatchTable(const QString &fileHash)
 {
-    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-    query.exec(QString("select poolID from match where MD5='%1'").arg(fileHash));
-    if(!query.first())return nullptr;
-    QString poolID=query.value(0).toString();
+    QSqlQuery &query=DBExecutor::cachedQuery(GlobalObjects::Comment_DB,"select poolID from match where MD5=?");
+    query.bindValue(0,fileHash);
+    query.exec();
+    const bool found=query.first();
+    QString poolID=found?query.value(0).toString():QString();
+    query.finish();
+    if(!found)return nullptr;
     Pool *pool=getPool(poolID,false);
     if(!pool)return nullptr;
     MatchInfo *matchInfo=new MatchInfo;
@@ -566,12 +805,15 @@ QString DanmuManager::createPool(const QString &animeTitle, const QString &title
     QString poolId(getPoolId(animeTitle,title));
     if(!pools.contains(poolId))
     {
-        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-        query.prepare("insert into pool(PoolID,AnimeTitle,Title) values(?,?,?)");
-        query.bindValue(0,poolId);
-        query.bindValue(1,animeTitle);
-        query.bindValue(2,title);
-        query.exec();
+        //queued before the match and the sources of the pool, the writer keeps the order
+        GlobalObjects::dbExecutor->write([poolId,animeTitle,title](){
+            QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+            query.prepare("insert into pool(PoolID,AnimeTitle,Title) values(?,?,?)");
+            query.bindValue(0,poolId);
+            query.bindValue(1,animeTitle);
+            query.bindValue(2,title);
+            query.exec();
+        });
         QMutexLocker locker(removeLock);
         pools.insert(poolId,new Pool(poolId,animeTitle,title));
     }
@@ -580,49 +822,76 @@ QString DanmuManager::createPool(const QString &animeTitle, const QString &title
     return poolId;
 }
 
-QString DanmuManager::renamePool(const QString &pid, const QString &nAnimeTitle, const QString &nEpTitle)
+void DanmuManager::renamePool(const QString &pid, const QString &nAnimeTitle, const QString &nEpTitle,
+                              QObject *context, const std::function<void(const QString &)> &callback)
 {
     Pool *pool=getPool(pid,false);
-    if(!pool) return QString();
-    if(nAnimeTitle==pool->anime && nEpTitle==pool->ep) return pool->pid;
-    PoolStateLock lock;
-    if(!lock.tryLock(pid)) return QString();
-    QString npid(getPoolId(nAnimeTitle,nEpTitle));
-    int oldId=DanmuPoolNode::idHash(pool->pid),newId=DanmuPoolNode::idHash(npid);
-    QSqlDatabase db(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-    db.transaction();
-
-    QSqlQuery query(db);
-    query.prepare("update pool set PoolID=?,AnimeTitle=?,Title=? where PoolID=?");
-    query.bindValue(0,npid);
-    query.bindValue(1,nAnimeTitle);
-    query.bindValue(2,nEpTitle);
-    query.bindValue(3,pool->pid);
-    query.exec();
-
-    if(oldId!=newId)
+    if(!pool)
     {
-        query.prepare(QString("insert into danmu_%1 select * from danmu_%2 where PoolID=?").arg(newId).arg(oldId));
-        query.bindValue(0,npid);
-        query.exec();
-        query.exec(QString("delete from danmu_%1 where PoolID='%2'").arg(oldId).arg(npid));
+        callback(QString());
+        return;
     }
-
-    if(!db.commit()) return QString();
-
-    QMutexLocker locker(removeLock);
-    if(poolDanmuCacheInfo.contains(pid))
+    if(nAnimeTitle==pool->anime && nEpTitle==pool->ep)
+    {
+        callback(pool->pid);
+        return;
+    }
+    //held until the pool takes the new id
+    QSharedPointer<PoolStateLock> lock(new PoolStateLock);
+    if(!lock->tryLock(pid))
     {
-        QMutexLocker locker(cacheLock);
-        poolDanmuCacheInfo.remove(pid);
+        callback(QString());
+        return;
     }
-    pools.remove(pid);
-    pool->pid=npid;
-    pool->anime=nAnimeTitle;
-    pool->ep=nEpTitle;
-    pools.insert(npid,pool);
+    QString npid(getPoolId(nAnimeTitle,nEpTitle));
+    int oldId=tableId(pool->pid),newId=tableId(npid);
+    const QString opid(pool->pid);
+    QFuture<bool> renamed=writePool(npid,[opid,npid,nAnimeTitle,nEpTitle,oldId,newId](){
+        QSqlDatabase db(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        db.transaction();
+
+        QSqlQuery query(db);
+        query.prepare("update pool set PoolID=?,AnimeTitle=?,Title=? where PoolID=?");
+        query.bindValue(0,npid);
+        query.bindValue(1,nAnimeTitle);
+        query.bindValue(2,nEpTitle);
+        query.bindValue(3,opid);
+        query.exec();
 
-    return npid;
+        if(oldId!=newId)
+        {
+            query.prepare(QString("insert into danmu_%1(PoolID,Time,Date,Color,Mode,Size,Source,User,Text) "
+                                  "select PoolID,Time,Date,Color,Mode,Size,Source,User,Text from danmu_%2 where PoolID=?").arg(newId).arg(oldId));
+            query.bindValue(0,npid);
+            query.exec();
+            query.prepare(QString("delete from danmu_%1 where PoolID=?").arg(oldId));
+            query.bindValue(0,npid);
+            query.exec();
+        }
+        return db.commit();
+    });
+    QPointer<Pool> poolPtr(pool);
+    DBExecutor::then(renamed,context,[this,lock,poolPtr,pid,npid,nAnimeTitle,nEpTitle,callback](const QFuture<bool> &future){
+        if(!future.result() || !poolPtr)
+        {
+            callback(QString());
+            return;
+        }
+        {
+            QMutexLocker locker(removeLock);
+            if(poolDanmuCacheInfo.contains(pid))
+            {
+                QMutexLocker locker(cacheLock);
+                poolDanmuCacheInfo.remove(pid);
+            }
+            pools.remove(pid);
+            poolPtr->pid=npid;
+            poolPtr->anime=nAnimeTitle;
+            poolPtr->ep=nEpTitle;
+            pools.insert(npid,poolPtr);
+        }
+        callback(npid);
+    });
 }
 
 QString DanmuManager::getPoolId(const QString &animeTitle, const QString &title)
@@ -633,16 +902,12 @@ QString DanmuManager::getPoolId(const QString &animeTitle, const QString &title)
 
 void DanmuManager::setMatch(const QString &fileHash, const QString &poolId)
 {
-    QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-    query.exec(QString("select * from match where MD5='%1'").arg(fileHash));
-    if(query.first())
-    {
-        query.exec(QString("delete from match where MD5='%1'").arg(fileHash));
-    }
-    query.prepare("insert into match(MD5,PoolID) values(?,?)");
-    query.bindValue(0,fileHash);
-    query.bindValue(1,poolId);
-    query.exec();
+    GlobalObjects::dbExecutor->write([fileHash,poolId](){
+        QSqlQuery &query=DBExecutor::cachedQuery(GlobalObjects::Comment_DB,"insert or replace into match(MD5,PoolID) values(?,?)");
+        query.bindValue(0,fileHash);
+        query.bindValue(1,poolId);
+        query.exec();
+    });
 }
 
 void DanmuManager::deletePool(const QList<DanmuPoolNode *> &deleteList)
@@ -679,9 +944,11 @@ void DanmuManager::deletePool(const QList<DanmuPoolNode *> &deleteList)
                         query.bindValue(0,epNode->idInfo);
 
                         QSqlQuery deleteDMQuery(db);
-                        int tableId=DanmuPoolNode::idHash(epNode->idInfo);
-                        deleteDMQuery.prepare(QString("delete from danmu_%1 where PoolID=? and Source=?").arg(tableId));
+                        deleteDMQuery.prepare(QString("delete from danmu_%1 where PoolID=? and Source=?").arg(tableId(epNode->idInfo)));
                         deleteDMQuery.bindValue(0,epNode->idInfo);
+                        QSqlQuery deleteBlockQuery(db);
+                        deleteBlockQuery.prepare("delete from danmu_block where PoolID=? and Source=?");
+                        deleteBlockQuery.bindValue(0,epNode->idInfo);
                         Pool *pool=getPool(epNode->idInfo,false);
                         for(DanmuPoolNode *srcNode:*epNode->children)
                         {
@@ -693,6 +960,8 @@ void DanmuManager::deletePool(const QList<DanmuPoolNode *> &deleteList)
                                 query.exec();
                                 deleteDMQuery.bindValue(1,static_cast<DanmuPoolSourceNode *>(srcNode)->srcId);
                                 deleteDMQuery.exec();
+                                deleteBlockQuery.bindValue(1,static_cast<DanmuPoolSourceNode *>(srcNode)->srcId);
+                                deleteBlockQuery.exec();
                             }
                         }
                         break;
@@ -711,31 +980,89 @@ void DanmuManager::deletePool(const QList<DanmuPoolNode *> &deleteList)
 
 void DanmuManager::deleteSource(const QString &pid, int srcId)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([pid,srcId](){
+    const int tableId=this->tableId(pid);
+    writePool(pid,[pid,srcId,tableId](){
         QSqlDatabase db = GlobalObjects::getDB(GlobalObjects::Comment_DB);
-        QSqlQuery query(db);
         db.transaction();
-        query.exec(QString("delete from source where PoolID='%1' and ID=%2").arg(pid).arg(srcId));
-        int tableId=DanmuPoolNode::idHash(pid);
-        query.exec(QString("delete from danmu_%1 where PoolID='%2' and Source=%3").arg(tableId).arg(pid).arg(srcId));
+        for(const QString &sql:{QStringLiteral("delete from source where PoolID=? and ID=?"),
+                                QString("delete from danmu_%1 where PoolID=? and Source=?").arg(tableId),
+                                QStringLiteral("delete from danmu_block where PoolID=? and Source=?")})
+        {
+            QSqlQuery &query=DBExecutor::cachedQuery(GlobalObjects::Comment_DB,sql);
+            query.bindValue(0,pid);
+            query.bindValue(1,srcId);
+            query.exec();
+        }
         db.commit();
     });
 }
 
 void DanmuManager::deleteDanmu(const QString &pid, const QSharedPointer<DanmuComment> danmu)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.RunOnce([pid,danmu](){
-        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-        int tableId=DanmuPoolNode::idHash(pid);
-        query.prepare(QString("delete from danmu_%1 where PoolID=? and Date=? and User=? and Text=? and Source=?").arg(tableId));
-        query.bindValue(0,pid);
-        query.bindValue(1,danmu->date);
-        query.bindValue(2,danmu->sender);
-        query.bindValue(3,danmu->text);
-        query.bindValue(4,danmu->source);
-        query.exec();
+    {
+        QMutexLocker locker(&deleteLock);
+        QList<QSharedPointer<DanmuComment> > &pending=pendingDeletes[pid];
+        pending.append(danmu);
+        //a write for the pool is still queued, it takes this comment too
+        if(pending.count()>1) return;
+    }
+    const int tableId=this->tableId(pid);
+    writePool(pid,[this,pid,tableId](){
+        QList<QSharedPointer<DanmuComment> > danmuList;
+        {
+            QMutexLocker locker(&deleteLock);
+            danmuList=pendingDeletes.take(pid);
+        }
+        QSqlDatabase db(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        db.transaction();
+        QSqlQuery query(db);
+        //seeks the (PoolID,Source,Time) index, only one row goes with the comment
+        query.prepare(QString("delete from danmu_%1 where rowid=(select rowid from danmu_%1 where PoolID=? and Source=? and Time=? "
+                              "and Date=? and User=? and Text=? limit 1)").arg(tableId));
+        //already compacted, by source
+        QHash<int,QList<QSharedPointer<DanmuComment> > > blockDeletes;
+        for(const auto &danmu:danmuList)
+        {
+            query.bindValue(0,pid);
+            query.bindValue(1,danmu->source);
+            query.bindValue(2,danmu->originTime);
+            query.bindValue(3,danmu->date);
+            query.bindValue(4,danmu->sender);
+            query.bindValue(5,danmu->text);
+            query.exec();
+            if(query.numRowsAffected()<=0) blockDeletes[danmu->source].append(danmu);
+        }
+        //every block is decoded and written once for all of its deleted comments
+        query.prepare("select Data from danmu_block where PoolID=? and Source=?");
+        for(auto iter=blockDeletes.cbegin();iter!=blockDeletes.cend();++iter)
+        {
+            query.bindValue(0,pid);
+            query.bindValue(1,iter.key());
+            query.exec();
+            if(!query.first()) continue;
+            QList<DanmuComment *> blockList;
+            if(!DanmuBlock(query.value(0).toByteArray()).decode(iter.key(),blockList))
+            {
+                qDeleteAll(blockList);
+                continue;
+            }
+            bool removed=false;
+            for(const auto &danmu:iter.value())
+            {
+                //same as the row path, only the first comment with the same fields goes
+                auto dmIter=std::find_if(blockList.begin(),blockList.end(),[&danmu](const DanmuComment *dm){
+                    return dm->originTime==danmu->originTime && dm->date==danmu->date &&
+                           dm->sender==danmu->sender && dm->text==danmu->text;
+                });
+                if(dmIter==blockList.end()) continue;
+                delete *dmIter;
+                blockList.erase(dmIter);
+                removed=true;
+            }
+            if(removed) saveBlock(db,pid,iter.key(),DanmuBlock::encode(blockList));
+            qDeleteAll(blockList);
+        }
+        db.commit();
     });
 }
 
@@ -743,23 +1070,75 @@ void DanmuManager::updatePool(QList<DanmuPoolNode *> &updateList)
 {
     ThreadTask task(GlobalObjects::workThread);
     task.Run([this,&updateList](){
+        struct UpdateTarget
+        {
+            QString pid;
+            DanmuPoolSourceNode *srcNode;
+            QString title;
+        };
+        //sources of different pools may share a URL, it is downloaded once
+        QHash<QString,QList<UpdateTarget> > urlTargets;
+        RefreshScheduler scheduler(&refreshPool,providerRefreshLimit);
         for(const DanmuPoolNode *animeNode:updateList)
         {
             if(animeNode->checkStatus==Qt::Unchecked)continue;
             for(DanmuPoolNode *epNode:*animeNode->children)
             {
                 if(epNode->checkStatus==Qt::Unchecked)continue;
-                Pool *pool=getPool(epNode->idInfo);
+                Pool *pool=getPool(epNode->idInfo,false);
+                if(!pool) continue;
                 for(DanmuPoolNode *sourceNode:*epNode->children)
                 {
                     if(sourceNode->checkStatus==Qt::Unchecked)continue;
-                    emit workerStateMessage(tr("Updating: %1 %2 %3").arg(animeNode->title, epNode->title, sourceNode->idInfo));
                     DanmuPoolSourceNode *srcNode(static_cast<DanmuPoolSourceNode *>(sourceNode));
-                    pool->update(srcNode->srcId);
-                    srcNode->danmuCount=pool->sources()[srcNode->srcId].count;
+                    const QString url(pool->sources().value(srcNode->srcId).url);
+                    if(url.isEmpty()) continue;
+                    urlTargets[url].append({epNode->idInfo,srcNode,QString("%1 %2 %3").arg(animeNode->title, epNode->title, sourceNode->idInfo)});
+                    scheduler.add(url);
                 }
             }
         }
+        const int total=scheduler.count();
+        int finished=0, added=0;
+#ifdef QT_DEBUG
+        QElapsedTimer timer;
+        timer.start();
+#endif
+        scheduler.run([&](const QString &url, QList<DanmuComment *> &danmuList, const QString &errInfo){
+            ++finished;
+            const QList<UpdateTarget> &targets=urlTargets[url];
+            for(int i=0;i<targets.count();++i)
+            {
+                const UpdateTarget &target=targets.at(i);
+                emit workerStateMessage(errInfo.isEmpty()?tr("Updating(%1/%2): %3").arg(finished).arg(total).arg(target.title):
+                                                          tr("Update Failed(%1/%2): %3, %4").arg(finished).arg(total).arg(target.title, errInfo));
+                if(!errInfo.isEmpty()) continue;
+                //each pool takes its own copy, the downloaded comments are not merged or shared yet
+                QList<DanmuComment *> targetList;
+                if(i==targets.count()-1)
+                {
+                    targetList.swap(danmuList);
+                }
+                else
+                {
+                    targetList.reserve(danmuList.count());
+                    for(const DanmuComment *danmu:danmuList)
+                        targetList.append(new DanmuComment(*danmu));
+                }
+                Pool *pool=getPool(target.pid);
+                if(!pool)
+                {
+                    qDeleteAll(targetList);
+                    continue;
+                }
+                added+=pool->update(target.srcNode->srcId,targetList);
+                target.srcNode->danmuCount=pool->sources().value(target.srcNode->srcId).count;
+            }
+            qDeleteAll(danmuList);
+        });
+#ifdef QT_DEBUG
+        qDebug()<<"refresh"<<total<<"sources, added"<<added<<"comments:"<<timer.elapsed()<<"ms";
+#endif
         emit workerStateMessage("Done");
         return 0;
     });
@@ -767,11 +1146,9 @@ void DanmuManager::updatePool(QList<DanmuPoolNode *> &updateList)
 
 void DanmuManager::updateSourceDelay(const QString &pid, const DanmuSourceInfo *sourceInfo)
 {
-    ThreadTask task(GlobalObjects::workThread);
     int delay=sourceInfo->delay,id=sourceInfo->id;
-    task.RunOnce([delay,id,pid](){
-        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-        query.prepare("update source set Delay= ? where PoolID=? and ID=?");
+    GlobalObjects::dbExecutor->write([delay,id,pid](){
+        QSqlQuery &query=DBExecutor::cachedQuery(GlobalObjects::Comment_DB,"update source set Delay= ? where PoolID=? and ID=?");
         query.bindValue(0,delay);
         query.bindValue(1,pid);
         query.bindValue(2,id);
@@ -779,27 +1156,31 @@ void DanmuManager::updateSourceDelay(const QString &pid, const DanmuSourceInfo *
     });
 }
 
-QList<DanmuComment *> DanmuManager::updateSource(const DanmuSourceInfo *sourceInfo, const QSet<QString> &danmuHashSet)
+QList<DanmuComment *> DanmuManager::updateSource(const DanmuSourceInfo *sourceInfo, const FingerprintIndex &index, int dedupSource)
 {
     QList<DanmuComment *> tmpList;
     QString errInfo = GlobalObjects::providerManager->downloadBySourceURL(sourceInfo->url,tmpList);
     if(!errInfo.isEmpty())return tmpList;
     GlobalObjects::blocker->preFilter(tmpList);
-    for(auto iter=tmpList.begin();iter!=tmpList.end();)
+    filterUpdate(tmpList,sourceInfo->id,index,dedupSource);
+    return tmpList;
+}
+
+void DanmuManager::filterUpdate(QList<DanmuComment *> &danmuList, int sourceId, const FingerprintIndex &index, int dedupSource)
+{
+    for(auto iter=danmuList.begin();iter!=danmuList.end();)
     {
-        QByteArray hashData(QString("%0%1%2%3").arg((*iter)->text, QString::number((*iter)->originTime), (*iter)->sender, QString::number((*iter)->color)).toUtf8());
-        if(danmuHashSet.contains(QCryptographicHash::hash(hashData,QCryptographicHash::Md5).toHex()) || (*iter)->text.isEmpty())
+        if((*iter)->text.isEmpty() || index.contains(*iter,dedupSource))
         {
             delete *iter;
-            iter=tmpList.erase(iter);
+            iter=danmuList.erase(iter);
         }
         else
         {
-            (*iter)->source=sourceInfo->id;
+            (*iter)->source=sourceId;
             ++iter;
         }
     }
-    return tmpList;
 }
 
 void DanmuManager::loadAllPool()
@@ -890,11 +1271,9 @@ void DanmuManager::deletePool(const QString &pid)
 
 void DanmuManager::updateSourceTimeline(const QString &pid, const DanmuSourceInfo *sourceInfo)
 {
-    ThreadTask task(GlobalObjects::workThread);
     DanmuSourceInfo srcInfo(*sourceInfo);
-    task.RunOnce([pid, srcInfo](){
-        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-        query.prepare("update source set TimeLine= ? where PoolID=? and ID=?");
+    GlobalObjects::dbExecutor->write([pid, srcInfo](){
+        QSqlQuery &query=DBExecutor::cachedQuery(GlobalObjects::Comment_DB,"update source set TimeLine= ? where PoolID=? and ID=?");
         query.bindValue(0,srcInfo.getTimelineStr());
         query.bindValue(1,pid);
         query.bindValue(2,srcInfo.id);
@@ -903,17 +1282,45 @@ void DanmuManager::updateSourceTimeline(const QString &pid, const DanmuSourceInf
 
 }
 
-void DanmuManager::loadPool(Pool *pool)
+QFuture<DanmuManager::LoadedPool> DanmuManager::readPool(const Pool *pool, int focusTime)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    task.Run([pool](){
-        QSqlQuery query(GlobalObjects::getDB(GlobalObjects::Comment_DB));
-        auto &sources=pool->sourcesTable;
-        for(auto &src:sources)
-            src.count=0;
-        int tableId=DanmuPoolNode::idHash(pool->id());
-        query.exec(QString("select * from danmu_%1 where PoolID='%2'").arg(tableId).arg(pool->id()));
-        int timeNo = query.record().indexOf("Time"),
+    const QString pid(pool->id());
+    const QMap<int,DanmuSourceInfo> sources(pool->sourcesTable);
+    //rows still waiting in the write queue would be missed, only then the read waits for the writer
+    return GlobalObjects::dbExecutor->read(DBExecutor::Interactive,[this,pid,sources,focusTime](){
+#ifdef QT_DEBUG
+        QElapsedTimer timer;
+        timer.start();
+#endif
+        QSqlDatabase db(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+        QSqlQuery query(db);
+        LoadedPool loaded;
+        QList<QPair<int,DanmuBlock> > blocks;
+        //sources whose block did not decode in full, their block and rows are left as they are
+        QSet<int> brokenSources;
+        int blockDanmuCount=0;
+        query.prepare("select Source,Data from danmu_block where PoolID=?");
+        query.bindValue(0,pid);
+        query.exec();
+        while (query.next())
+        {
+            int srcId=query.value(0).toInt();
+            DanmuBlock block(query.value(1).toByteArray());
+            if(!block.isValid())
+            {
+                qDebug()<<"invalid danmu block:"<<pid<<srcId;
+                brokenSources.insert(srcId);
+                continue;
+            }
+            blockDanmuCount+=block.count();
+            blocks.append(qMakePair(srcId,block));
+        }
+        //rows saved after the last compaction
+        QList<DanmuComment *> rowDanmuList;
+        int tableId=this->tableId(pid);
+        query.exec(QString("select rowid as RowID,* from danmu_%1 where PoolID='%2'").arg(tableId).arg(pid));
+        int rowIdNo = query.record().indexOf("RowID"),
+            timeNo = query.record().indexOf("Time"),
             dateNo=query.record().indexOf("Date"),
             colorNo=query.record().indexOf("Color"),
             modeNo=query.record().indexOf("Mode"),
@@ -921,8 +1328,11 @@ void DanmuManager::loadPool(Pool *pool)
             sourceNo=query.record().indexOf("Source"),
             userNo=query.record().indexOf("User"),
             textNo=query.record().indexOf("Text");
+        QSet<int> rowSources;
+        QHash<int,QVector<qint64> > sourceRowIds;
         while (query.next())
         {
+            sourceRowIds[query.value(sourceNo).toInt()].append(query.value(rowIdNo).toLongLong());
             QString text=query.value(textNo).toString();
             if(text.isEmpty()) continue;
             DanmuComment *danmu=new DanmuComment();
@@ -936,32 +1346,169 @@ void DanmuManager::loadPool(Pool *pool)
             danmu->source=query.value(sourceNo).toInt();
             danmu->text=text;
             danmu->originTime=query.value(timeNo).toInt();
-
-            Q_ASSERT(sources.contains(danmu->source));
-            pool->setDelay(danmu);
-            sources[danmu->source].count++;
-            pool->commentList.append(QSharedPointer<DanmuComment>(danmu));
+            rowSources.insert(danmu->source);
+            rowDanmuList.append(danmu);
         }
-        return 0;
+        //pools with rows are loaded at once, the rows are compacted below
+        const bool windowed=focusTime>=0 && windowedLoad && rowSources.isEmpty() && blockDanmuCount>=WindowedLoadMinCount;
+        QList<DanmuComment *> &danmuList=loaded.danmuList;
+        if(windowed)
+        {
+            QSharedPointer<PoolLoader> loader(new PoolLoader);
+            for(const auto &block:blocks)
+            {
+                Q_ASSERT(sources.contains(block.first));
+                loaded.sourceCounts[block.first]+=block.second.count();
+                loader->addBlock(sources[block.first],block.second);
+            }
+            loader->setFocus(focusTime);
+            loader->decodeWindow(focusTime-LoadWindowBefore,focusTime+LoadWindowAfter,danmuList);
+            loaded.loader=loader;
+        }
+        else
+        {
+            danmuList.reserve(blockDanmuCount+rowDanmuList.count());
+            for(const auto &block:blocks)
+            {
+                if(!block.second.decode(block.first,danmuList))
+                {
+                    qDebug()<<"invalid danmu block:"<<pid<<block.first;
+                    brokenSources.insert(block.first);
+                }
+            }
+            danmuList.append(rowDanmuList);
+        }
+        if(!windowed)
+        {
+            for(const DanmuComment *danmu:danmuList)
+                loaded.sourceCounts[danmu->source]++;
+        }
+        //fold the rows into the blocks, pools saved in rows only are moved on their first load
+        //a block written now would replace the part of a broken block that was not decoded
+        rowSources.subtract(brokenSources);
+        if(!rowSources.isEmpty())
+        {
+            QHash<int,QList<DanmuComment *> > sourceDanmu;
+            for(DanmuComment *danmu:danmuList)
+            {
+                if(rowSources.contains(danmu->source))
+                    sourceDanmu[danmu->source].append(danmu);
+            }
+            QVector<qint64> rowIds;
+            for(auto iter=sourceRowIds.cbegin();iter!=sourceRowIds.cend();++iter)
+            {
+                if(!brokenSources.contains(iter.key()))
+                    rowIds+=iter.value();
+            }
+            QHash<int,QByteArray> blockData;
+            for(auto iter=sourceDanmu.cbegin();iter!=sourceDanmu.cend();++iter)
+                blockData.insert(iter.key(),DanmuBlock::encode(iter.value()));
+            //the rows are deleted by id, rows saved after this read are kept
+            writePool(pid,[pid,blockData,rowIds,tableId](){
+                QSqlDatabase db(GlobalObjects::getDB(GlobalObjects::Comment_DB));
+                QSqlQuery query(db);
+                db.transaction();
+                for(auto iter=blockData.cbegin();iter!=blockData.cend();++iter)
+                    saveBlock(db,pid,iter.key(),iter.value());
+                query.prepare(QString("delete from danmu_%1 where rowid=?").arg(tableId));
+                for(qint64 rowId:rowIds)
+                {
+                    query.bindValue(0,rowId);
+                    query.exec();
+                }
+                db.commit();
+            });
+        }
+#ifdef QT_DEBUG
+        qDebug()<<"load pool:"<<pid<<"block comments:"<<blockDanmuCount<<"row comments:"<<rowDanmuList.count()
+                <<"decoded:"<<danmuList.count()<<(windowed?"windowed":"full")<<"time:"<<timer.elapsed()<<"ms";
+#endif
+        return loaded;
+    },hasPendingWrites(pid));
+}
+
+void DanmuManager::applyLoaded(Pool *pool, const LoadedPool &loaded)
+{
+    auto &sources=pool->sourcesTable;
+    for(auto &src:sources)
+        src.count=loaded.sourceCounts.value(src.id);
+    pool->commentList.reserve(pool->commentList.count()+loaded.danmuList.count());
+    for(DanmuComment *danmu:loaded.danmuList)
+    {
+        pool->stringPool.intern(danmu);
+        Q_ASSERT(sources.contains(danmu->source));
+        pool->setDelay(danmu);
+        pool->commentList.append(QSharedPointer<DanmuComment>(danmu));
+    }
+    pool->loader=loaded.loader;
+    pool->checkBlock();
+    pool->isLoaded=true;
+    if(pool->loader) streamPool(pool);
+}
+
+void DanmuManager::loadPool(Pool *pool, int focusTime)
+{
+    applyLoaded(pool,readPool(pool,focusTime).result());
+}
+
+void DanmuManager::streamPool(Pool *pool)
+{
+    QSharedPointer<PoolLoader> loader(pool->loader);
+    QPointer<Pool> poolPtr(pool);
+    //decoding only, but it should not wait behind updates on the work thread
+    QFuture<bool> decoded=GlobalObjects::dbExecutor->read(DBExecutor::Background,[loader](){
+        return loader->decodeNext(StreamChunkSize);
+    });
+    DBExecutor::then(decoded,this,[this,loader,poolPtr](const QFuture<bool> &future){
+        takeStreamed(poolPtr,loader,future.result());
     });
 }
 
+void DanmuManager::takeStreamed(QPointer<Pool> pool, QSharedPointer<PoolLoader> loader, bool hasMore)
+{
+    //the pool is gone, cleaned or already loaded in full
+    if(!pool || pool->loader!=loader) return;
+    if(!pool->takeLoaded())
+    {
+        //busy, e.g. updating, try again later
+        QTimer::singleShot(StreamRetryInterval,this,[this,pool,loader,hasMore](){
+            takeStreamed(pool,loader,hasMore);
+        });
+        return;
+    }
+    if(hasMore)
+        streamPool(pool);
+    else
+        pool->loader.clear();
+}
+
+void DanmuManager::saveBlock(QSqlDatabase &db, const QString &pid, int sourceId, const QByteArray &data)
+{
+    QSqlQuery query(db);
+    query.prepare("insert into danmu_block(PoolID,Source,Count,Data) values(?,?,?,?)");
+    query.bindValue(0,pid);
+    query.bindValue(1,sourceId);
+    query.bindValue(2,DanmuBlock(data).count());
+    query.bindValue(3,data);
+    query.exec();
+}
+
 void DanmuManager::updatePool(Pool *pool, QList<DanmuComment *> &outList, int sourceId)
 {
     ThreadTask task(GlobalObjects::workThread);
     task.Run([pool,&outList,sourceId,this](){
-        const auto &danmuHashSet=pool->getDanmuHashSet(sourceId);
+        const FingerprintIndex &index=pool->fingerprintIndex();
         if(sourceId==-1)
         {
             const auto &sourceTable=pool->sources();
             for(const auto &src:sourceTable)
             {
-                outList.append(updateSource(&src,danmuHashSet));
+                outList.append(updateSource(&src,index,-1));
             }
         }
         else
         {
-            outList.append(updateSource(&pool->sourcesTable[sourceId],danmuHashSet));
+            outList.append(updateSource(&pool->sourcesTable[sourceId],index,sourceId));
         }
         return 0;
     });
@@ -969,40 +1516,83 @@ void DanmuManager::updatePool(Pool *pool, QList<DanmuComment *> &outList, int so
 
 void DanmuManager::saveSource(const QString &pid, const DanmuSourceInfo *source, const QList<QSharedPointer<DanmuComment> > &danmuList)
 {
-    ThreadTask task(GlobalObjects::workThread);
-    DanmuSourceInfo src;
-    if(source!=nullptr) src=*source;
-    task.RunOnce([pid,src,source,danmuList](){
+    saveSources(pid,{{source?*source:DanmuSourceInfo(),source!=nullptr,danmuList}});
+}
+
+void DanmuManager::saveSources(const QString &pid, const QList<DanmuSourceRows> &sources)
+{
+    const int tableId=this->tableId(pid);
+    writePool(pid,[pid,sources,tableId](){
+#ifdef QT_DEBUG
+        QElapsedTimer timer;
+        timer.start();
+#endif
         QSqlDatabase db = GlobalObjects::getDB(GlobalObjects::Comment_DB);
-        QSqlQuery query(db);
         db.transaction();
-        if(source)
-        {
-            query.prepare("insert into source(PoolID,ID,Name,Delay,URL,TimeLine) values(?,?,?,?,?,?)");
-            query.bindValue(0,pid);
-            query.bindValue(1,src.id);
-            query.bindValue(2,src.name);
-            query.bindValue(3,src.delay);
-            query.bindValue(4,src.url);
-            query.bindValue(5,src.getTimelineStr());
-            query.exec();
-        }
-        int tableId=DanmuPoolNode::idHash(pid);
-        query.prepare(QString("insert into danmu_%1(PoolID,Time,Date,Color,Mode,Size,Source,User,Text) values(?,?,?,?,?,?,?,?,?)").arg(tableId));
-        for(const auto &danmu: danmuList)
+        int rows=0;
+        for(const DanmuSourceRows &src:sources)
         {
-            if(danmu->text.isEmpty()) continue;
-            query.bindValue(0,pid);
-            query.bindValue(1,danmu->originTime);
-            query.bindValue(2,danmu->date);
-            query.bindValue(3,danmu->color);
-            query.bindValue(4,(int)danmu->type);
-            query.bindValue(5,(int)danmu->fontSizeLevel);
-            query.bindValue(6,danmu->source);
-            query.bindValue(7,danmu->sender);
-            query.bindValue(8,danmu->text);
-            query.exec();
+            if(src.isNew)
+            {
+                QSqlQuery &query=DBExecutor::cachedQuery(GlobalObjects::Comment_DB,"insert into source(PoolID,ID,Name,Delay,URL,TimeLine) values(?,?,?,?,?,?)");
+                query.bindValue(0,pid);
+                query.bindValue(1,src.source.id);
+                query.bindValue(2,src.source.name);
+                query.bindValue(3,src.source.delay);
+                query.bindValue(4,src.source.url);
+                query.bindValue(5,src.source.getTimelineStr());
+                query.exec();
+            }
+            rows+=saveRows(pid,tableId,src.danmuList);
         }
         db.commit();
+#ifdef QT_DEBUG
+        const qint64 elapsed=qMax<qint64>(timer.nsecsElapsed(),1);
+        qDebug()<<"save sources:"<<pid<<sources.count()<<"rows:"<<rows<<"time:"<<elapsed/1000000<<"ms,"<<qint64(rows*1e9/elapsed)<<"rows/s";
+#else
+        Q_UNUSED(rows)
+#endif
     });
 }
+
+int DanmuManager::saveRows(const QString &pid, int tableId, const QList<QSharedPointer<DanmuComment> > &danmuList)
+{
+    QVector<const DanmuComment *> rows;
+    rows.reserve(danmuList.count());
+    for(const auto &danmu:danmuList)
+    {
+        if(!danmu->text.isEmpty()) rows.append(danmu.data());
+    }
+    const QString insertSql(QString("insert into danmu_%1(PoolID,Time,Date,Color,Mode,Size,Source,User,Text) values").arg(tableId));
+    const QString rowValues("(?,?,?,?,?,?,?,?,?)");
+    QString batchSql(insertSql);
+    for(int i=0;i<InsertBatchRows;++i)
+    {
+        if(i>0) batchSql.append(',');
+        batchSql.append(rowValues);
+    }
+    //full batches share one statement, the rest goes row by row
+    int pos=0;
+    while(pos<rows.count())
+    {
+        const int batchRows=rows.count()-pos>=InsertBatchRows?InsertBatchRows:1;
+        QSqlQuery &query=DBExecutor::cachedQuery(GlobalObjects::Comment_DB,batchRows>1?batchSql:insertSql+rowValues);
+        int param=0;
+        for(int i=pos;i<pos+batchRows;++i)
+        {
+            const DanmuComment *danmu=rows.at(i);
+            query.bindValue(param++,pid);
+            query.bindValue(param++,danmu->originTime);
+            query.bindValue(param++,danmu->date);
+            query.bindValue(param++,danmu->color);
+            query.bindValue(param++,(int)danmu->type);
+            query.bindValue(param++,(int)danmu->fontSizeLevel);
+            query.bindValue(param++,danmu->source);
+            query.bindValue(param++,danmu->sender);
+            query.bindValue(param++,danmu->text);
+        }
+        query.exec();
+        pos+=batchRows;
+    }
+    return rows.count();
+}
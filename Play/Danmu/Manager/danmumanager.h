@@ -2,9 +2,23 @@
 #define DANMUMANAGER_H
 
 #include <QAbstractItemModel>
+#include <QSqlDatabase>
+#include <QPointer>
+#include <QThreadPool>
+#include <QFuture>
+#include <functional>
 #include "../common.h"
 #include "nodeinfo.h"
 class Pool;
+class PoolLoader;
+class FingerprintIndex;
+//comments of a source to save, the source row is inserted too if isNew
+struct DanmuSourceRows
+{
+    DanmuSourceInfo source;
+    bool isNew;
+    QList<QSharedPointer<DanmuComment> > danmuList;
+};
 class DanmuManager : public QObject
 {
     Q_OBJECT
@@ -16,6 +30,11 @@ public:
 public:
     Pool *getPool(const QString &pid, bool loadDanmu=true);
     Pool *getPool(const QString &animeTitle, const QString &title, bool loadDanmu=true);
+    //for playback: large pools are loaded around time first, the rest is streamed in the background
+    //callback(pool) is called on the thread of context once the pool is read, pool is nullptr if it does not exist
+    void getPoolWindowed(const QString &pid, int time, QObject *context, const std::function<void(Pool *)> &callback);
+    //the source counts are read once on a db reader, done is called on the thread of context
+    void loadSourceCounts(QObject *context, const std::function<void()> &done);
     void loadPoolInfo(QList<DanmuPoolNode *> &poolNodeList);
     void deletePool(const QList<DanmuPoolNode *> &deleteList);
     void updatePool(QList<DanmuPoolNode *> &updateList);
@@ -24,7 +43,9 @@ public:
     int importKdFile(const QString &fileName, QWidget *parent);
     QStringList getAssociatedFile16Md5(const QString &pid);
     QString createPool(const QString &animeTitle, const QString &title, const QString &fileHash="");
-    QString renamePool(const QString &pid, const QString &nAnimeTitle, const QString &nEpTitle);
+    //callback(npid) is called on the thread of context, npid is empty if the pool is busy or the rename failed
+    void renamePool(const QString &pid, const QString &nAnimeTitle, const QString &nEpTitle,
+                    QObject *context, const std::function<void(const QString &)> &callback);
     QString getFileHash(const QString &fileName);
 public:
     enum MatchProvider
@@ -46,17 +67,40 @@ private:
 signals:
     void workerStateMessage(const QString &msg);
 private:
-    void loadPool(Pool *pool);
+    //read on a db reader, taken by the pool on the calling thread
+    struct LoadedPool
+    {
+        QList<DanmuComment *> danmuList;
+        QHash<int,int> sourceCounts;
+        QSharedPointer<PoolLoader> loader;
+    };
+    typedef QHash<QString,QHash<int,int> > SourceCounts;
+    QFuture<LoadedPool> readPool(const Pool *pool, int focusTime);
+    void applyLoaded(Pool *pool, const LoadedPool &loaded);
+    void loadPool(Pool *pool, int focusTime=-1);
+    //writes to the comments of pid, loads of pid wait for them only while some are queued
+    template<typename Func>
+    auto writePool(const QString &pid, Func task) -> QFuture<decltype(task())>;
+    bool hasPendingWrites(const QString &pid);
+    void streamPool(Pool *pool);
+    void takeStreamed(QPointer<Pool> pool, QSharedPointer<PoolLoader> loader, bool hasMore);
+    static void saveBlock(QSqlDatabase &db, const QString &pid, int sourceId, const QByteArray &data);
     void updatePool(Pool *pool, QList<DanmuComment *> &outList, int sourceId=-1);
     QString getPoolId(const QString &animeTitle, const QString &title);
+    inline int tableId(const QString &pid) const {return DanmuPoolNode::idHash(pid,danmuTableCount);}
     void saveSource(const QString &pid, const DanmuSourceInfo *source, const QList<QSharedPointer<DanmuComment> > &danmuList);
+    void saveSources(const QString &pid, const QList<DanmuSourceRows> &sources);
+    static int saveRows(const QString &pid, int tableId, const QList<QSharedPointer<DanmuComment> > &danmuList);
     void deleteSource(const QString &pid, int sourceId);
     void deleteDanmu(const QString &pid, const QSharedPointer<DanmuComment> danmu);
     void updateSourceTimeline(const QString &pid, const DanmuSourceInfo *sourceInfo);
     void updateSourceDelay(const QString &pid, const DanmuSourceInfo *sourceInfo);
-    QList<DanmuComment *> updateSource(const DanmuSourceInfo *sourceInfo, const QSet<QString> &danmuHashSet);
+    QList<DanmuComment *> updateSource(const DanmuSourceInfo *sourceInfo, const FingerprintIndex &index, int dedupSource);
+    //drops empty and known comments, the rest are moved to sourceId
+    static void filterUpdate(QList<DanmuComment *> &danmuList, int sourceId, const FingerprintIndex &index, int dedupSource);
 
 private:
+    void upgradeDB();
     void loadAllPool();
     void refreshCache(Pool *newPool=nullptr);
     void deletePool(const QString &pid);
@@ -67,8 +111,20 @@ private:
     QMutex *cacheLock,*removeLock;
     QReadWriteLock poolStateLock;
     QSet<QString> busyPoolSet;
+    QMutex pendingWriteLock;
+    QHash<QString,int> pendingPoolWrites;
+    //comments to delete by pool, taken by one write
+    QMutex deleteLock;
+    QHash<QString,QList<QSharedPointer<DanmuComment> > > pendingDeletes;
     bool countInited;
-    const int DanmuTableCount=5;
+    bool windowedLoad;
+    int danmuTableCount;
+    QThreadPool refreshPool;
+    int providerRefreshLimit;
+    const int WindowedLoadMinCount=20000;
+    const int LoadWindowBefore=30*1000, LoadWindowAfter=5*60*1000;
+    static const int StreamChunkSize=16384;
+    const int StreamRetryInterval=100;
 };
 class PoolStateLock
 {
@@ -0,0 +1,135 @@
+#include "fingerprintindex.h"
+#include "../common.h"
+#include "Common/hash64.h"
+
+FingerprintIndex::FingerprintIndex():used(0),built(false)
+{
+
+}
+
+quint64 FingerprintIndex::fingerprint(const DanmuComment *danmu)
+{
+    const quint64 seed=(quint64(quint32(danmu->color))<<32)|quint32(danmu->originTime);
+    const quint64 textHash=Hash64::hash(danmu->text.constData(),size_t(danmu->text.size())*sizeof(QChar),seed);
+    return Hash64::hash(danmu->sender.constData(),size_t(danmu->sender.size())*sizeof(QChar),textHash);
+}
+
+void FingerprintIndex::clear()
+{
+    QVector<Slot> emptyTable;
+    table.swap(emptyTable);
+    used=0;
+    built=false;
+}
+
+void FingerprintIndex::reserve(int count)
+{
+    int c=16;
+    while(c<count*2) c<<=1;
+    if(c>table.size()) rehash(c);
+}
+
+void FingerprintIndex::add(const DanmuComment *danmu)
+{
+    if(!built) return;
+    insert(validKey(fingerprint(danmu)),danmu->source);
+}
+
+void FingerprintIndex::remove(const DanmuComment *danmu)
+{
+    if(!built || used==0) return;
+    const quint64 key=validKey(fingerprint(danmu));
+    const int mask=table.size()-1;
+    for(int i=int(key&quint64(mask));table.at(i).key!=0;i=(i+1)&mask)
+    {
+        Slot &slot=table[i];
+        if(slot.key==key && slot.source==danmu->source)
+        {
+            if(--slot.count==0) erase(i);
+            return;
+        }
+    }
+}
+
+void FingerprintIndex::removeSource(int sourceId)
+{
+    if(!built) return;
+    QVector<Slot> old(table);
+    table.fill(Slot{0,0,0});
+    used=0;
+    for(const Slot &slot:old)
+    {
+        if(slot.key==0 || slot.source==sourceId) continue;
+        place(slot);
+        ++used;
+    }
+}
+
+bool FingerprintIndex::contains(quint64 fp, int sourceId) const
+{
+    if(used==0) return false;
+    const quint64 key=validKey(fp);
+    const int mask=table.size()-1;
+    for(int i=int(key&quint64(mask));table.at(i).key!=0;i=(i+1)&mask)
+    {
+        const Slot &slot=table.at(i);
+        if(slot.key==key && (sourceId==-1 || slot.source==sourceId)) return true;
+    }
+    return false;
+}
+
+void FingerprintIndex::insert(quint64 key, int sourceId)
+{
+    if(!table.isEmpty())
+    {
+        const int mask=table.size()-1;
+        for(int i=int(key&quint64(mask));table.at(i).key!=0;i=(i+1)&mask)
+        {
+            Slot &slot=table[i];
+            if(slot.key==key && slot.source==sourceId)
+            {
+                ++slot.count;
+                return;
+            }
+        }
+    }
+    if((used+1)*2>table.size()) rehash(qMax(16,table.size()*2));
+    place(Slot{key,sourceId,1});
+    ++used;
+}
+
+void FingerprintIndex::erase(int pos)
+{
+    //backward shift: move up the slots whose probe sequence passes the hole
+    const int mask=table.size()-1;
+    int hole=pos;
+    for(int i=(pos+1)&mask;table.at(i).key!=0;i=(i+1)&mask)
+    {
+        const int home=int(table.at(i).key&quint64(mask));
+        if(((i-home)&mask)>=((i-hole)&mask))
+        {
+            table[hole]=table.at(i);
+            hole=i;
+        }
+    }
+    table[hole]=Slot{0,0,0};
+    --used;
+}
+
+void FingerprintIndex::place(const Slot &item)
+{
+    const int mask=table.size()-1;
+    int i=int(item.key&quint64(mask));
+    while(table.at(i).key!=0) i=(i+1)&mask;
+    table[i]=item;
+}
+
+void FingerprintIndex::rehash(int capacity)
+{
+    QVector<Slot> old(table);
+    table.fill(Slot{0,0,0},capacity);
+    for(const Slot &slot:old)
+    {
+        if(slot.key!=0) place(slot);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef FINGERPRINTINDEX_H
+#define FINGERPRINTINDEX_H
+#include <QVector>
+class DanmuComment;
+/*
+ * Dedup index of a pool: 64-bit fingerprint of text, origin time, sender and color -> source.
+ * Open addressing(linear probing) like DrawInfoTable, key 0 marks an empty slot, removal shifts
+ * the following slots back so no tombstones are left. The same comment in several sources takes
+ * one slot per source, each slot counts its copies.
+ * The index is built on first use (see Pool::fingerprintIndex) and kept up to date by the pool after that,
+ * add/remove are no-ops before it is built.
+ */
+class FingerprintIndex
+{
+public:
+    FingerprintIndex();
+    static quint64 fingerprint(const DanmuComment *danmu);
+
+    inline bool isBuilt() const {return built;}
+    inline int size() const {return used;}
+    template<typename Container>
+    void build(const Container &danmuList)
+    {
+        clear();
+        reserve(danmuList.count());
+        built=true;
+        for(const auto &danmu:danmuList)
+            add(&*danmu);
+    }
+    void clear();
+    void reserve(int count);
+
+    void add(const DanmuComment *danmu);
+    void remove(const DanmuComment *danmu);
+    void removeSource(int sourceId);
+    //sourceId=-1: in any source
+    bool contains(quint64 fp, int sourceId=-1) const;
+    inline bool contains(const DanmuComment *danmu, int sourceId=-1) const {return contains(fingerprint(danmu),sourceId);}
+private:
+    struct Slot
+    {
+        quint64 key;
+        qint32 source;
+        qint32 count;
+    };
+    QVector<Slot> table;
+    int used;
+    bool built;
+
+    static inline quint64 validKey(quint64 key) {return key?key:1;}
+    void insert(quint64 key, int sourceId);
+    void erase(int pos);
+    void place(const Slot &item);
+    void rehash(int capacity);
+};
+#endif // FINGERPRINTINDEX_H
@@ -13,11 +13,14 @@ DanmuManagerModel::~DanmuManagerModel()
     qDeleteAll(animeNodeList);
 }
 
-void DanmuManagerModel::refreshList()
+void DanmuManagerModel::refreshList(const std::function<void()> &done)
 {
-    beginResetModel();
-    GlobalObjects::danmuManager->loadPoolInfo(animeNodeList);
-    endResetModel();
+    GlobalObjects::danmuManager->loadSourceCounts(this,[this,done](){
+        beginResetModel();
+        GlobalObjects::danmuManager->loadPoolInfo(animeNodeList);
+        endResetModel();
+        if(done) done();
+    });
 }
 
 void DanmuManagerModel::exportPool(const QString &dir, bool useTimeline, bool applyBlockRule)
@@ -1,6 +1,7 @@
 #ifndef MANAGERVIEW_H
 #define MANAGERVIEW_H
 #include <QAbstractItemModel>
+#include <functional>
 #include "nodeinfo.h"
 class DanmuManagerModel : public QAbstractItemModel
 {
@@ -8,7 +9,8 @@ class DanmuManagerModel : public QAbstractItemModel
 public:
     explicit DanmuManagerModel(QObject *parent = nullptr);
     virtual ~DanmuManagerModel();
-    void refreshList();
+    //the list is rebuilt once the source counts are read, then done is called
+    void refreshList(const std::function<void()> &done=nullptr);
     void exportPool(const QString &dir, bool useTimeline=true, bool applyBlockRule=false);
     void exportKdFile(const QString &dir, const QString &comment="");
     void deletePool();
@@ -62,14 +62,14 @@ void DanmuPoolNode::setParentCheckStatus()
     }
 }
 
-int DanmuPoolNode::idHash(const QString &str)
+int DanmuPoolNode::idHash(const QString &str, int count)
 {
     size_t hash = 0;
     for(int i=0;i<str.length();++i)
     {
         hash=hash * 131 + str.at(i).unicode();
     }
-    return hash % 5;
+    return hash % count;
 }
 
 DanmuSourceInfo DanmuPoolSourceNode::toSourceInfo()
@@ -24,7 +24,7 @@ struct DanmuPoolNode
     int setCount();
     void setChildrenCheckStatus();
     void setParentCheckStatus();
-    static int idHash(const QString &str);
+    static int idHash(const QString &str, int count);
 };
 struct DanmuPoolSourceNode : public DanmuPoolNode
 {
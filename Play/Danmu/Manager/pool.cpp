@@ -1,5 +1,6 @@
 #include "pool.h"
 #include "danmumanager.h"
+#include "poolloader.h"
 #include "globalobjects.h"
 #include "../blocker.h"
 #include "Common/network.h"
@@ -20,27 +21,102 @@ Pool::Pool(const QString &id, const QString &animeTitle, const QString &epTitle,
 
 }
 
-bool Pool::load()
+bool Pool::load(int focusTime)
 {
     if(!isLoaded && !pid.isEmpty())
     {
         PoolStateLock locker;
         if(!locker.tryLock(pid)) return false;
-        GlobalObjects::danmuManager->loadPool(this);
-        GlobalObjects::blocker->checkDanmu(commentList);
-        isLoaded=true;
+        GlobalObjects::danmuManager->loadPool(this,focusTime);
         return true;
     }
-    GlobalObjects::blocker->checkDanmu(commentList);
+    if(loader)
+    {
+        if(focusTime>=0)
+        {
+            loader->setFocus(focusTime);
+        }
+        else
+        {
+            PoolStateLock locker;
+            if(locker.tryLock(pid)) completeLoad();
+        }
+    }
+    checkBlock();
     return false;
 }
 
+void Pool::completeLoad()
+{
+    if(!loader) return;
+    QList<DanmuComment *> danmuList;
+    loader->decodeAll(danmuList);
+    loader.clear();
+    appendLoaded(danmuList);
+}
+
+bool Pool::takeLoaded()
+{
+    PoolStateLock locker;
+    if(!locker.tryLock(pid)) return false;
+    appendLoaded(loader->takeReady());
+    return true;
+}
+
+void Pool::appendLoaded(const QList<DanmuComment *> &danmuList)
+{
+    if(danmuList.isEmpty()) return;
+    QList<QSharedPointer<DanmuComment> > addedList;
+    addedList.reserve(danmuList.count());
+    for(DanmuComment *danmu:danmuList)
+    {
+        if(!sourcesTable.contains(danmu->source))
+        {
+            delete danmu;
+            continue;
+        }
+        stringPool.intern(danmu);
+        setDelay(danmu);
+        fingerprints.add(danmu);
+        addedList.append(QSharedPointer<DanmuComment>(danmu));
+    }
+    GlobalObjects::blocker->checkDanmu(addedList);
+    const int oldCount=commentList.count();
+    commentList.append(addedList);
+    if(used)
+    {
+        //the loaded part is sorted already, only the new comments need sorting
+        std::sort(commentList.begin()+oldCount,commentList.end(),DanmuSPCompare);
+        std::inplace_merge(commentList.begin(),commentList.begin()+oldCount,commentList.end(),DanmuSPCompare);
+        emit poolDanmuChanged(addedList, QList<QSharedPointer<DanmuComment> >());
+    }
+}
+
+void Pool::setLoadFocus(int time)
+{
+    if(loader) loader->setFocus(time);
+}
+
+void Pool::checkBlock()
+{
+    DanmuStore store;
+    store.build(commentList);
+    GlobalObjects::blocker->checkDanmu(store);
+}
+
 bool Pool::clean()
 {
     PoolStateLock locker;
     if(!locker.tryLock(pid)) return false;
+    if(loader)
+    {
+        loader->cancel();
+        loader.clear();
+    }
     QList<QSharedPointer<DanmuComment> > emptyList;
     commentList.swap(emptyList);
+    stringPool.clear();
+    fingerprints.clear();
     isLoaded=false;
     return true;
 }
@@ -51,14 +127,36 @@ int Pool::update(int sourceId, QList<QSharedPointer<DanmuComment> > *incList)
     if(sourceId!=-1 && !sourcesTable.contains(sourceId)) return 0;
     PoolStateLock locker;
     if(!locker.tryLock(pid)) return 0;
+    completeLoad();
     QList<DanmuComment *> tList;
     GlobalObjects::danmuManager->updatePool(this,tList,sourceId);
+    return mergeUpdate(sourceId,tList,incList);
+}
+
+int Pool::update(int sourceId, QList<DanmuComment *> &danmuList)
+{
+    PoolStateLock locker;
+    if(!sourcesTable.contains(sourceId) || !locker.tryLock(pid))
+    {
+        qDeleteAll(danmuList);
+        danmuList.clear();
+        return 0;
+    }
+    completeLoad();
+    DanmuManager::filterUpdate(danmuList,sourceId,fingerprintIndex(),sourceId);
+    return mergeUpdate(sourceId,danmuList,nullptr);
+}
+
+int Pool::mergeUpdate(int sourceId, QList<DanmuComment *> &tList, QList<QSharedPointer<DanmuComment> > *incList)
+{
     QList<QSharedPointer<DanmuComment> > spList;
     if(sourceId!=-1)
     {
         sourcesTable[sourceId].count+=tList.count();
         for(auto comment:tList)
         {
+            stringPool.intern(comment);
+            fingerprints.add(comment);
             QSharedPointer<DanmuComment> sp(comment);
             commentList.append(sp);
             spList.append(sp);
@@ -70,6 +168,8 @@ int Pool::update(int sourceId, QList<QSharedPointer<DanmuComment> > *incList)
         for(auto &comment:tList)
         {
             sourcesTable[comment->source].count++;
+            stringPool.intern(comment);
+            fingerprints.add(comment);
             QSharedPointer<DanmuComment> sp(comment);
             commentList.append(sp);
             spList.append(sp);
@@ -81,8 +181,9 @@ int Pool::update(int sourceId, QList<QSharedPointer<DanmuComment> > *incList)
     if(!pid.isEmpty()) GlobalObjects::danmuManager->saveSource(pid,nullptr,spList);
     if(tList.count()>0 && used)
     {
-        std::sort(commentList.begin(),commentList.end(),DanmuSPCompare);
-        emit poolChanged(true);
+        //stable, the comments already in the pool keep their order for the incremental merge
+        std::stable_sort(commentList.begin(),commentList.end(),DanmuSPCompare);
+        emit poolDanmuChanged(spList, QList<QSharedPointer<DanmuComment> >());
     }
     return tList.count();
 }
@@ -91,6 +192,47 @@ int Pool::addSource(const DanmuSourceInfo &sourceInfo, QList<DanmuComment *> &da
 {
     PoolStateLock locker;
     if(!locker.tryLock(pid)) return -1;
+    completeLoad();
+    QList<DanmuSourceRows> saveList;
+    const int sourceId=mergeSource(sourceInfo,danmuList,saveList);
+    if(saveList.isEmpty()) return sourceId;
+    if(!pid.isEmpty())GlobalObjects::danmuManager->saveSources(pid,saveList);
+    if(reset && used)
+    {
+        //stable, the comments already in the pool keep their order for the incremental merge
+        std::stable_sort(commentList.begin(),commentList.end(),DanmuSPCompare);
+        emit poolDanmuChanged(saveList.first().danmuList, QList<QSharedPointer<DanmuComment> >());
+    }
+    return sourceId;
+}
+
+QList<int> Pool::addSources(const QList<DanmuSourceInfo> &sourceInfos, QList<QList<DanmuComment *> > &danmuLists, bool reset)
+{
+    Q_ASSERT(sourceInfos.count()==danmuLists.count());
+    PoolStateLock locker;
+    if(!locker.tryLock(pid)) return QList<int>();
+    completeLoad();
+    QList<int> sourceIds;
+    QList<DanmuSourceRows> saveList;
+    for(int i=0;i<sourceInfos.count();++i)
+        sourceIds.append(mergeSource(sourceInfos.at(i),danmuLists[i],saveList));
+    if(saveList.isEmpty()) return sourceIds;
+    //one transaction for all the sources
+    if(!pid.isEmpty())GlobalObjects::danmuManager->saveSources(pid,saveList);
+    if(reset && used)
+    {
+        QList<QSharedPointer<DanmuComment> > addedList;
+        for(const DanmuSourceRows &rows:saveList)
+            addedList.append(rows.danmuList);
+        //stable, the comments already in the pool keep their order for the incremental merge
+        std::stable_sort(commentList.begin(),commentList.end(),DanmuSPCompare);
+        emit poolDanmuChanged(addedList, QList<QSharedPointer<DanmuComment> >());
+    }
+    return sourceIds;
+}
+
+int Pool::mergeSource(const DanmuSourceInfo &sourceInfo, QList<DanmuComment *> &danmuList, QList<DanmuSourceRows> &saveList)
+{
     DanmuSourceInfo *source(nullptr);
     bool containSource=false;
     for(auto iter=sourcesTable.begin();iter!=sourcesTable.end();++iter)
@@ -104,12 +246,10 @@ int Pool::addSource(const DanmuSourceInfo &sourceInfo, QList<DanmuComment *> &da
     }
     if(source)
     {
-        QSet<QString> &&danmuHashSet=getDanmuHashSet(source->id);
+        const FingerprintIndex &index=fingerprintIndex();
         for(auto iter=danmuList.begin();iter!=danmuList.end();)
         {
-            QByteArray hashData(QString("%0%1%2%3").arg((*iter)->text, QString::number((*iter)->originTime), (*iter)->sender, QString::number((*iter)->color)).toUtf8());
-            QString danmuHash(QString(QCryptographicHash::hash(hashData,QCryptographicHash::Md5).toHex()));
-            if(danmuHashSet.contains(danmuHash))
+            if(index.contains(*iter,source->id))
             {
                 delete *iter;
                 iter=danmuList.erase(iter);
@@ -144,16 +284,13 @@ int Pool::addSource(const DanmuSourceInfo &sourceInfo, QList<DanmuComment *> &da
     {
         danmu->source=source->id;
 		setDelay(danmu);
+        stringPool.intern(danmu);
+        fingerprints.add(danmu);
         QSharedPointer<DanmuComment> sp(danmu);
         commentList.append(sp);
         tmpList.append(sp);
     }
-    if(!pid.isEmpty())GlobalObjects::danmuManager->saveSource(pid,containSource?nullptr:source,tmpList);
-    if(reset && used)
-    {
-        std::sort(commentList.begin(),commentList.end(),DanmuSPCompare);
-        emit poolChanged(true);
-    }
+    saveList.append({*source,!containSource,tmpList});
     return source->id;
 }
 
@@ -162,18 +299,24 @@ bool Pool::deleteSource(int sourceId, bool applyDB)
     if(!sourcesTable.contains(sourceId)) return false;
     PoolStateLock locker;
     if(!locker.tryLock(pid)) return false;
+    completeLoad();
     sourcesTable.remove(sourceId);
+    fingerprints.removeSource(sourceId);
+    QList<QSharedPointer<DanmuComment> > removedList;
     for(auto iter=commentList.begin();iter!=commentList.end();)
     {
         if((*iter)->source==sourceId)
+        {
+            removedList.append(*iter);
             iter=commentList.erase(iter);
+        }
         else
             ++iter;
     }
     if(!pid.isEmpty() && applyDB) GlobalObjects::danmuManager->deleteSource(pid,sourceId);
     if(used)
     {
-        emit poolChanged(true);
+        emit poolDanmuChanged(QList<QSharedPointer<DanmuComment> >(), removedList);
     }
     return true;
 }
@@ -186,6 +329,7 @@ bool Pool::deleteDanmu(int pos)
         if(!locker.tryLock(pid)) return false;
         sourcesTable[commentList.at(pos)->source].count--;
         if(!pid.isEmpty())GlobalObjects::danmuManager->deleteDanmu(pid, commentList.at(pos));
+        fingerprints.remove(commentList.at(pos).data());
         commentList.removeAt(pos);
         return true;
     }
@@ -199,6 +343,7 @@ bool Pool::setTimeline(int sourceId, const QList<QPair<int, int> > timelineInfo)
     if(!locker.tryLock(pid)) return false;
     DanmuSourceInfo *srcInfo=&sourcesTable[sourceId];
     srcInfo->timelineInfo=timelineInfo;
+    if(loader) loader->setSource(*srcInfo);
     for(auto iter=commentList.cbegin();iter!=commentList.cend();++iter)
     {
         DanmuComment *cur = (*iter).data();
@@ -221,6 +366,7 @@ bool Pool::setDelay(int sourceId, int delay)
     PoolStateLock locker;
     if(!locker.tryLock(pid)) return false;
     srcInfo->delay=delay;
+    if(loader) loader->setSource(*srcInfo);
     for(auto iter=commentList.cbegin();iter!=commentList.cend();++iter)
     {
         DanmuComment *cur = (*iter).data();
@@ -252,6 +398,7 @@ void Pool::exportPool(const QString &fileName, bool useTimeline, bool applyBlock
     QFile danmuFile(fileName);
     bool ret=danmuFile.open(QIODevice::WriteOnly|QIODevice::Text);
     if(!ret) return;
+    completeLoad();
     QXmlStreamWriter writer(&danmuFile);
     writer.setAutoFormatting(true);
     writer.writeStartDocument();
@@ -291,6 +438,7 @@ void Pool::exportKdFile(QDataStream &stream, const QList<int> &ids)
 {
     PoolStateLock lock;
     if(!lock.tryLock(pid)) return;
+    completeLoad();
 
     stream<<anime<<ep;
     stream<<GlobalObjects::danmuManager->getAssociatedFile16Md5(pid).join(';');
@@ -319,6 +467,7 @@ void Pool::exportKdFile(QDataStream &stream, const QList<int> &ids)
 
 void Pool::exportSimpleInfo(int srcId, QList<SimpleDanmuInfo> &simpleDanmuList)
 {
+    completeLoad();
     for(const auto &danmu:commentList)
     {
         if(danmu->source!=srcId) continue;
@@ -332,11 +481,13 @@ void Pool::exportSimpleInfo(int srcId, QList<SimpleDanmuInfo> &simpleDanmuList)
 
 QJsonArray Pool::exportJson()
 {
+    completeLoad();
     return exportJson(commentList);
 }
 
 QJsonObject Pool::exportFullJson()
 {
+    completeLoad();
     QJsonArray danmuArray(exportJson(commentList, true));
     QJsonArray sourceArray;
     for(auto &source:sourcesTable)
@@ -452,19 +603,10 @@ QJsonArray Pool::getPoolCodeInfo(const QString &code)
 }
 
 
-QSet<QString> Pool::getDanmuHashSet(int sourceId)
+const FingerprintIndex &Pool::fingerprintIndex()
 {
-    if(sourceId != -1 && !sourcesTable.contains(sourceId)) return QSet<QString>();
-    QSet<QString> hashSet;
-    for(QSharedPointer<DanmuComment> &danmu:commentList)
-    {
-        if(danmu->source==sourceId || sourceId==-1)
-        {
-            QByteArray hashData(QString("%0%1%2%3").arg(danmu->text).arg(danmu->originTime).arg(danmu->sender).arg(danmu->color).toUtf8());
-            hashSet.insert(QCryptographicHash::hash(hashData,QCryptographicHash::Md5).toHex());
-        }
-    }
-    return hashSet;
+    if(!fingerprints.isBuilt()) fingerprints.build(commentList);
+    return fingerprints;
 }
 
 void Pool::addSourceJson(const QJsonArray &array)
@@ -482,13 +624,5 @@ void Pool::addSourceJson(const QJsonArray &array)
 
 void Pool::setDelay(DanmuComment *danmu)
 {
-    DanmuSourceInfo *srcInfo=&sourcesTable[danmu->source];
-    int delay=0;
-    for(auto &spaceItem:srcInfo->timelineInfo)
-    {
-        if(danmu->originTime>spaceItem.first)delay+=spaceItem.second;
-        else break;
-    }
-    delay+=srcInfo->delay;
-    danmu->time=danmu->originTime+delay<0?danmu->originTime:danmu->originTime+delay;
+    danmu->time=sourcesTable[danmu->source].playTime(danmu->originTime);
 }
@@ -3,6 +3,10 @@
 
 #include <QObject>
 #include "../common.h"
+#include "../danmustore.h"
+#include "fingerprintindex.h"
+class PoolLoader;
+struct DanmuSourceRows;
 
 class Pool : public QObject
 {
@@ -15,15 +19,21 @@ public:
     inline bool isUsed() const {return used;}
     inline const QString &animeTitle() const {return anime;}
     inline const QString &epTitle() const {return ep;}
+    //comments are still streamed in, see DanmuManager::getPoolWindowed
+    inline bool isLoading() const {return !loader.isNull();}
 public:
     int update(int sourceId=-1, QList<QSharedPointer<DanmuComment> > *incList=nullptr);
     int addSource(const DanmuSourceInfo &sourceInfo, QList<DanmuComment *> &danmuList, bool reset=false);
+    //all or nothing, empty if the pool is busy, the pool takes the comments otherwise
+    QList<int> addSources(const QList<DanmuSourceInfo> &sourceInfos, QList<QList<DanmuComment *> > &danmuLists, bool reset=false);
     bool deleteSource(int sourceId, bool applyDB=true);
     bool deleteDanmu(int pos);
     bool setTimeline(int sourceId, const QList<QPair<int,int> > timelineInfo);
     bool setDelay(int sourceId, int delay);
     void setUsed(bool on);
     void setSourceVisibility(int srcId, bool show);
+    //segments around time are streamed in first
+    void setLoadFocus(int time);
     void exportPool(const QString &fileName, bool useTimeline=true, bool applyBlockRule=false, const QList<int> &ids=QList<int>());
     void exportKdFile(QDataStream &stream, const QList<int> &ids=QList<int>());
     void exportSimpleInfo(int srcId, QList<SimpleDanmuInfo> &simpleDanmuList);
@@ -41,16 +51,30 @@ private:
     bool isLoaded;
     QList<QSharedPointer<DanmuComment> > commentList;
     QMap<int,DanmuSourceInfo> sourcesTable;
+    DanmuStringPool stringPool;
+    QSharedPointer<PoolLoader> loader;
+    FingerprintIndex fingerprints;
 
-    bool load();
+    //comments downloaded for the source by DanmuManager, the pool takes them
+    int update(int sourceId, QList<DanmuComment *> &danmuList);
+    int mergeSource(const DanmuSourceInfo &sourceInfo, QList<DanmuComment *> &danmuList, QList<DanmuSourceRows> &saveList);
+    int mergeUpdate(int sourceId, QList<DanmuComment *> &tList, QList<QSharedPointer<DanmuComment> > *incList);
+    bool load(int focusTime=-1);
     bool clean();
+    void completeLoad();
+    bool takeLoaded();
+    void appendLoaded(const QList<DanmuComment *> &danmuList);
+    void checkBlock();
     void setDelay(DanmuComment *danmu);
-    QSet<QString> getDanmuHashSet(int sourceId=-1);
+    //built on first use, call with the pool locked and loaded completely
+    const FingerprintIndex &fingerprintIndex();
     void addSourceJson(const QJsonArray &array);
 
     friend class DanmuManager;
 signals:
     void poolChanged(bool reset);
+    //only comments were added/removed, the time of other comments is unchanged
+    void poolDanmuChanged(const QList<QSharedPointer<DanmuComment> > &addedList, const QList<QSharedPointer<DanmuComment> > &removedList);
 public slots:
 };
 
@@ -0,0 +1,143 @@
+#include "poolloader.h"
+#include "../common.h"
+
+PoolLoader::PoolLoader():focus(0),decoding(false),cancelled(false)
+{
+
+}
+
+PoolLoader::~PoolLoader()
+{
+    qDeleteAll(ready);
+}
+
+void PoolLoader::addBlock(const DanmuSourceInfo &source, const DanmuBlock &block)
+{
+    const int blockIndex=blocks.count();
+    blocks.append(qMakePair(source.id,block));
+    sources.insert(source.id,source);
+    const auto &segs=block.segments();
+    for(int i=0;i<segs.count();++i)
+    {
+        PendingSegment seg{blockIndex,i,segs.at(i).startTime,segs.at(i).endTime,segs.at(i).count};
+        pending.append(seg);
+    }
+}
+
+void PoolLoader::decodeWindow(int start, int end, QList<DanmuComment *> &outList)
+{
+    QMutexLocker locker(&lock);
+    for(auto iter=pending.begin();iter!=pending.end();)
+    {
+        int segStart, segEnd;
+        playRange(*iter,segStart,segEnd);
+        if(segEnd>=start && segStart<=end)
+        {
+            decode(*iter,outList);
+            iter=pending.erase(iter);
+        }
+        else
+            ++iter;
+    }
+}
+
+bool PoolLoader::decodeNext(int maxCount)
+{
+    QList<PendingSegment> segs;
+    {
+        QMutexLocker locker(&lock);
+        if(cancelled || pending.isEmpty()) return false;
+        int count=0;
+        while(!pending.isEmpty() && count<maxCount)
+        {
+            int nearest=0;
+            for(int i=1;i<pending.count();++i)
+            {
+                if(distance(pending.at(i))<distance(pending.at(nearest))) nearest=i;
+            }
+            count+=pending.at(nearest).count;
+            segs.append(pending.takeAt(nearest));
+        }
+        decoding=true;
+    }
+    //blocks is not modified once the loader is shared, decoding needs no lock
+    QList<DanmuComment *> danmuList;
+    for(const PendingSegment &seg:segs)
+        decode(seg,danmuList);
+    QMutexLocker locker(&lock);
+    decoding=false;
+    decodeDone.wakeAll();
+    if(cancelled)
+    {
+        qDeleteAll(danmuList);
+        return false;
+    }
+    ready.append(danmuList);
+    return !pending.isEmpty();
+}
+
+void PoolLoader::decodeAll(QList<DanmuComment *> &outList)
+{
+    QMutexLocker locker(&lock);
+    //segments taken by the work thread are not pending any more, wait for them
+    while(decoding) decodeDone.wait(&lock);
+    outList.append(ready);
+    ready.clear();
+    for(const PendingSegment &seg:pending)
+        decode(seg,outList);
+    pending.clear();
+}
+
+QList<DanmuComment *> PoolLoader::takeReady()
+{
+    QMutexLocker locker(&lock);
+    QList<DanmuComment *> danmuList;
+    danmuList.swap(ready);
+    return danmuList;
+}
+
+void PoolLoader::setSource(const DanmuSourceInfo &source)
+{
+    QMutexLocker locker(&lock);
+    if(sources.contains(source.id)) sources.insert(source.id,source);
+}
+
+void PoolLoader::setFocus(int time)
+{
+    QMutexLocker locker(&lock);
+    focus=time;
+}
+
+void PoolLoader::cancel()
+{
+    QMutexLocker locker(&lock);
+    cancelled=true;
+    pending.clear();
+    qDeleteAll(ready);
+    ready.clear();
+}
+
+int PoolLoader::distance(const PendingSegment &seg) const
+{
+    int start, end;
+    playRange(seg,start,end);
+    if(end<focus) return (focus-end)*2; //playback moves forward, the segments behind come later
+    if(start>focus) return start-focus;
+    return 0;
+}
+
+void PoolLoader::playRange(const PendingSegment &seg, int &start, int &end) const
+{
+    auto source=sources.constFind(blocks.at(seg.block).first);
+    start=source->playTime(seg.startTime);
+    end=source->playTime(seg.endTime);
+    //a negative delay is not applied to the comments it would move before 0, the range may turn around
+    if(start>end) qSwap(start,end);
+}
+
+void PoolLoader::decode(const PendingSegment &seg, QList<DanmuComment *> &outList) const
+{
+    const auto &block=blocks.at(seg.block);
+    if(!block.second.decodeSegment(seg.segment,block.first,outList))
+        qDebug()<<"invalid danmu block segment:"<<block.first<<seg.segment;
+}
@@ -0,0 +1,54 @@
+#ifndef POOLLOADER_H
+#define POOLLOADER_H
+#include <QtCore>
+#include "danmublock.h"
+#include "../common.h"
+/*
+ * Segments of a pool that is loaded by time window (see DanmuManager::loadPool).
+ * The window around the playback position is decoded during the load, the rest stays here
+ * and is decoded on the work thread, the segments nearest the focus time first.
+ * Segment ranges are in originTime, they are shifted by the delay and timeline of their source
+ * before they are compared with the window and the focus, which are in playback time.
+ * Decoded comments wait in the ready list until the pool takes them on its own thread.
+ * Blocks are only added before the loader is shared, everything else is guarded by the mutex.
+ */
+class PoolLoader
+{
+public:
+    PoolLoader();
+    ~PoolLoader();
+    void addBlock(const DanmuSourceInfo &source, const DanmuBlock &block);
+    //the delay or timeline of the source changed
+    void setSource(const DanmuSourceInfo &source);
+    //segments overlapping [start, end](playback time) are decoded at once, new comments are appended to outList
+    void decodeWindow(int start, int end, QList<DanmuComment *> &outList);
+    //decodes segments for about maxCount comments into the ready list, false if nothing is left
+    bool decodeNext(int maxCount);
+    //the rest, including the ready list, is appended to outList, the caller owns the comments
+    void decodeAll(QList<DanmuComment *> &outList);
+    QList<DanmuComment *> takeReady();
+    void setFocus(int time);
+    void cancel();
+private:
+    struct PendingSegment
+    {
+        int block, segment;
+        int startTime, endTime;
+        int count;
+    };
+    mutable QMutex lock;
+    QWaitCondition decodeDone;
+    QList<QPair<int,DanmuBlock> > blocks;
+    QHash<int,DanmuSourceInfo> sources;
+    QList<PendingSegment> pending;
+    QList<DanmuComment *> ready;
+    int focus;
+    bool decoding;
+    bool cancelled;
+
+    int distance(const PendingSegment &seg) const;
+    //playback time of the segment, the lock is held
+    void playRange(const PendingSegment &seg, int &start, int &end) const;
+    void decode(const PendingSegment &seg, QList<DanmuComment *> &outList) const;
+};
+#endif // POOLLOADER_H
@@ -0,0 +1,83 @@
+#include "refreshscheduler.h"
+#include <QtConcurrent>
+#include "../common.h"
+#include "../providermanager.h"
+#include "../blocker.h"
+#include "globalobjects.h"
+
+RefreshScheduler::RefreshScheduler(QThreadPool *pool, int providerLimit):threadPool(pool),limit(qMax(1,providerLimit))
+{
+
+}
+
+void RefreshScheduler::add(const QString &url)
+{
+    if(urls.contains(url)) return;
+    urls.insert(url);
+    //unsupported URLs fail at once, they share the empty provider id
+    pending[GlobalObjects::providerManager->getSourceProvider(url)].enqueue(url);
+}
+
+void RefreshScheduler::run(const MergeFunc &merge)
+{
+    if(urls.isEmpty()) return;
+    struct Result
+    {
+        QString provider, url;
+        QList<DanmuComment *> danmuList;
+        QString errInfo;
+    };
+    //filled by the refresh threads, taken by this thread
+    QMutex resultLock;
+    QWaitCondition resultReady;
+    QQueue<Result> results;
+    QHash<QString,int> running;
+    int runningCount=0, remaining=urls.count();
+    const int maxRunning=qMax(1,threadPool->maxThreadCount());
+    auto dispatch=[&](){
+        bool started=true;
+        while(started && runningCount<maxRunning)
+        {
+            started=false;
+            for(auto iter=pending.begin();iter!=pending.end() && runningCount<maxRunning;++iter)
+            {
+                if(iter.value().isEmpty() || running.value(iter.key())>=limit) continue;
+                const QString provider(iter.key()), url(iter.value().dequeue());
+                ++running[provider];
+                ++runningCount;
+                started=true;
+                QtConcurrent::run(threadPool,[&resultLock,&resultReady,&results,provider,url](){
+                    Result result{provider,url,QList<DanmuComment *>(),QString()};
+                    result.errInfo=GlobalObjects::providerManager->downloadBySourceURL(url,result.danmuList);
+                    QMutexLocker locker(&resultLock);
+                    results.enqueue(result);
+                    resultReady.wakeOne();
+                });
+            }
+        }
+    };
+    dispatch();
+    while(remaining>0)
+    {
+        QQueue<Result> finished;
+        resultLock.lock();
+        while(results.isEmpty())
+            resultReady.wait(&resultLock);
+        finished.swap(results);
+        resultLock.unlock();
+        while(!finished.isEmpty())
+        {
+            Result result(finished.dequeue());
+            --running[result.provider];
+            --runningCount;
+            //start the next downloads before merging, merging may take a while on large pools
+            dispatch();
+            //the block rules are not thread safe, prefilter here instead of on the refresh threads
+            if(result.errInfo.isEmpty()) GlobalObjects::blocker->preFilter(result.danmuList);
+            merge(result.url,result.danmuList,result.errInfo);
+            --remaining;
+        }
+    }
+    pending.clear();
+    urls.clear();
+}
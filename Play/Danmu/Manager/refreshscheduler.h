@@ -0,0 +1,32 @@
+#ifndef REFRESHSCHEDULER_H
+#define REFRESHSCHEDULER_H
+#include <QtCore>
+#include <functional>
+class DanmuComment;
+/*
+ * Downloads many sources at once for a batch refresh (see DanmuManager::updatePool).
+ * Each URL is downloaded once however many sources share it. Downloading and parsing run on
+ * the refresh threads, at most providerLimit requests per provider at a time so one site is
+ * not flooded, the providers are served in turn. Finished downloads are prefiltered and handed
+ * to the merge callback on the thread that called run() while the other downloads go on.
+ * The threads of the pool should not expire: Network keeps one QNetworkAccessManager per thread.
+ */
+class RefreshScheduler
+{
+public:
+    //the callback owns danmuList, errInfo is empty on success
+    using MergeFunc=std::function<void(const QString &url, QList<DanmuComment *> &danmuList, const QString &errInfo)>;
+
+    RefreshScheduler(QThreadPool *pool, int providerLimit);
+    void add(const QString &url);
+    inline int count() const {return urls.count();}
+    //blocks until every URL is merged, the merge callback runs in between without processing events
+    void run(const MergeFunc &merge);
+private:
+    QThreadPool *threadPool;
+    int limit;
+    QSet<QString> urls;
+    //provider id -> URLs waiting for a slot
+    QMap<QString,QQueue<QString> > pending;
+};
+#endif // REFRESHSCHEDULER_H
@@ -1,5 +1,6 @@
 #include "bilibiliprovider.h"
 #include "Common/network.h"
+#include "xmldanmuparser.h"
 namespace
 {
     const char *supportedUrlRe[]={"(https?://)?www\\.bilibili\\.com/video/av[0-9]+/?",
@@ -103,8 +104,8 @@ QString BilibiliProvider::downloadDanmu(DanmuSourceItem *item, QList<DanmuCommen
     QString errInfo;
     try
     {
-        QString replyStr(Network::httpGet(QString("http://comment.bilibili.com/%1.xml").arg(item->subId),QUrlQuery()));
-        handleDownloadReply(replyStr,danmuList);
+        const QByteArray reply(Network::httpGet(QString("http://comment.bilibili.com/%1.xml").arg(item->subId),QUrlQuery()));
+        handleDownloadReply(reply,danmuList);
     }
     catch(Network::NetworkError &error)
     {
@@ -356,50 +357,7 @@ void BilibiliProvider::decodeEpList(const QByteArray &bytes, DanmuAccessResult *
     }
 }
 
-void BilibiliProvider::handleDownloadReply(QString &reply, QList<DanmuComment *> &danmuList)
+void BilibiliProvider::handleDownloadReply(const QByteArray &reply, QList<DanmuComment *> &danmuList)
 {
-    QXmlStreamReader reader(reply);
-    while(!reader.atEnd())
-    {
-        if(reader.isStartElement() && reader.name()=="d")
-        {
-            QXmlStreamAttributes attributes=reader.attributes();
-            if(attributes.hasAttribute("p"))
-            {
-                QStringList attrList=attributes.value("p").toString().split(',');
-                if(attrList.length()<8)continue;
-                DanmuComment *danmu=new DanmuComment();
-                danmu->text=reader.readElementText();
-                danmu->time = attrList[0].toFloat() * 1000;
-                danmu->originTime=danmu->time;
-                danmu->setType(attrList[1].toInt());
-                danmu->color=attrList[3].toInt();
-                danmu->date=attrList[4].toLongLong();
-                danmu->sender="[Bilibili]"+attrList[6];
-                switch (attrList[2].toInt())
-                {
-                case 25:
-                    danmu->fontSizeLevel=DanmuComment::Normal;
-                    break;
-                case 18:
-                    danmu->fontSizeLevel=DanmuComment::Small;
-                    break;
-                case 36:
-                    danmu->fontSizeLevel=DanmuComment::Large;
-                    break;
-                default:
-                    break;
-                }
-                if(danmu->type!=DanmuComment::UNKNOW)danmuList.append(danmu);
-                else
-                {
-#ifdef QT_DEBUG
-                    qDebug()<<"unsupport danmu mode:"<<danmu->text;
-#endif
-                    delete danmu;
-                }
-            }
-        }
-        reader.readNext();
-    }
+    XmlDanmuParser::parse(reply,danmuList,{8,QStringLiteral("[Bilibili]"),true});
 }
@@ -25,7 +25,7 @@ private:
     void handleViewReply(QJsonDocument &document, DanmuAccessResult *result, DanmuSourceItem *sItem);
     void decodeVideoList(const QByteArray &bytes, DanmuAccessResult *result, int aid);
     void decodeEpList(const QByteArray &bytes, DanmuAccessResult *result, int aid);
-    void handleDownloadReply(QString &reply,QList<DanmuComment *> &danmuList);
+    void handleDownloadReply(const QByteArray &reply, QList<DanmuComment *> &danmuList);
 };
 
 #endif // BILIBILIPROVIDER_H
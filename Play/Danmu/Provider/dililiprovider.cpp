@@ -1,5 +1,6 @@
 #include "dililiprovider.h"
 #include "Common/network.h"
+#include "xmldanmuparser.h"
 #include "Common/htmlparsersax.h"
 
 namespace
@@ -118,8 +119,8 @@ QString DililiProvider::downloadDanmu(DanmuSourceItem *item, QList<DanmuComment
     query.addQueryItem("id", videoId);
     try
     {
-        QString replyStr(Network::httpGet(baseUrl,query));
-        handleDownloadReply(replyStr,danmuList);
+        const QByteArray reply(Network::httpGet(baseUrl,query));
+        handleDownloadReply(reply,danmuList);
     }
     catch(Network::NetworkError &error)
     {
@@ -241,48 +242,7 @@ void DililiProvider::handleEpReply(const QString &reply, DanmuAccessResult *resu
     return;
 }
 
-void DililiProvider::handleDownloadReply(const QString &reply, QList<DanmuComment *> &danmuList)
+void DililiProvider::handleDownloadReply(const QByteArray &reply, QList<DanmuComment *> &danmuList)
 {
-    QXmlStreamReader reader(reply);
-    while(!reader.atEnd())
-    {
-        if(reader.isStartElement() && reader.name()=="d")
-        {
-            QXmlStreamAttributes attributes=reader.attributes();
-            if(attributes.hasAttribute("p"))
-            {
-                QStringList attrList=attributes.value("p").toString().split(',');
-                if(attrList.length()<7)continue;
-                DanmuComment *danmu=new DanmuComment();
-                danmu->text=reader.readElementText();
-                danmu->time = attrList[0].toFloat() * 1000;
-                danmu->originTime=danmu->time;
-                danmu->setType(attrList[1].toInt());
-                danmu->color=attrList[3].toInt();
-                danmu->date=attrList[4].toLongLong();
-                danmu->sender="[5dm]"+attrList[6];
-                switch (attrList[2].toInt())
-                {
-                case 18:
-                    danmu->fontSizeLevel=DanmuComment::Small;
-                    break;
-                case 36:
-                    danmu->fontSizeLevel=DanmuComment::Large;
-                    break;
-                default:
-                    danmu->fontSizeLevel=DanmuComment::Normal;
-                    break;
-                }
-                if(danmu->type!=DanmuComment::UNKNOW)danmuList.append(danmu);
-                else
-                {
-#ifdef QT_DEBUG
-                    qDebug()<<"unsupport danmu mode:"<<danmu->text;
-#endif
-                    delete danmu;
-                }
-            }
-        }
-        reader.readNext();
-    }
+    XmlDanmuParser::parse(reply,danmuList,{7,QStringLiteral("[5dm]"),true});
 }
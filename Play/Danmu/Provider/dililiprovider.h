@@ -23,6 +23,6 @@ public slots:
 private:
     void handleSearchReply(const QString &reply,DanmuAccessResult *result);
     void handleEpReply(const QString &reply, DanmuAccessResult *result);
-    void handleDownloadReply(const QString &reply, QList<DanmuComment *> &danmuList);
+    void handleDownloadReply(const QByteArray &reply, QList<DanmuComment *> &danmuList);
 };
 #endif // DILILIPROVIDER_H
@@ -1,6 +1,7 @@
 #include "tucaoprovider.h"
 #include "Common/htmlparsersax.h"
 #include "Common/network.h"
+#include "xmldanmuparser.h"
 
 namespace
 {
@@ -87,8 +88,8 @@ QString TucaoProvider::downloadDanmu(DanmuSourceItem *item, QList<DanmuComment *
     QString errInfo;
     try
     {
-        QString replyStr(Network::httpGet(baseUrl,query));
-        handleDownloadReply(replyStr,danmuList);
+        const QByteArray reply(Network::httpGet(baseUrl,query));
+        handleDownloadReply(reply,danmuList);
     }
     catch(Network::NetworkError &error)
     {
@@ -181,51 +182,9 @@ void TucaoProvider::handleEpReply(QString &reply,DanmuSourceItem *item, DanmuAcc
     result->error=false;
 }
 
-void TucaoProvider::handleDownloadReply(QString &reply, QList<DanmuComment *> &danmuList)
+void TucaoProvider::handleDownloadReply(const QByteArray &reply, QList<DanmuComment *> &danmuList)
 {
-    QXmlStreamReader reader(reply);
-    while(!reader.atEnd())
-    {
-        if(reader.isStartElement() && reader.name()=="d")
-        {
-            QXmlStreamAttributes attributes=reader.attributes();
-            if(attributes.hasAttribute("p"))
-            {
-                QStringList attrList=attributes.value("p").toString().split(',');
-                if(attrList.length()<5)continue;
-                DanmuComment *danmu=new DanmuComment();
-                danmu->text=reader.readElementText();
-                danmu->time = attrList[0].toFloat() * 1000;
-                danmu->originTime=danmu->time;
-                danmu->setType(attrList[1].toInt());
-                danmu->color=attrList[3].toInt();
-                danmu->date=attrList[4].toLongLong();
-                danmu->blockBy=-1;
-                danmu->sender="[Tucao]";
-                switch (attrList[2].toInt())
-                {
-                case 18:
-                    danmu->fontSizeLevel=DanmuComment::Small;
-                    break;
-                case 36:
-                    danmu->fontSizeLevel=DanmuComment::Large;
-                    break;
-                default:
-                    danmu->fontSizeLevel=DanmuComment::Normal;
-                    break;
-                }
-                if(danmu->type!=DanmuComment::UNKNOW)danmuList.append(danmu);
-                else
-                {
-#ifdef QT_DEBUG
-                    qDebug()<<"unsupport danmu mode:"<<danmu->text;
-#endif
-                    delete danmu;
-                }
-            }
-        }
-        reader.readNext();
-    }
+    XmlDanmuParser::parse(reply,danmuList,{5,QStringLiteral("[Tucao]"),false});
 }
 
 QStringList TucaoProvider::supportedURLs()
@@ -22,6 +22,6 @@ public slots:
 private:
     void handleSearchReply(QString &reply,DanmuAccessResult *result);
     void handleEpReply(QString &reply,DanmuSourceItem *item, DanmuAccessResult *result);
-    void handleDownloadReply(QString &reply,QList<DanmuComment *> &danmuList);
+    void handleDownloadReply(const QByteArray &reply, QList<DanmuComment *> &danmuList);
 };
 #endif // TUCAOPROVIDER_H
@@ -0,0 +1,409 @@
+#include "xmldanmuparser.h"
+#include <QTextCodec>
+#include <cstring>
+#include <limits>
+#include "../common.h"
+
+namespace
+{
+    //time,mode,size,color,date,pool,sender,id,(weight)
+    const int MaxFields=9;
+    const double Pow10[]={1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+                          1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+
+    struct Span
+    {
+        const char *begin, *end;
+    };
+
+    inline bool isSpace(char c) {return c==' ' || c=='\t' || c=='\n' || c=='\r';}
+    inline bool startsWith(const char *p, const char *end, const char *str, int len)
+    {
+        return end-p>=len && memcmp(p,str,len)==0;
+    }
+    const char *find(const char *p, const char *end, const char *str, int len)
+    {
+        while(end-p>=len)
+        {
+            p=static_cast<const char *>(memchr(p,str[0],end-p-len+1));
+            if(!p) return nullptr;
+            if(memcmp(p,str,len)==0) return p;
+            ++p;
+        }
+        return nullptr;
+    }
+    inline void trim(Span &s)
+    {
+        while(s.begin<s.end && isSpace(*s.begin)) ++s.begin;
+        while(s.end>s.begin && isSpace(*(s.end-1))) --s.end;
+    }
+
+    //0 if the field is not a number, like QString::toLongLong
+    qint64 toLongLong(Span s)
+    {
+        trim(s);
+        const char *p=s.begin;
+        bool neg=false;
+        if(p<s.end && (*p=='-' || *p=='+')) neg=(*p++=='-');
+        if(p==s.end) return 0;
+        quint64 val=0;
+        for(;p<s.end;++p)
+        {
+            if(*p<'0' || *p>'9') return 0;
+            const quint64 next=val*10+quint64(*p-'0');
+            if(next/10!=val || next>quint64(std::numeric_limits<qint64>::max())) return 0;
+            val=next;
+        }
+        return neg?-qint64(val):qint64(val);
+    }
+    inline int toInt(const Span &s)
+    {
+        const qint64 val=toLongLong(s);
+        return (val<std::numeric_limits<int>::min() || val>std::numeric_limits<int>::max())?0:int(val);
+    }
+    //same result as QString::toFloat: decimal->double(correctly rounded)->float
+    float toFloat(Span s)
+    {
+        trim(s);
+        const char *p=s.begin;
+        bool neg=false;
+        if(p<s.end && (*p=='-' || *p=='+')) neg=(*p++=='-');
+        quint64 mantissa=0;
+        int digits=0, frac=0;
+        bool dot=false, simple=(p<s.end);
+        for(;p<s.end && simple;++p)
+        {
+            if(*p=='.' && !dot)
+            {
+                dot=true;
+                continue;
+            }
+            if(*p<'0' || *p>'9')
+            {
+                simple=false;
+                break;
+            }
+            mantissa=mantissa*10+quint64(*p-'0');
+            if(mantissa) ++digits;
+            if(dot) ++frac;
+            if(digits>15 || frac>22) simple=false;
+        }
+        //mantissa<2^53 and 10^frac are exact, one division rounds correctly
+        if(simple) return float(neg?-(double(mantissa)/Pow10[frac]):double(mantissa)/Pow10[frac]);
+        return QByteArray(s.begin,int(s.end-s.begin)).toFloat();
+    }
+
+    void appendUtf8(QByteArray &buf, uint code)
+    {
+        if(code<0x80)
+        {
+            buf.append(char(code));
+        }
+        else if(code<0x800)
+        {
+            buf.append(char(0xc0|(code>>6)));
+            buf.append(char(0x80|(code&0x3f)));
+        }
+        else if(code<0x10000)
+        {
+            buf.append(char(0xe0|(code>>12)));
+            buf.append(char(0x80|((code>>6)&0x3f)));
+            buf.append(char(0x80|(code&0x3f)));
+        }
+        else
+        {
+            buf.append(char(0xf0|(code>>18)));
+            buf.append(char(0x80|((code>>12)&0x3f)));
+            buf.append(char(0x80|((code>>6)&0x3f)));
+            buf.append(char(0x80|(code&0x3f)));
+        }
+    }
+    //p points to '&', returns the position after the entity or p if it is not one
+    const char *decodeEntity(const char *p, const char *end, QByteArray &buf)
+    {
+        const char *semi=static_cast<const char *>(memchr(p,';',qMin<qint64>(end-p,12)));
+        if(!semi) return p;
+        const char *name=p+1;
+        const int len=int(semi-name);
+        if(len>1 && name[0]=='#')
+        {
+            const bool hex=(name[1]=='x' || name[1]=='X');
+            uint code=0;
+            for(const char *c=name+(hex?2:1);c<semi;++c)
+            {
+                int d;
+                if(*c>='0' && *c<='9') d=*c-'0';
+                else if(hex && *c>='a' && *c<='f') d=*c-'a'+10;
+                else if(hex && *c>='A' && *c<='F') d=*c-'A'+10;
+                else return p;
+                code=code*(hex?16:10)+uint(d);
+                if(code>0x10ffff) return p;
+            }
+            appendUtf8(buf,code);
+            return semi+1;
+        }
+        char c;
+        if(len==2 && name[0]=='l' && name[1]=='t') c='<';
+        else if(len==2 && name[0]=='g' && name[1]=='t') c='>';
+        else if(len==3 && memcmp(name,"amp",3)==0) c='&';
+        else if(len==4 && memcmp(name,"quot",4)==0) c='"';
+        else if(len==4 && memcmp(name,"apos",4)==0) c='\'';
+        else return p;
+        buf.append(c);
+        return semi+1;
+    }
+    //entities are decoded, CDATA is copied as it is, line ends become '\n' like QXmlStreamReader does
+    QString decodeText(const char *p, const char *end, QByteArray &buf)
+    {
+        const char *special=p;
+        while(special<end && *special!='&' && *special!='\r' && *special!='<') ++special;
+        if(special==end) return QString::fromUtf8(p,int(end-p));
+        buf.resize(0);
+        while(p<end)
+        {
+            const char *run=p;
+            while(p<end && *p!='&' && *p!='\r' && *p!='<') ++p;
+            buf.append(run,int(p-run));
+            if(p==end) break;
+            if(*p=='&')
+            {
+                const char *next=decodeEntity(p,end,buf);
+                if(next==p)
+                {
+                    buf.append('&');
+                    ++p;
+                }
+                else
+                {
+                    p=next;
+                }
+            }
+            else if(*p=='\r')
+            {
+                buf.append('\n');
+                if(++p<end && *p=='\n') ++p;
+            }
+            else if(startsWith(p,end,"<![CDATA[",9))
+            {
+                const char *cdataEnd=find(p+9,end,"]]>",3);
+                buf.append(p+9,int((cdataEnd?cdataEnd:end)-p-9));
+                p=cdataEnd?cdataEnd+3:end;
+            }
+            else if(startsWith(p,end,"<!--",4))
+            {
+                const char *commentEnd=find(p+4,end,"-->",3);
+                p=commentEnd?commentEnd+3:end;
+            }
+            else
+            {
+                buf.append(*p++);
+            }
+        }
+        return QString::fromUtf8(buf);
+    }
+    //first '<' that is not CDATA or a comment
+    const char *textEnd(const char *p, const char *end)
+    {
+        while(p<end)
+        {
+            p=static_cast<const char *>(memchr(p,'<',end-p));
+            if(!p) return end;
+            if(startsWith(p,end,"<![CDATA[",9))
+            {
+                p=find(p+9,end,"]]>",3);
+                if(!p) return end;
+                p+=3;
+            }
+            else if(startsWith(p,end,"<!--",4))
+            {
+                p=find(p+4,end,"-->",3);
+                if(!p) return end;
+                p+=3;
+            }
+            else
+            {
+                return p;
+            }
+        }
+        return end;
+    }
+
+    void parseUtf8(const char *p, const char *end, QList<DanmuComment *> &danmuList, const XmlDanmuParser::Format &format)
+    {
+        QByteArray buf;
+        Span fields[MaxFields];
+        while(p<end)
+        {
+            p=static_cast<const char *>(memchr(p,'<',end-p));
+            if(!p) break;
+            if(startsWith(p,end,"<!--",4) || startsWith(p,end,"<![CDATA[",9))
+            {
+                const bool comment=(p[1]=='!' && p[2]=='-');
+                p=comment?find(p+4,end,"-->",3):find(p+9,end,"]]>",3);
+                if(!p) break;
+                p+=3;
+                continue;
+            }
+            if(end-p<3 || p[1]!='d' || !(isSpace(p[2]) || p[2]=='>' || p[2]=='/'))
+            {
+                ++p;
+                continue;
+            }
+            //attributes, only p is kept
+            const char *q=p+2;
+            Span attr{nullptr,nullptr};
+            bool closed=false, malformed=false;
+            while(true)
+            {
+                while(q<end && isSpace(*q)) ++q;
+                if(q>=end) return;
+                if(*q=='>')
+                {
+                    ++q;
+                    break;
+                }
+                if(*q=='/')
+                {
+                    closed=true;
+                    q=static_cast<const char *>(memchr(q,'>',end-q));
+                    if(!q) return;
+                    ++q;
+                    break;
+                }
+                const char *name=q;
+                while(q<end && *q!='=' && *q!='>' && *q!='/' && !isSpace(*q)) ++q;
+                const char *nameEnd=q;
+                while(q<end && isSpace(*q)) ++q;
+                if(q>=end) return;
+                if(*q!='=')
+                {
+                    malformed=true;
+                    break;
+                }
+                ++q;
+                while(q<end && isSpace(*q)) ++q;
+                if(q>=end) return;
+                const char quote=*q;
+                if(quote!='"' && quote!='\'')
+                {
+                    malformed=true;
+                    break;
+                }
+                const char *value=++q;
+                q=static_cast<const char *>(memchr(q,quote,end-q));
+                if(!q) return;
+                if(nameEnd-name==1 && *name=='p') attr={value,q};
+                ++q;
+            }
+            p=q;
+            if(malformed || !attr.begin) continue;
+            int fieldCount=0;
+            for(const char *f=attr.begin;;)
+            {
+                const char *comma=static_cast<const char *>(memchr(f,',',attr.end-f));
+                if(fieldCount<MaxFields) fields[fieldCount]={f,comma?comma:attr.end};
+                ++fieldCount;
+                if(!comma) break;
+                f=comma+1;
+            }
+            const char *text=p;
+            if(!closed) p=textEnd(p,end);
+            if(fieldCount<format.minFields) continue;
+            DanmuComment *danmu=new DanmuComment();
+            if(!closed) danmu->text=decodeText(text,p,buf);
+            danmu->time=toFloat(fields[0])*1000;
+            danmu->originTime=danmu->time;
+            danmu->setType(fieldCount>1?toInt(fields[1]):0);
+            switch (fieldCount>2?toInt(fields[2]):25)
+            {
+            case 18:
+                danmu->fontSizeLevel=DanmuComment::Small;
+                break;
+            case 36:
+                danmu->fontSizeLevel=DanmuComment::Large;
+                break;
+            default:
+                danmu->fontSizeLevel=DanmuComment::Normal;
+                break;
+            }
+            danmu->color=fieldCount>3?toInt(fields[3]):0xffffff;
+            danmu->date=fieldCount>4?toLongLong(fields[4]):0;
+            danmu->sender=format.senderPrefix;
+            if(format.senderId && fieldCount>6)
+                danmu->sender+=decodeText(fields[6].begin,fields[6].end,buf);
+            if(danmu->type!=DanmuComment::UNKNOW)danmuList.append(danmu);
+            else
+            {
+#ifdef QT_DEBUG
+                qDebug()<<"unsupport danmu mode:"<<danmu->text;
+#endif
+                delete danmu;
+            }
+        }
+    }
+
+    //codec of the document if it is not UTF-8, from the BOM or the xml declaration
+    QTextCodec *documentCodec(const char *begin, const char *end)
+    {
+        if(end-begin>=2 && ((uchar(begin[0])==0xff && uchar(begin[1])==0xfe) || (uchar(begin[0])==0xfe && uchar(begin[1])==0xff)))
+            return QTextCodec::codecForName("UTF-16");
+        if(!startsWith(begin,end,"<?xml",5)) return nullptr;
+        const char *declEnd=find(begin,end,"?>",2);
+        if(!declEnd) return nullptr;
+        const char *encoding=find(begin,declEnd,"encoding",8);
+        if(!encoding) return nullptr;
+        const char *quote=encoding+8;
+        while(quote<declEnd && *quote!='"' && *quote!='\'') ++quote;
+        if(quote>=declEnd) return nullptr;
+        const char *nameEnd=static_cast<const char *>(memchr(quote+1,*quote,declEnd-quote-1));
+        if(!nameEnd) return nullptr;
+        const QByteArray name(quote+1,int(nameEnd-quote-1));
+        if(name.compare("utf-8",Qt::CaseInsensitive)==0 || name.compare("utf8",Qt::CaseInsensitive)==0) return nullptr;
+        return QTextCodec::codecForName(name);
+    }
+}
+
+void XmlDanmuParser::parse(const QByteArray &data, QList<DanmuComment *> &danmuList, const Format &format)
+{
+    parse(data.constData(),data.constData()+data.size(),danmuList,format);
+}
+
+void XmlDanmuParser::parse(const char *begin, const char *end, QList<DanmuComment *> &danmuList, const Format &format)
+{
+    if(startsWith(begin,end,"\xef\xbb\xbf",3)) begin+=3;
+    QTextCodec *codec=documentCodec(begin,end);
+    if(codec)
+    {
+        const QByteArray utf8(codec->toUnicode(begin,int(end-begin)).toUtf8());
+        parseUtf8(utf8.constData(),utf8.constData()+utf8.size(),danmuList,format);
+        return;
+    }
+    parseUtf8(begin,end,danmuList,format);
+}
+
+bool XmlDanmuParser::parseFile(const QString &fileName, QList<DanmuComment *> &danmuList, const Format &format)
+{
+    QFile xmlFile(fileName);
+    if(!xmlFile.open(QIODevice::ReadOnly)) return false;
+#ifdef QT_DEBUG
+    QElapsedTimer timer;
+    timer.start();
+    const int oldCount=danmuList.count();
+#endif
+    const qint64 size=xmlFile.size();
+    const uchar *data=size>0?xmlFile.map(0,size):nullptr;
+    if(data)
+    {
+        const char *begin=reinterpret_cast<const char *>(data);
+        parse(begin,begin+size,danmuList,format);
+        xmlFile.unmap(const_cast<uchar *>(data));
+    }
+    else
+    {
+        parse(xmlFile.readAll(),danmuList,format);
+    }
+#ifdef QT_DEBUG
+    qDebug()<<"parse xml:"<<fileName<<size/1024<<"KB,"<<danmuList.count()-oldCount<<"comments,"<<timer.elapsed()<<"ms";
+#endif
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef XMLDANMUPARSER_H
+#define XMLDANMUPARSER_H
+#include <QtCore>
+class DanmuComment;
+/*
+ * Parser for the Bilibili style comment xml: <d p="time,mode,size,color,date,pool,sender,id">text</d>.
+ * It works on the raw UTF-8 bytes of a mapped file or a network reply: the p attribute is split in
+ * place, only the text and the sender become QStrings and entities are decoded while they are copied.
+ * Everything except the d elements is skipped, it is not a general xml parser.
+ * Documents in other encodings are converted to UTF-8 first.
+ */
+class XmlDanmuParser
+{
+public:
+    struct Format
+    {
+        int minFields;          //elements with fewer fields in p are skipped
+        QString senderPrefix;
+        bool senderId;          //append the sender field(7th) to senderPrefix
+    };
+    static void parse(const QByteArray &data, QList<DanmuComment *> &danmuList, const Format &format);
+    static void parse(const char *begin, const char *end, QList<DanmuComment *> &danmuList, const Format &format);
+    static bool parseFile(const QString &fileName, QList<DanmuComment *> &danmuList, const Format &format);
+};
+#endif // XMLDANMUPARSER_H
@@ -1,20 +1,133 @@
 #include "cacheworker.h"
-#include <QtConcurrent>
+#include "Common/hash64.h"
+#include <functional>
+#include <climits>
 #ifdef TEXTURE_MAIN_THREAD
 #include "globalobjects.h"
 #include "Play/Video/mpvplayer.h"
 #endif
 extern QOpenGLContext *danmuTextureContext;
 extern QSurface *surface;
+//GLES2 headers only have GL_UNPACK_ROW_LENGTH_EXT
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+namespace
+{
+    //free line right and below every item in the atlas
+    const int AtlasPadding=1;
+    //prefetch images in the raster pool at a time, they run after the due ones
+    const int PrefetchInFlight=4;
+    const int MaxPrefetchHeld=256;
+    const int MaxTextSizes=4096;
+    const int MaxRasterThreads=4;
+
+    //the text never changes after loading, it is hashed once on the cache thread
+    inline quint64 textHash(DanmuComment *comment)
+    {
+        if(comment->textHash==0)
+        {
+            const quint64 hash=Hash64::hash(comment->text.constData(),size_t(comment->text.size())*sizeof(QChar));
+            comment->textHash=hash?hash:1;
+        }
+        return comment->textHash;
+    }
+
+    struct SizedFont
+    {
+        explicit SizedFont(const QFont &font):font(font),metrics(font){}
+        QFont font;
+        QFontMetrics metrics;
+    };
+    //fonts of one raster thread, QFont and QFontMetrics are not created again for every image
+    struct RasterContext
+    {
+        RasterContext():styleVersion(-1){}
+        ~RasterContext(){qDeleteAll(fonts);}
+        int styleVersion;
+        QFont baseFont;
+        QHash<int,SizedFont *> fonts;
+        //(text hash, point size) -> point size after fitting the text into 2048px, text size
+        QHash<QPair<quint64,int>,QPair<int,QSize> > textSizes;
+
+        void reset(const QFont &font, int version)
+        {
+            qDeleteAll(fonts);
+            fonts.clear();
+            textSizes.clear();
+            baseFont=font;
+            styleVersion=version;
+        }
+        const SizedFont &sizedFont(int pointSize)
+        {
+            SizedFont *&sizedFont=fonts[pointSize];
+            if(!sizedFont)
+            {
+                QFont font(baseFont);
+                font.setPointSize(pointSize);
+                sizedFont=new SizedFont(font);
+            }
+            return *sizedFont;
+        }
+    };
+    QThreadStorage<RasterContext *> rasterContexts;
+
+    RasterContext &rasterContext(const QFont &baseFont, int version)
+    {
+        if(!rasterContexts.hasLocalData())
+            rasterContexts.setLocalData(new RasterContext);
+        RasterContext *context=rasterContexts.localData();
+        if(context->styleVersion!=version)
+            context->reset(baseFont,version);
+        return *context;
+    }
+
+    class RasterTask : public QRunnable
+    {
+    public:
+        explicit RasterTask(const std::function<void()> &func):func(func){}
+        void run() override {func();}
+    private:
+        std::function<void()> func;
+    };
+}
 
-CacheWorker::CacheWorker(const DanmuStyle *style):danmuStyle(style)
+CacheWorker::CacheWorker(const DanmuStyle *style):danmuStyle(style),cacheHits(0),cacheMisses(0),
+    uploadScheduled(false),styleVersion(0),prefetchInFlight(0),prefetchGeneration(0),rasterCostUs(0)
 {
+    //the threads keep their fonts
+    rasterPool.setExpiryTimeout(-1);
+    rasterPool.setMaxThreadCount(qBound(1,QThread::idealThreadCount()-1,MaxRasterThreads));
     danmuFont.setFamily(danmuStyle->fontFamily);
     danmuStrokePen.setWidthF(danmuStyle->strokeWidth);
     danmuStrokePen.setJoinStyle(Qt::RoundJoin);
     danmuStrokePen.setCapStyle(Qt::RoundCap);
 }
 
+CacheWorker::~CacheWorker()
+{
+    rasterPool.waitForDone();
+    for(RasterJob *job:inFlight)
+    {
+        delete job->info.img;
+        delete job->info.drawInfo;
+        delete job;
+    }
+    qDeleteAll(pendingBatches);
+}
+
+void CacheWorker::releaseUnused()
+{
+    danmuCache.removeIf([this](DanmuDrawInfo *drawInfo){
+        Q_ASSERT(drawInfo->useCount >= 0);
+        if(drawInfo->useCount>0) return false;
+        textureAtlas.release({drawInfo->atlasPage,drawInfo->texX,drawInfo->texY,
+                              drawInfo->width+AtlasPadding,drawInfo->height+AtlasPadding});
+        delete drawInfo;
+        return true;
+    });
+}
+
 void CacheWorker::cleanCache()
 {
 #ifdef QT_DEBUG
@@ -22,287 +135,409 @@ void CacheWorker::cleanCache()
     QElapsedTimer timer;
     timer.start();
 #endif
-    for(auto iter=danmuCache.begin();iter!=danmuCache.end();)
-    {
-        Q_ASSERT(iter.value()->useCount >= 0);
-        if(iter.value()->useCount==0)
-        {
-            --textureRef[iter.value()->texture];
-            delete iter.value();
-            iter=danmuCache.erase(iter);
-        }
-        else
-        {
-            ++iter;
-        }
-    }
+    releaseUnused();
 #ifdef TEXTURE_MAIN_THREAD
     QMetaObject::invokeMethod(GlobalObjects::mpvplayer,[this](){
 #endif
     danmuTextureContext->makeCurrent(surface);
-    QOpenGLFunctions *glFuns=danmuTextureContext->functions();
-    for(auto iter=textureRef.begin();iter!=textureRef.end();)
-    {
-        Q_ASSERT(iter.value()>= 0);
-        if(iter.value()==0)
-        {
-            glFuns->glDeleteTextures(1,&iter.key());
-            iter=textureRef.erase(iter);
-        }
-        else
-        {
-            ++iter;
-        }
-    }
+    syncPageTextures(danmuTextureContext->functions());
     danmuTextureContext->doneCurrent();
 #ifdef TEXTURE_MAIN_THREAD
     },Qt::BlockingQueuedConnection);
 #endif
 #ifdef QT_DEBUG
-    qDebug()<<"clean done:"<<timer.elapsed()<<"ms, left item:"<<danmuCache.size();
+    TextureAtlas::Stats stats(textureAtlas.stats());
+    qDebug()<<"clean done:"<<timer.elapsed()<<"ms, left item:"<<danmuCache.size()
+            <<"atlas pages:"<<stats.pages<<"occupancy:"<<stats.occupancy()<<"fragmentation:"<<stats.fragmentation();
 #endif
 }
 
-void CacheWorker::createImage(CacheMiddleInfo &midInfo)
+void CacheWorker::syncPageTextures(QOpenGLFunctions *glFuns)
+{
+    for(int page:textureAtlas.takeDroppedPages())
+    {
+        GLuint texture=pageTextures.take(page);
+        glFuns->glDeleteTextures(1,&texture);
+    }
+    const int pageSize=textureAtlas.pageSize();
+    for(int page:textureAtlas.takeNewPages())
+    {
+        GLuint texture;
+        glFuns->glGenTextures(1, &texture);
+        glFuns->glBindTexture(GL_TEXTURE_2D, texture);
+        glFuns->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pageSize, pageSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glFuns->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glFuns->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glFuns->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glFuns->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        pageTextures.insert(page,texture);
+    }
+}
+
+quint64 CacheWorker::cacheKey(DanmuComment *comment, int mergeCount) const
+{
+    const quint64 key[3]={textHash(comment),
+                          (quint64(quint32(comment->color))<<32)|quint32(danmuStyle->fontSizeTable[comment->fontSizeLevel]),
+                          quint64(mergeCount)};
+    return Hash64::hash(key,sizeof(key));
+}
+
+void CacheWorker::createImage(CacheMiddleInfo &midInfo, const QFont &baseFont, int version, bool useGlyphAtlas)
 {
     DanmuComment *comment=midInfo.comment;
-    QFont danmuFont(this->danmuFont);
+    RasterContext &context=rasterContext(baseFont,version);
+    int startPointSize;
     if(danmuStyle->randomSize)
     {
-        danmuFont.setPointSize(QRandomGenerator::global()->
-                               bounded(danmuStyle->fontSizeTable[DanmuComment::FontSizeLevel::Small],
-                               danmuStyle->fontSizeTable[DanmuComment::FontSizeLevel::Large]));
+        startPointSize=QRandomGenerator::global()->
+                bounded(danmuStyle->fontSizeTable[DanmuComment::FontSizeLevel::Small],
+                danmuStyle->fontSizeTable[DanmuComment::FontSizeLevel::Large]);
     }
-    else if(comment->mergedList && danmuStyle->enlargeMerged)
+    else if(midInfo.mergeCount>0 && danmuStyle->enlargeMerged)
     {
-        float enlargeRate(qBound(1.f,log2f(comment->mergedList->count()+1)/2,2.5f));
-        danmuFont.setPointSize(danmuStyle->fontSizeTable[DanmuComment::FontSizeLevel::Normal]*enlargeRate);
+        float enlargeRate(qBound(1.f,log2f(midInfo.mergeCount+1)/2,2.5f));
+        startPointSize=danmuStyle->fontSizeTable[DanmuComment::FontSizeLevel::Normal]*enlargeRate;
     }
     else
     {
-        danmuFont.setPointSize(danmuStyle->fontSizeTable[comment->fontSizeLevel]);
+        startPointSize=danmuStyle->fontSizeTable[comment->fontSizeLevel];
     }
-    QFontMetrics metrics(danmuFont);
     QPen danmuStrokePen;
     danmuStrokePen.setWidthF(danmuStyle->strokeWidth);
     int strokeWidth=danmuStyle->strokeWidth;
-    int left=qAbs(metrics.leftBearing(comment->text.front()));
+    int left=qAbs(context.sizedFont(startPointSize).metrics.leftBearing(comment->text.front()));
 
-    QSize textSize;
-    int pointSize=danmuFont.pointSize();
-    int minPointSize=pointSize/2;
     //If the width is greater than 2048, then adjust the font size
     //but the font size cannot be less than half of the previous point size
-    do
+    const QPair<quint64,int> sizeKey(midInfo.textHash,startPointSize);
+    auto sizeIter=context.textSizes.constFind(sizeKey);
+    if(sizeIter==context.textSizes.cend())
     {
-        danmuFont.setPointSize(pointSize--);
-        QFontMetrics tMetrice(danmuFont);
-        textSize = tMetrice.size(0, comment->text);
-        metrics.swap(tMetrice);
-    }while(textSize.width()>2048 && pointSize>minPointSize);
+        QSize textSize;
+        int pointSize=startPointSize, fittedPointSize;
+        int minPointSize=pointSize/2;
+        do
+        {
+            fittedPointSize=pointSize--;
+            textSize = context.sizedFont(fittedPointSize).metrics.size(0, comment->text);
+        }while(textSize.width()>2048 && pointSize>minPointSize);
+        if(context.textSizes.size()>=MaxTextSizes) context.textSizes.clear();
+        sizeIter=context.textSizes.insert(sizeKey,qMakePair(fittedPointSize,textSize));
+    }
+    const QSize textSize(sizeIter->second);
+    const SizedFont &sizedFont=context.sizedFont(sizeIter->first);
+    const QFont &danmuFont=sizedFont.font;
+    const QFontMetrics &metrics=sizedFont.metrics;
 
     QSize imgSize=textSize+QSize(strokeWidth*2+left,strokeWidth);
     int mergeCountWidth=0;
-    if(comment->mergedList && danmuStyle->mergeCountPos>0)
+    if(midInfo.mergeCount>0 && danmuStyle->mergeCountPos>0)
     {
-        QFont tmpFont(danmuFont);
-        tmpFont.setPointSize(tmpFont.pointSize()/2);
-        QFontMetrics metrics(tmpFont);
-        mergeCountWidth=metrics.size(0,QString("[%1]").arg(comment->mergedList->count())).width();
+        mergeCountWidth=context.sizedFont(danmuFont.pointSize()/2).metrics.
+                size(0,QString("[%1]").arg(midInfo.mergeCount)).width();
         imgSize.rwidth()+=mergeCountWidth;
     }
     if(imgSize.width()>2048)imgSize.rwidth()=2048;
     if(imgSize.height()>2048)imgSize.rheight()=2048;
 
-    DanmuDrawInfo *drawInfo=new DanmuDrawInfo;
-    drawInfo->useCount=0;
+    DanmuDrawInfo *drawInfo=midInfo.drawInfo;
     drawInfo->height=imgSize.height();
     drawInfo->width=imgSize.width();
     //drawInfo->img=img;
 
-    QPainterPath path;
+    QList<TextItem> textItems;
     QStringList multilines(comment->text.split('\n'));
     int py = qAbs((imgSize.height() - metrics.height()*multilines.size()) / 2 + metrics.ascent());
     int i=0;
     for(const QString &line:multilines)
     {
-        if(i==0 && danmuStyle->mergeCountPos==1 && comment->mergedList)
+        if(i==0 && danmuStyle->mergeCountPos==1 && midInfo.mergeCount>0)
         {
-            int sz=danmuFont.pointSize();
-            danmuFont.setPointSize(sz/2);
-            path.addText(left+strokeWidth,py,danmuFont,QString("[%1]").arg(comment->mergedList->count()));
-            danmuFont.setPointSize(sz);
-            path.addText(left+strokeWidth+mergeCountWidth,py,danmuFont,line);
+            const QFont &countFont=context.sizedFont(danmuFont.pointSize()/2).font;
+            textItems.append({QPointF(left+strokeWidth,py),countFont,QString("[%1]").arg(midInfo.mergeCount)});
+            textItems.append({QPointF(left+strokeWidth+mergeCountWidth,py),danmuFont,line});
         }
-        else if(i==multilines.count()-1 && danmuStyle->mergeCountPos==2 && comment->mergedList)
+        else if(i==multilines.count()-1 && danmuStyle->mergeCountPos==2 && midInfo.mergeCount>0)
         {
-            path.addText(left+strokeWidth,py+i*metrics.height(),danmuFont,line);
-            int sz=danmuFont.pointSize();
-            danmuFont.setPointSize(sz/2);
-            path.addText(left+strokeWidth+textSize.width(),py+i*metrics.height(),danmuFont,QString("[%1]").arg(comment->mergedList->count()));
-            danmuFont.setPointSize(sz);
+            textItems.append({QPointF(left+strokeWidth,py+i*metrics.height()),danmuFont,line});
+            const QFont &countFont=context.sizedFont(danmuFont.pointSize()/2).font;
+            textItems.append({QPointF(left+strokeWidth+textSize.width(),py+i*metrics.height()),countFont,QString("[%1]").arg(midInfo.mergeCount)});
         }
         else
         {
-            path.addText(left+strokeWidth,py+i*metrics.height(),danmuFont,line);
+            textItems.append({QPointF(left+strokeWidth,py+i*metrics.height()),danmuFont,line});
         }
         ++i;
     }
     QImage *img=new QImage(imgSize, QImage::Format_ARGB32);
     img->fill(Qt::transparent);
-    QPainter painter(img);
-    painter.setRenderHint(QPainter::Antialiasing);
     int r=(comment->color>>16)&0xff,g=(comment->color>>8)&0xff,b=comment->color&0xff;
-    if(strokeWidth>0)
+    if(useGlyphAtlas)
     {
-        danmuStrokePen.setColor(comment->color==0x000000?Qt::white:Qt::black);
-        painter.strokePath(path,danmuStrokePen);
-        painter.drawPath(path);
+        //a cache miss only costs a layout pass and glyph blending, glyphs are rasterized once
+        QVector<GlyphAtlas::GlyphQuad> quads;
+        glyphAtlas.setStrokeWidth(strokeWidth>0?danmuStyle->strokeWidth:0);
+        for(int pass=0;pass<2;++pass)
+        {
+            bool full=false;
+            for(const TextItem &item:textItems)
+            {
+                if(!glyphAtlas.layoutText(item.pos,item.font,item.text,quads))
+                {
+                    full=true;
+                    break;
+                }
+            }
+            if(!full) break;
+            glyphAtlas.clear();
+            quads.clear();
+        }
+        glyphAtlas.compose(*img,quads,qRgb(r,g,b),comment->color==0x000000?qRgb(255,255,255):qRgb(0,0,0));
+    }
+    else
+    {
+        QPainterPath path;
+        for(const TextItem &item:textItems)
+            path.addText(item.pos,item.font,item.text);
+        QPainter painter(img);
+        painter.setRenderHint(QPainter::Antialiasing);
+        if(strokeWidth>0)
+        {
+            danmuStrokePen.setColor(comment->color==0x000000?Qt::white:Qt::black);
+            painter.strokePath(path,danmuStrokePen);
+            painter.drawPath(path);
+        }
+        painter.fillPath(path,QBrush(QColor(r,g,b)));
+        painter.end();
     }
-    painter.fillPath(path,QBrush(QColor(r,g,b)));
-    painter.end();
 
     midInfo.img=img;
-    midInfo.drawInfo=drawInfo;
 }
 
 void CacheWorker::createTexture(QList<CacheMiddleInfo> &midInfo)
 {
-    int textureWidth=0,textureHeight;
     for(auto &mInfo:midInfo)
     {
-        if(mInfo.drawInfo->width>textureWidth) textureWidth=mInfo.drawInfo->width;
-    }
-    for(int i=1;i<12;++i)
-    {
-        if(textureWidth<(1<<i))
+        DanmuDrawInfo *drawInfo=mInfo.drawInfo;
+        const int width=qMin(drawInfo->width+AtlasPadding,textureAtlas.pageSize());
+        const int height=qMin(drawInfo->height+AtlasPadding,textureAtlas.pageSize());
+        TextureAtlas::Region region;
+        //give the unused items back before going over the page limit
+        if(!textureAtlas.allocate(width,height,region,false))
         {
-            textureWidth=(1<<i);
-            break;
+            releaseUnused();
+            bool ret=textureAtlas.allocate(width,height,region,true);
+            Q_ASSERT(ret);
+            Q_UNUSED(ret)
         }
+        drawInfo->width=region.width-AtlasPadding;
+        drawInfo->height=region.height-AtlasPadding;
+        drawInfo->atlasPage=region.page;
+        drawInfo->texX=region.x;
+        drawInfo->texY=region.y;
     }
-    if(textureWidth>2048) textureWidth=2048;
-    int x=0,y=0,rowHeight=0;
+#ifdef TEXTURE_MAIN_THREAD
+    QMetaObject::invokeMethod(GlobalObjects::mpvplayer,[this,&midInfo](){
+#endif
+    danmuTextureContext->makeCurrent(surface);
+    QOpenGLFunctions *glFuns=danmuTextureContext->functions();
+    syncPageTextures(glFuns);
+    const GLfloat pageSize=textureAtlas.pageSize();
+    //transparent line for the padding right and below every item, keeps linear filtering inside the item
+    const QByteArray blank(textureAtlas.pageSize()*4,'\0');
+    //GLES2(e.g. ANGLE) has no row length without GL_EXT_unpack_subimage, images wider than the item are copied
+    const bool hasRowLength=!danmuTextureContext->isOpenGLES() || danmuTextureContext->format().majorVersion()>=3 ||
+            danmuTextureContext->hasExtension(QByteArrayLiteral("GL_EXT_unpack_subimage"));
+    glFuns->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLuint boundTexture=0;
     for(auto &mInfo:midInfo)
     {
-        if(textureWidth-x>mInfo.drawInfo->width)
+        DanmuDrawInfo *drawInfo=mInfo.drawInfo;
+        drawInfo->texture=pageTextures.value(drawInfo->atlasPage);
+        if(drawInfo->texture!=boundTexture)
         {
-            mInfo.texX=x;
-            mInfo.texY=y;
-            x+=mInfo.drawInfo->width;
-            if(mInfo.drawInfo->height>rowHeight) rowHeight=mInfo.drawInfo->height;
+            glFuns->glBindTexture(GL_TEXTURE_2D, drawInfo->texture);
+            boundTexture=drawInfo->texture;
         }
-        else
+        if(mInfo.img->bytesPerLine()==drawInfo->width*4)
         {
-            x=0;
-            y+=rowHeight;
-            rowHeight=mInfo.drawInfo->height;
-            mInfo.texX=x;
-            mInfo.texY=y;
-			x += mInfo.drawInfo->width;
+            glFuns->glTexSubImage2D(GL_TEXTURE_2D,0,drawInfo->texX,drawInfo->texY,drawInfo->width
+                                    ,drawInfo->height,GL_RGBA,GL_UNSIGNED_BYTE,mInfo.img->constBits());
         }
-    }
-    textureHeight=y+rowHeight;
-    for(int i=1;i<12;++i)
-    {
-        if(textureHeight<(1<<i))
+        else if(hasRowLength)
         {
-            textureHeight=(1<<i);
-            break;
+            glFuns->glPixelStorei(GL_UNPACK_ROW_LENGTH, mInfo.img->bytesPerLine()/4);
+            glFuns->glTexSubImage2D(GL_TEXTURE_2D,0,drawInfo->texX,drawInfo->texY,drawInfo->width
+                                    ,drawInfo->height,GL_RGBA,GL_UNSIGNED_BYTE,mInfo.img->constBits());
+            glFuns->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
         }
-    }
-    if(textureHeight>2048) textureHeight=2048;
-#ifdef TEXTURE_MAIN_THREAD
-    QMetaObject::invokeMethod(GlobalObjects::mpvplayer,[this,&midInfo,textureWidth,textureHeight](){
-#endif
-    danmuTextureContext->makeCurrent(surface);
-    QOpenGLFunctions *glFuns=danmuTextureContext->functions();
-    GLuint texture;
-    glFuns->glGenTextures(1, &texture);
-    glFuns->glBindTexture(GL_TEXTURE_2D, texture);
-    glFuns->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glFuns->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, textureWidth, textureHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    textureRef.insert(texture,midInfo.size());
-
-    for(auto &mInfo:midInfo)
-    {
-        mInfo.drawInfo->texture=texture;
-        glFuns->glTexSubImage2D(GL_TEXTURE_2D,0,mInfo.texX,mInfo.texY,mInfo.drawInfo->width
-                                ,mInfo.drawInfo->height,GL_RGBA,GL_UNSIGNED_BYTE,mInfo.img->bits());
-        mInfo.drawInfo->l=((GLfloat)mInfo.texX)/textureWidth;
-        mInfo.drawInfo->r=((GLfloat)mInfo.texX+mInfo.drawInfo->width)/textureWidth;
-        if(mInfo.drawInfo->r>1)mInfo.drawInfo->r=1;
-        mInfo.drawInfo->t=((GLfloat)mInfo.texY)/textureHeight;
-        mInfo.drawInfo->b=((GLfloat)mInfo.texY+mInfo.drawInfo->height)/textureHeight;
-        if(mInfo.drawInfo->b>1)mInfo.drawInfo->b=1;
+        else
+        {
+            //32 bit pixels, the lines of the copy are tightly packed
+            const QImage packed(mInfo.img->copy(0,0,drawInfo->width,drawInfo->height));
+            glFuns->glTexSubImage2D(GL_TEXTURE_2D,0,drawInfo->texX,drawInfo->texY,drawInfo->width
+                                    ,drawInfo->height,GL_RGBA,GL_UNSIGNED_BYTE,packed.constBits());
+        }
+        if(drawInfo->texX+drawInfo->width<textureAtlas.pageSize())
+            glFuns->glTexSubImage2D(GL_TEXTURE_2D,0,drawInfo->texX+drawInfo->width,drawInfo->texY,1
+                                    ,drawInfo->height,GL_RGBA,GL_UNSIGNED_BYTE,blank.constData());
+        if(drawInfo->texY+drawInfo->height<textureAtlas.pageSize())
+            glFuns->glTexSubImage2D(GL_TEXTURE_2D,0,drawInfo->texX,drawInfo->texY+drawInfo->height,drawInfo->width
+                                    ,1,GL_RGBA,GL_UNSIGNED_BYTE,blank.constData());
+        drawInfo->l=drawInfo->texX/pageSize;
+        drawInfo->r=(drawInfo->texX+drawInfo->width)/pageSize;
+        drawInfo->t=drawInfo->texY/pageSize;
+        drawInfo->b=(drawInfo->texY+drawInfo->height)/pageSize;
         delete mInfo.img;
     }
     glFuns->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-    glFuns->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glFuns->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFuns->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glFuns->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     danmuTextureContext->doneCurrent();
 #ifdef TEXTURE_MAIN_THREAD
     },Qt::BlockingQueuedConnection);
 #endif
 }
 
-void CacheWorker::beginCache(PrepareList *danmus)
+CacheWorker::RasterJob *CacheWorker::startJob(const QSharedPointer<DanmuComment> &comment, quint64 hash, int mergeCount, bool prefetch)
 {
-#ifdef QT_DEBUG
-    qDebug()<<"cache start---";
-    QElapsedTimer timer;
-    timer.start();
-    qint64 etime=0;
-#endif
-    QStringList hashList;
-    QSet<QString> tmpHash;
+    RasterJob *job=new RasterJob;
+    job->info.hash=hash;
+    job->info.comment=comment.data();
+    job->info.mergeCount=mergeCount;
+    job->info.textHash=textHash(comment.data());
+    //created here instead of createImage, the draw info pool belongs to this thread
+    job->info.drawInfo=new DanmuDrawInfo;
+    job->info.drawInfo->useCount=0;
+    job->info.img=nullptr;
+    job->comment=comment;
+    job->font=danmuFont;
+    job->styleVersion=styleVersion;
+    job->refs=0;
+    job->prefetch=prefetch;
+    job->holdTime=0;
+    job->holdGeneration=-1;
+    job->costNs=0;
+    inFlight.insert(hash,job);
+    if(prefetch) ++prefetchInFlight;
+    if(danmuStyle->glyphAtlas)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        createImage(job->info,job->font,job->styleVersion,true);
+        job->costNs=timer.nsecsElapsed();
+        jobDone(job);
+    }
+    else
+    {
+        rasterPool.start(new RasterTask([this,job](){
+            QElapsedTimer timer;
+            timer.start();
+            createImage(job->info,job->font,job->styleVersion,false);
+            job->costNs=timer.nsecsElapsed();
+            QMetaObject::invokeMethod(this,[this,job](){
+                jobDone(job);
+            },Qt::QueuedConnection);
+        }),prefetch?0:1);
+    }
+    return job;
+}
+
+void CacheWorker::jobDone(RasterJob *job)
+{
+    readyJobs.append(job);
+    //images finished close together go up in one upload
+    if(!uploadScheduled)
+    {
+        uploadScheduled=true;
+        QMetaObject::invokeMethod(this,&CacheWorker::uploadReady,Qt::QueuedConnection);
+    }
+}
+
+void CacheWorker::uploadReady()
+{
+    uploadScheduled=false;
+    if(readyJobs.isEmpty()) return;
     QList<CacheMiddleInfo> mInfoList;
-    for(QPair<QSharedPointer<DanmuComment>,DanmuDrawInfo*> &dm:*danmus)
+    for(RasterJob *job:readyJobs)
+        mInfoList.append(job->info);
+    createTexture(mInfoList);
+    int lastCost=rasterCostUs.loadAcquire();
+    for(RasterJob *job:readyJobs)
     {
-        QString hash_str(QCryptographicHash::hash(QString("%1%2%3%4")
-                         .arg(dm.first->text
-                              ,QString::number(dm.first->color)
-                              ,QString::number(danmuStyle->fontSizeTable[dm.first->fontSizeLevel])
-                         ,dm.first->mergedList?QString::number(dm.first->mergedList->count()):"0").toUtf8()
-                         ,QCryptographicHash::Md5).toHex());
-        hashList<<hash_str;
-        if(!danmuCache.contains(hash_str) && !tmpHash.contains(hash_str))
-        {
-            CacheMiddleInfo mInfo;
-            mInfo.hash=hash_str;
-            mInfo.comment=dm.first.data();
-            mInfoList.append(mInfo);
-            tmpHash.insert(hash_str);
-        }
+        DanmuDrawInfo *drawInfo=job->info.drawInfo;
+        Q_ASSERT(!danmuCache.value(job->info.hash));
+        danmuCache.insert(job->info.hash, drawInfo);
+        inFlight.remove(job->info.hash);
+        //the danmu of the waiting batches already point to it
+        drawInfo->useCount+=job->refs;
+        if(job->holdGeneration==prefetchGeneration)
+            holdPrefetched(job->holdTime,drawInfo);
+        if(job->prefetch) --prefetchInFlight;
+        for(PendingBatch *batch:job->batches)
+            --batch->waiting;
+        //moving average, the pool sizes its look-ahead with it
+        const int cost=qMax<qint64>(1,job->costNs/1000);
+        lastCost=lastCost==0?cost:lastCost+(cost-lastCost)/8;
+        delete job;
     }
-	if (!mInfoList.isEmpty())
-	{
-		QtConcurrent::blockingMap(mInfoList, std::bind(&CacheWorker::createImage, this, std::placeholders::_1));
-		createTexture(mInfoList);
-		for (auto &mInfo : mInfoList)
-		{
-			Q_ASSERT(!danmuCache.contains(mInfo.hash));
-			danmuCache.insert(mInfo.hash, mInfo.drawInfo);
-		}
-	}
-    int i=0;
+    rasterCostUs.storeRelease(lastCost);
+    readyJobs.clear();
+    flushBatches();
+    processPrefetch();
+}
+
+void CacheWorker::flushBatches()
+{
+    while(!pendingBatches.isEmpty() && pendingBatches.head()->waiting==0)
+    {
+        PendingBatch *batch=pendingBatches.dequeue();
+        //the comments before this batch have taken their items, the rest may come in the next one
+        releasePrefetched(batch->dueTime);
+        emit cacheDone(batch->danmus);
+        delete batch;
+    }
+}
+
+void CacheWorker::beginCache(PrepareList *danmus)
+{
+    PendingBatch *batch=new PendingBatch{danmus,0,INT_MIN};
     for(QPair<QSharedPointer<DanmuComment>,DanmuDrawInfo*> &dm:*danmus)
     {
-         DanmuDrawInfo *drawInfo(danmuCache.value(hashList[i++],nullptr));
-         Q_ASSERT(drawInfo);
-         drawInfo->useCount++;
-         dm.second=drawInfo;
+        const int mergeCount=dm.first->mergedList?dm.first->mergedList->count():0;
+        const quint64 hash=cacheKey(dm.first.data(),mergeCount);
+        batch->dueTime=qMax(batch->dueTime,dm.first->time);
+        //hold the hit items now, uploading the new ones may give unused items back to the atlas
+        DanmuDrawInfo *drawInfo(danmuCache.value(hash));
+        if(drawInfo)
+        {
+            drawInfo->useCount++;
+            dm.second=drawInfo;
+            ++cacheHits;
+            continue;
+        }
+        RasterJob *job=inFlight.value(hash);
+        if(job)
+        {
+            ++cacheHits;
+        }
+        else
+        {
+            ++cacheMisses;
+            job=startJob(dm.first,hash,mergeCount,false);
+        }
+        //counted in useCount when it is uploaded
+        ++job->refs;
+        dm.second=job->info.drawInfo;
+        if(!job->batches.contains(batch))
+        {
+            job->batches.append(batch);
+            ++batch->waiting;
+        }
     }
-#ifdef QT_DEBUG
-    etime=timer.elapsed();
-    qDebug()<<"cache end, time: "<<etime<<"ms";
-#endif
-    emit cacheDone(danmus);
+    pendingBatches.enqueue(batch);
+    flushBatches();
 }
 
-void CacheWorker::changeRefCount(QList<DanmuDrawInfo *> *descList)
+void CacheWorker::changeRefCount(QVector<DanmuDrawInfo *> *descList)
 {
     for(DanmuDrawInfo *drawInfo:*descList)
     {
@@ -316,6 +551,67 @@ void CacheWorker::changeRefCount(QList<DanmuDrawInfo *> *descList)
 
 void CacheWorker::changeDanmuStyle()
 {
+    glyphAtlas.clear();
+    //raster threads pick up the new font with their next image
+    ++styleVersion;
     danmuFont.setFamily(danmuStyle->fontFamily);
     danmuFont.setBold(danmuStyle->bold);
 }
+
+void CacheWorker::prefetch(const QList<QSharedPointer<DanmuComment> > &danmus)
+{
+    for(const auto &danmu:danmus)
+        prefetchQueue.enqueue(danmu);
+    processPrefetch();
+}
+
+void CacheWorker::dropPrefetched()
+{
+    prefetchQueue.clear();
+    //images still in flight are not held when they come back
+    ++prefetchGeneration;
+    releasePrefetched(INT_MAX);
+}
+
+void CacheWorker::processPrefetch()
+{
+    while(!prefetchQueue.isEmpty() && prefetchInFlight<PrefetchInFlight &&
+          prefetchHeld.size()+prefetchInFlight<MaxPrefetchHeld)
+    {
+        QSharedPointer<DanmuComment> danmu(prefetchQueue.dequeue());
+        const int mergeCount=danmu->mergedList?danmu->mergedList->count():0;
+        const quint64 hash=cacheKey(danmu.data(),mergeCount);
+        DanmuDrawInfo *drawInfo(danmuCache.value(hash));
+        if(drawInfo)
+        {
+            holdPrefetched(danmu->time,drawInfo);
+            continue;
+        }
+        RasterJob *job=inFlight.value(hash);
+        if(!job) job=startJob(danmu,hash,mergeCount,true);
+        if(job->holdGeneration!=prefetchGeneration)
+        {
+            job->holdTime=danmu->time;
+            job->holdGeneration=prefetchGeneration;
+        }
+    }
+}
+
+void CacheWorker::holdPrefetched(int time, DanmuDrawInfo *drawInfo)
+{
+    drawInfo->useCount++;
+    prefetchHeld.insert(time,drawInfo);
+}
+
+void CacheWorker::releasePrefetched(int dueTime)
+{
+    while(!prefetchHeld.isEmpty() && prefetchHeld.firstKey()<dueTime)
+    {
+        prefetchHeld.first()->useCount--;
+        prefetchHeld.erase(prefetchHeld.begin());
+    }
+    while(!prefetchQueue.isEmpty() && prefetchQueue.head()->time<dueTime)
+        prefetchQueue.dequeue();
+    //it stopped at the hold limit
+    processPrefetch();
+}
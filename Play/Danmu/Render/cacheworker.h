@@ -2,6 +2,9 @@
 #define CACHEWORKER_H
 #include <QtCore>
 #include "../common.h"
+#include "glyphatlas.h"
+#include "textureatlas.h"
+#include "drawinfotable.h"
 struct DanmuStyle
 {
     int *fontSizeTable;
@@ -11,37 +14,105 @@ struct DanmuStyle
     bool randomSize;
     int mergeCountPos;
     bool enlargeMerged;
+    bool glyphAtlas;
+};
+struct TextItem
+{
+    QPointF pos;
+    QFont font;
+    QString text;
 };
 struct CacheMiddleInfo
 {
-    QString hash;
+    quint64 hash;
     DanmuComment *comment;
     DanmuDrawInfo *drawInfo;
     QImage *img;
-    int texX,texY;
+    //taken in the cache thread when the job starts, mergedList is not read in the raster threads
+    int mergeCount;
+    quint64 textHash;   //key of the measured text sizes
 };
 
+/*
+ * Makes the images of the danmu and packs them into the texture atlas, lives in the cache thread.
+ * Images are rasterized on rasterPool, each thread keeps its own fonts, metrics and measured text
+ * sizes. The cache thread only dispatches and uploads, a batch is sent back(cacheDone, in the
+ * order they came) when its last image is uploaded, it never waits for the slowest one.
+ * With the glyph atlas the images are made in the cache thread, the atlas is not shared.
+ */
 class CacheWorker : public QObject
 {
     Q_OBJECT
 public:
     explicit CacheWorker(const DanmuStyle *style);
+    ~CacheWorker();
+    //read them only when no batch is in flight
+    inline qint64 hitCount() const {return cacheHits;}
+    inline qint64 missCount() const {return cacheMisses;}
+    //us spent on one new image(averaged), read from any thread, 0 before the first one
+    inline int rasterCost() const {return rasterCostUs.loadAcquire();}
 private:
     const int max_cache=512;
-    QHash<QString,DanmuDrawInfo *> danmuCache;
-    QHash<GLuint,int> textureRef;
+    DrawInfoTable danmuCache;
+    TextureAtlas textureAtlas;
+    QHash<int,GLuint> pageTextures;
     const DanmuStyle *danmuStyle;
     QFont danmuFont;
     QPen danmuStrokePen;
+    GlyphAtlas glyphAtlas;
+    qint64 cacheHits, cacheMisses;
+    struct PendingBatch
+    {
+        PrepareList *danmus;
+        int waiting;    //images not uploaded yet
+        int dueTime;    //latest comment time
+    };
+    struct RasterJob
+    {
+        CacheMiddleInfo info;
+        QSharedPointer<DanmuComment> comment;   //keeps info.comment alive
+        QFont font;                             //family and bold when it started
+        int styleVersion;
+        int refs;                               //danmu of the batches waiting for it
+        QList<PendingBatch *> batches;
+        bool prefetch;
+        int holdTime, holdGeneration;           //held for the prefetch while the generation is current
+        qint64 costNs;
+    };
+    QThreadPool rasterPool;
+    QHash<quint64,RasterJob *> inFlight;
+    QList<RasterJob *> readyJobs;
+    bool uploadScheduled;
+    QQueue<PendingBatch *> pendingBatches;
+    int styleVersion;
+    QQueue<QSharedPointer<DanmuComment> > prefetchQueue;
+    //items prefetched for comments not due yet by time, each one holds a use count
+    QMultiMap<int,DanmuDrawInfo *> prefetchHeld;
+    int prefetchInFlight, prefetchGeneration;
+    QAtomicInt rasterCostUs;
+    quint64 cacheKey(DanmuComment *comment, int mergeCount) const;
+    void releaseUnused();
     void cleanCache();
-    void createImage(CacheMiddleInfo &midInfo);
+    void syncPageTextures(QOpenGLFunctions *glFuns);
+    //useGlyphAtlas: only in the cache thread
+    void createImage(CacheMiddleInfo &midInfo, const QFont &baseFont, int version, bool useGlyphAtlas);
     void createTexture(QList<CacheMiddleInfo> &midInfo);
+    RasterJob *startJob(const QSharedPointer<DanmuComment> &comment, quint64 hash, int mergeCount, bool prefetch);
+    void jobDone(RasterJob *job);
+    void uploadReady();
+    void flushBatches();
+    void processPrefetch();
+    void holdPrefetched(int time, DanmuDrawInfo *drawInfo);
+    void releasePrefetched(int dueTime);
 signals:
     void cacheDone(PrepareList *danmus);
-    void recyleRefList(QList<DanmuDrawInfo *> *descList);
+    void recyleRefList(QVector<DanmuDrawInfo *> *descList);
 public slots:
     void beginCache(PrepareList *danmus);
-    void changeRefCount(QList<DanmuDrawInfo *> *descList);
+    void changeRefCount(QVector<DanmuDrawInfo *> *descList);
     void changeDanmuStyle();
+    //comments due soon, rasterized a few at a time when no due batch is waiting
+    void prefetch(const QList<QSharedPointer<DanmuComment> > &danmus);
+    void dropPrefetched();
 };
 #endif // CACHEWORKER_H
@@ -0,0 +1,51 @@
+#include "danmubatch.h"
+#include "../common.h"
+
+DanmuBatchBuilder::DanmuBatchBuilder():lastFrame{0,0,0}
+{
+
+}
+
+void DanmuBatchBuilder::build(const QVector<DanmuInstance> &objList, int viewWidth, int viewHeight, float alpha)
+{
+    batchList.clear();
+    //count the danmu of every texture first, the pages are few so a linear search is enough
+    for(const DanmuInstance &obj:objList)
+    {
+        const GLuint texture=obj.drawInfo->texture;
+        int b=0;
+        while(b<batchList.size() && batchList.at(b).texture!=texture) ++b;
+        if(b==batchList.size()) batchList.append({texture,0,0});
+        batchList[b].count+=VerticesPerDanmu;
+    }
+    batchOffset.resize(batchList.size());
+    int first=0;
+    for(int b=0;b<batchList.size();++b)
+    {
+        batchList[b].first=first;
+        batchOffset[b]=first;
+        first+=batchList.at(b).count;
+    }
+    //resize keeps the capacity, the array is reused every frame
+    vertexData.resize(first);
+
+    const GLfloat h=2.f/viewWidth, v=2.f/viewHeight;
+    Vertex *vtx=vertexData.data();
+    for(const DanmuInstance &obj:objList)
+    {
+        const DanmuDrawInfo *drawInfo=obj.drawInfo;
+        int b=0;
+        while(batchList.at(b).texture!=drawInfo->texture) ++b;
+        Vertex *q=vtx+batchOffset[b];
+        batchOffset[b]+=VerticesPerDanmu;
+
+        const GLfloat l=obj.x*h-1, r=(obj.x+drawInfo->width)*h-1,
+                      t=1-obj.y*v, bm=1-(obj.y+drawInfo->height)*v;
+        q[0]={l,t,drawInfo->l,drawInfo->t,alpha};
+        q[1]={r,t,drawInfo->r,drawInfo->t,alpha};
+        q[2]={l,bm,drawInfo->l,drawInfo->b,alpha};
+        q[3]={r,t,drawInfo->r,drawInfo->t,alpha};
+        q[4]={l,bm,drawInfo->l,drawInfo->b,alpha};
+        q[5]={r,bm,drawInfo->r,drawInfo->b,alpha};
+    }
+}
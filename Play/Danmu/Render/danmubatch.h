@@ -0,0 +1,47 @@
+#ifndef DANMUBATCH_H
+#define DANMUBATCH_H
+#include <QtCore>
+#include <QtGui/qopengl.h>
+struct DanmuInstance;
+/*
+ * CPU side of the danmu draw, no GL calls here.
+ * Turns the visible danmu of a frame into one vertex array grouped by texture page,
+ * so the player uploads it into its stream buffer once and draws each page once.
+ */
+class DanmuBatchBuilder
+{
+public:
+    struct Vertex
+    {
+        GLfloat x, y;   //clip space
+        GLfloat u, v;
+        GLfloat alpha;
+    };
+    struct Batch
+    {
+        GLuint texture;
+        int first;      //first vertex
+        int count;      //vertex count
+    };
+    struct FrameStats
+    {
+        int danmus;
+        int drawCalls;
+        qint64 uploadBytes;
+    };
+    static const int VerticesPerDanmu=6;
+
+    DanmuBatchBuilder();
+    void build(const QVector<DanmuInstance> &objList, int viewWidth, int viewHeight, float alpha);
+    inline const QVector<Vertex> &vertices() const {return vertexData;}
+    inline const QVector<Batch> &batches() const {return batchList;}
+    inline qint64 vertexBytes() const {return qint64(vertexData.size())*sizeof(Vertex);}
+
+    //filled in by the owner after drawing
+    FrameStats lastFrame;
+private:
+    QVector<Vertex> vertexData;
+    QVector<Batch> batchList;
+    QVector<int> batchOffset;
+};
+#endif // DANMUBATCH_H
@@ -0,0 +1,227 @@
+#include "danmubenchmark.h"
+#include <QOffscreenSurface>
+#include <QRandomGenerator>
+#include <cmath>
+#include "globalobjects.h"
+#include "danmurender.h"
+#include "danmubatch.h"
+#include "Play/Danmu/danmupool.h"
+#include "Play/Danmu/Manager/pool.h"
+#include "Play/Video/framepacer.h"
+
+namespace
+{
+    const int MaxTextLength=80;
+}
+
+DanmuBenchmark::Config DanmuBenchmark::Config::fromArguments(const QStringList &args)
+{
+    Config config{20,300,12,0.1,{60,144},1920,1080,1};
+    for(const QString &arg:args)
+    {
+        int eqPos=arg.indexOf('=');
+        if(eqPos==-1) continue;
+        const QString key(arg.left(eqPos)), val(arg.mid(eqPos+1));
+        if(key=="density") config.density=qMax(1,val.toInt());
+        else if(key=="seconds") config.seconds=qMax(1,val.toInt());
+        else if(key=="textlen") config.textLength=qBound(1,val.toInt(),MaxTextLength);
+        else if(key=="merge") config.mergeRatio=qBound(0.0,val.toDouble(),1.0);
+        else if(key=="width") config.width=qMax(1,val.toInt());
+        else if(key=="height") config.height=qMax(1,val.toInt());
+        else if(key=="seed") config.seed=val.toUInt();
+        else if(key=="rates")
+        {
+            config.rates.clear();
+            for(const QString &rate:val.split(':',QString::SkipEmptyParts))
+            {
+                if(rate.toInt()>0) config.rates.append(rate.toInt());
+            }
+        }
+    }
+    if(config.rates.isEmpty()) config.rates<<60;
+    return config;
+}
+
+DanmuBenchmark::DanmuBenchmark(const Config &config):config(config)
+{
+
+}
+
+int DanmuBenchmark::run()
+{
+    QTextStream out(stdout);
+    QOffscreenSurface offscreenSurface;
+    offscreenSurface.create();
+    DanmuRender *render=GlobalObjects::danmuRender;
+    render->initTextureContext(&offscreenSurface,nullptr);
+    render->offscreen=true;
+    render->surfaceRect.setRect(0,0,config.width,config.height);
+
+    QElapsedTimer timer;
+    timer.start();
+    Pool *pool=createPool();
+    const qint64 createTime=timer.restart();
+    DanmuPool *danmuPool=GlobalObjects::danmuPool;
+    danmuPool->setConnect(pool);
+    //merged on the pool thread
+    while(danmuPool->taskRunning || danmuPool->hasPendingTask)
+        QCoreApplication::processEvents(QEventLoop::AllEvents,10);
+    out<<QString("pool: %1 comments, %2 after merge, created in %3ms, merged in %4ms")
+         .arg(danmuPool->totalCount()).arg(danmuPool->finalPool.count()).arg(createTime).arg(timer.elapsed())<<endl;
+    out<<QString("view: %1x%2, density: %3/s, mean text length: %4, merge ratio: %5")
+         .arg(config.width).arg(config.height).arg(config.density).arg(config.textLength).arg(config.mergeRatio)<<endl;
+
+    for(int rate:config.rates)
+        printResult(runRate(rate));
+
+    render->cleanup();
+    waitCache();
+    danmuPool->setConnect(danmuPool->emptyPool);
+    delete pool;
+    return 0;
+}
+
+Pool *DanmuBenchmark::createPool()
+{
+    static const int colors[]={0xfe0302,0xff7204,0xffaa02,0xffd302,0x00cd00,0x4266be,0x89d5ff,0xcc0273};
+    QRandomGenerator rand(config.seed);
+    QList<DanmuComment *> danmuList;
+    QStringList recentTexts;
+    const int total=config.density*config.seconds;
+    for(int i=0;i<total;++i)
+    {
+        DanmuComment *danmu=new DanmuComment;
+        //times stay sorted, so a repeated text lands close to the one it repeats
+        danmu->time=danmu->originTime=int((i+rand.generateDouble())*1000/config.density);
+        danmu->date=0;
+        if(!recentTexts.isEmpty() && rand.generateDouble()<config.mergeRatio)
+        {
+            danmu->text=recentTexts.at(rand.bounded(recentTexts.count()));
+        }
+        else
+        {
+            //exponential length distribution around the mean
+            int length=1+int(-std::log(1-rand.generateDouble())*(config.textLength-1));
+            length=qMin(length,MaxTextLength);
+            danmu->text.reserve(length);
+            for(int c=0;c<length;++c)
+            {
+                if(rand.bounded(10)<7)
+                    danmu->text.append(QChar(0x4e00+rand.bounded(3000)));
+                else
+                    danmu->text.append(QChar('a'+rand.bounded(26)));
+            }
+            recentTexts.append(danmu->text);
+            if(recentTexts.count()>16) recentTexts.removeFirst();
+        }
+        danmu->sender=QString::number(rand.bounded(5000));
+        danmu->color=rand.bounded(4)==0?colors[rand.bounded(8)]:0xffffff;
+        int typeVal=rand.bounded(20);
+        danmu->setType(typeVal<17?1:(typeVal<19?5:4));
+        int sizeVal=rand.bounded(20);
+        danmu->fontSizeLevel=sizeVal<17?DanmuComment::Normal:(sizeVal<19?DanmuComment::Small:DanmuComment::Large);
+        danmuList.append(danmu);
+    }
+    DanmuSourceInfo sourceInfo;
+    sourceInfo.id=0;
+    sourceInfo.delay=0;
+    sourceInfo.count=0;
+    sourceInfo.show=true;
+    sourceInfo.name="Benchmark";
+    sourceInfo.url="kikoplay:benchmark";
+    //no pool id, nothing is written to the database
+    Pool *pool=new Pool(QString(),"Benchmark","");
+    pool->addSource(sourceInfo,danmuList);
+    return pool;
+}
+
+DanmuBenchmark::Result DanmuBenchmark::runRate(int rate)
+{
+    DanmuRender *render=GlobalObjects::danmuRender;
+    DanmuPool *danmuPool=GlobalObjects::danmuPool;
+    render->cleanup();
+    waitCache();
+    danmuPool->reset();
+
+    const qint64 hitsStart=render->cacheWorker->hitCount(), missesStart=render->cacheWorker->missCount();
+    const AllocationStats objStart(DanmuObject::allocationStats()), drawInfoStart(DanmuDrawInfo::allocationStats());
+    const int prepareListStart=danmuPool->prepareListAllocCount(), refListStart=render->drListAllocCount;
+
+    const float interval=1000.f/rate;
+    const int frames=config.seconds*rate;
+    QVector<qint64> costs;
+    costs.reserve(frames);
+    DanmuBatchBuilder batchBuilder;
+    //paced like MPVPlayer::swapped, with mpv reporting the playback time on every frame
+    FramePacer pacer;
+    QElapsedTimer timer;
+    qint64 waitTime=0;
+    int maxOnScreen=0;
+    for(int f=1;f<=frames;++f)
+    {
+        const qint64 hostTime=qint64(f*double(interval)*1e6);
+        pacer.sync(f*double(interval),hostTime);
+        timer.start();
+        const float step=pacer.swapped(hostTime);
+        //the pool is fed every frame and prefetches from there
+        if(pacer.isValid()) danmuPool->mediaTimeElapsed(int(pacer.frameTime()));
+        render->moveDanmu(step);
+        for(int i=0;i<3;++i)
+        {
+            if(!render->hideLayout[i]) render->layout_table[i]->drawLayout();
+        }
+        batchBuilder.build(render->objList,config.width,config.height,1.f);
+        maxOnScreen=qMax(maxOnScreen,render->objList.count());
+        render->objList.resize(0);
+        costs.append(timer.nsecsElapsed());
+        //the player keeps drawing while the cache thread works, the wait is reported apart
+        timer.restart();
+        waitCache();
+        waitTime+=timer.nsecsElapsed();
+    }
+    std::sort(costs.begin(),costs.end());
+    const AllocationStats objEnd(DanmuObject::allocationStats()), drawInfoEnd(DanmuDrawInfo::allocationStats());
+
+    Result result;
+    result.rate=rate;
+    result.frames=frames;
+    result.p50=costs.at(frames/2)/1e6;
+    result.p99=costs.at(qMin(frames-1,int(frames*0.99)))/1e6;
+    result.max=costs.last()/1e6;
+    result.cacheWait=waitTime/1e6;
+    result.cacheHits=render->cacheWorker->hitCount()-hitsStart;
+    result.cacheMisses=render->cacheWorker->missCount()-missesStart;
+    result.objectSlabs=objEnd.heapAllocs-objStart.heapAllocs;
+    result.drawInfoSlabs=drawInfoEnd.heapAllocs-drawInfoStart.heapAllocs;
+    result.prepareLists=danmuPool->prepareListAllocCount()-prepareListStart;
+    result.refLists=render->drListAllocCount-refListStart;
+    result.maxOnScreen=maxOnScreen;
+    return result;
+}
+
+void DanmuBenchmark::waitCache()
+{
+    DanmuPool *danmuPool=GlobalObjects::danmuPool;
+    //prepare lists come back once the cache thread is done with them
+    while(danmuPool->prepareListCount>danmuPool->prepareListPool.count())
+        QCoreApplication::processEvents();
+    //and the ref count lists sent before this point
+    QAtomicInt done(0);
+    QMetaObject::invokeMethod(GlobalObjects::danmuRender->cacheWorker,[&done](){
+        done.storeRelease(1);
+    },Qt::QueuedConnection);
+    while(!done.loadAcquire())
+        QCoreApplication::processEvents();
+}
+
+void DanmuBenchmark::printResult(const DanmuBenchmark::Result &result)
+{
+    QTextStream out(stdout);
+    const qint64 lookups=result.cacheHits+result.cacheMisses;
+    out<<QString("%1Hz, %2 frames: p50 %3ms, p99 %4ms, max %5ms, cache wait %6ms, max on screen %7")
+         .arg(result.rate).arg(result.frames).arg(result.p50,0,'f',3).arg(result.p99,0,'f',3)
+         .arg(result.max,0,'f',3).arg(result.cacheWait,0,'f',1).arg(result.maxOnScreen)<<endl;
+    out<<QString("    cache hit rate %1% (%2/%3), new slabs: DanmuObject %4 DanmuDrawInfo %5, new lists: prepare %6 ref %7")
+         .arg(lookups?100.0*result.cacheHits/lookups:0,0,'f',1).arg(result.cacheHits).arg(lookups)
+         .arg(result.objectSlabs).arg(result.drawInfoSlabs).arg(result.prepareLists).arg(result.refLists)<<endl;
+}
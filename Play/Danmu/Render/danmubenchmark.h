@@ -0,0 +1,48 @@
+#ifndef DANMUBENCHMARK_H
+#define DANMUBENCHMARK_H
+#include <QtCore>
+class Pool;
+/*
+ * Drives the danmu path without a player: a synthetic pool goes through DanmuPool,
+ * CacheWorker, the three layouts and DanmuBatchBuilder at a simulated refresh rate,
+ * every frame is paced by FramePacer as the player does it.
+ * Started with "KikoPlay --danmu-benchmark [key=value ...]", add "-platform offscreen"
+ * on machines without a display. The report is written to stdout.
+ * It runs on a temporary data directory, the settings and databases in use are not opened.
+ * Keys: density(comments/s) seconds textlen(mean) merge(ratio 0-1) rates(60:144) width height seed
+ */
+class DanmuBenchmark
+{
+public:
+    struct Config
+    {
+        int density;
+        int seconds;
+        int textLength;
+        double mergeRatio;
+        QList<int> rates;
+        int width, height;
+        quint32 seed;
+        static Config fromArguments(const QStringList &args);
+    };
+    struct Result
+    {
+        int rate;
+        int frames;
+        double p50, p99, max;   //main thread cost per frame, ms
+        double cacheWait;       //ms spent waiting for the cache thread, in total
+        qint64 cacheHits, cacheMisses;
+        qint64 objectSlabs, drawInfoSlabs;
+        int prepareLists, refLists;
+        int maxOnScreen;
+    };
+    explicit DanmuBenchmark(const Config &config);
+    int run();
+private:
+    Config config;
+    Pool *createPool();
+    Result runRate(int rate);
+    void waitCache();
+    void printResult(const Result &result);
+};
+#endif // DANMUBENCHMARK_H
@@ -33,14 +33,18 @@ DanmuRender::DanmuRender()
 	danmuStyle.bold = false;
     danmuStyle.enlargeMerged=true;
     danmuStyle.mergeCountPos=1;
+    danmuStyle.glyphAtlas=false;
+    offscreen=false;
     QObject::connect(GlobalObjects::mpvplayer,&MPVPlayer::resized,this,&DanmuRender::refreshDMRect);
 
     cacheWorker=new CacheWorker(&danmuStyle);
     cacheWorker->moveToThread(&cacheThread);
     QObject::connect(&cacheThread, &QThread::finished, cacheWorker, &QObject::deleteLater);
     QObject::connect(this,&DanmuRender::cacheDanmu,cacheWorker,&CacheWorker::beginCache);
+    QObject::connect(this,&DanmuRender::cachePrefetch,cacheWorker,&CacheWorker::prefetch);
+    QObject::connect(this,&DanmuRender::dropPrefetch,cacheWorker,&CacheWorker::dropPrefetched);
     QObject::connect(this,&DanmuRender::refCountChanged,cacheWorker,&CacheWorker::changeRefCount);
-    QObject::connect(cacheWorker,&CacheWorker::recyleRefList,[this](QList<DanmuDrawInfo *> *drList){
+    QObject::connect(cacheWorker,&CacheWorker::recyleRefList,[this](QVector<DanmuDrawInfo *> *drList){
         drListPool.append(drList);
     });
     QObject::connect(cacheWorker,&CacheWorker::cacheDone,this,&DanmuRender::addDanmu);
@@ -50,17 +54,10 @@ DanmuRender::DanmuRender()
 
     QObject::connect(GlobalObjects::mpvplayer,&MPVPlayer::initContext,[this](){
         QOpenGLContext *sharectx = GlobalObjects::mpvplayer->context();
-        surface = sharectx->surface();
-
-        danmuTextureContext = new QOpenGLContext();
-        danmuTextureContext->setFormat(sharectx->format());
-        danmuTextureContext->setShareContext(sharectx);
-        danmuTextureContext->create();
-#ifndef TEXTURE_MAIN_THREAD
-        danmuTextureContext->moveToThread(&cacheThread);
-#endif
+        initTextureContext(sharectx->surface(),sharectx);
     });
     currentDrList=nullptr;
+    drListAllocCount=0;
 }
 
 DanmuRender::~DanmuRender()
@@ -74,6 +71,18 @@ DanmuRender::~DanmuRender()
     DanmuObject::DeleteObjPool();
 }
 
+void DanmuRender::initTextureContext(QSurface *targetSurface, QOpenGLContext *shareContext)
+{
+    surface = targetSurface;
+    danmuTextureContext = new QOpenGLContext();
+    danmuTextureContext->setFormat(shareContext?shareContext->format():targetSurface->format());
+    if(shareContext) danmuTextureContext->setShareContext(shareContext);
+    danmuTextureContext->create();
+#ifndef TEXTURE_MAIN_THREAD
+    danmuTextureContext->moveToThread(&cacheThread);
+#endif
+}
+
 void DanmuRender::drawDanmu()
 {
     if(!hideLayout[DanmuComment::Rolling])layout_table[DanmuComment::Rolling]->drawLayout();
@@ -99,6 +108,20 @@ void DanmuRender::cleanup()
     layout_table[DanmuComment::Rolling]->cleanup();
     layout_table[DanmuComment::Top]->cleanup();
     layout_table[DanmuComment::Bottom]->cleanup();
+    //after a seek or a new item the prefetched comments will not come
+    emit dropPrefetch();
+#ifdef QT_DEBUG
+    logAllocationStats();
+#endif
+}
+
+void DanmuRender::logAllocationStats()
+{
+    //heap allocations should stop growing once playback reaches a steady state
+    AllocationStats objStats(DanmuObject::allocationStats()), drawInfoStats(DanmuDrawInfo::allocationStats());
+    qDebug()<<"DanmuObject: live"<<objStats.live()<<"acquired"<<objStats.acquired<<"slabs"<<objStats.heapAllocs<<"capacity"<<objStats.capacity;
+    qDebug()<<"DanmuDrawInfo: live"<<drawInfoStats.live()<<"acquired"<<drawInfoStats.acquired<<"slabs"<<drawInfoStats.heapAllocs<<"capacity"<<drawInfoStats.capacity;
+    qDebug()<<"PrepareList: created"<<GlobalObjects::danmuPool->prepareListAllocCount()<<"ref list: created"<<drListAllocCount;
 }
 
 QSharedPointer<DanmuComment> DanmuRender::danmuAt(QPointF point)
@@ -124,8 +147,9 @@ void DanmuRender::refDesc(DanmuDrawInfo *drawInfo)
     {
         if(drListPool.isEmpty())
         {
-            currentDrList=new QList<DanmuDrawInfo *>();
+            currentDrList=new QVector<DanmuDrawInfo *>();
             currentDrList->reserve(drSize);
+            ++drListAllocCount;
         }
         else
         {
@@ -135,7 +159,7 @@ void DanmuRender::refDesc(DanmuDrawInfo *drawInfo)
     currentDrList->append(drawInfo);
     if(currentDrList->size()>=drSize)
     {
-        QList<DanmuDrawInfo *> *tmp=currentDrList;
+        QVector<DanmuDrawInfo *> *tmp=currentDrList;
         currentDrList=nullptr;
         emit refCountChanged(tmp);
     }
@@ -222,6 +246,12 @@ void DanmuRender::setEnlargeMerged(bool enlarge)
     danmuStyle.enlargeMerged=enlarge;
 }
 
+void DanmuRender::setGlyphAtlas(bool on)
+{
+    danmuStyle.glyphAtlas=on;
+    emit danmuStyleChanged();
+}
+
 void DanmuRender::prepareDanmu(PrepareList *prepareList)
 {
     if(maxCount!=-1)
@@ -237,9 +267,14 @@ void DanmuRender::prepareDanmu(PrepareList *prepareList)
     emit cacheDanmu(prepareList);
 }
 
+void DanmuRender::prefetchDanmu(const QList<QSharedPointer<DanmuComment> > &danmus)
+{
+    emit cachePrefetch(danmus);
+}
+
 void DanmuRender::addDanmu(PrepareList *newDanmu)
 {
-    if(GlobalObjects::playlist->getCurrentItem()!=nullptr)
+    if(GlobalObjects::playlist->getCurrentItem()!=nullptr || offscreen)
     {
         for(auto &danmuInfo:*newDanmu)
         {
@@ -13,6 +13,7 @@ class DanmuRender : public QObject
 public:
     explicit DanmuRender();
     ~DanmuRender();
+    void initTextureContext(QSurface *targetSurface, QOpenGLContext *shareContext);
     void drawDanmu();
     void moveDanmu(float interval);
     void cleanup(DanmuComment::DanmuType cleanType);
@@ -22,8 +23,13 @@ public:
     int dense;
     QSharedPointer<DanmuComment> danmuAt(QPointF point);
     void removeBlocked();
-    inline void drawDanmuTexture(const DanmuObject *danmuObj){objList<<danmuObj;}
+    inline void drawDanmuTexture(const DanmuObject *danmuObj){objList.append({danmuObj->x,danmuObj->y,danmuObj->drawInfo});}
+    inline void drawDanmuTexture(float x, float y, const DanmuDrawInfo *drawInfo){objList.append({x,y,drawInfo});}
     void refDesc(DanmuDrawInfo *drawInfo);
+    //comments due in the next seconds, their images are made before they are sent to prepareDanmu
+    void prefetchDanmu(const QList<QSharedPointer<DanmuComment> > &danmus);
+    inline int rasterCost() const {return cacheWorker->rasterCost();}
+    void logAllocationStats();
 private:
     DanmuLayout *layout_table[3];
     bool hideLayout[3];
@@ -35,10 +41,14 @@ private:
     DanmuStyle danmuStyle;
     QThread cacheThread;
     CacheWorker *cacheWorker;
-    QList<QList<DanmuDrawInfo *> *> drListPool;
-    QList<DanmuDrawInfo *>  *currentDrList;
-    QList<const DanmuObject *> objList;
+    QList<QVector<DanmuDrawInfo *> *> drListPool;
+    QVector<DanmuDrawInfo *>  *currentDrList;
+    int drListAllocCount;
+    QVector<DanmuInstance> objList;
+    //laid out without a playlist item, set by DanmuBenchmark
+    bool offscreen;
     void refreshDMRect();
+    friend class DanmuBenchmark;
 public:
     void setBottomSubtitleProtect(bool bottomOn);
     void setTopSubtitleProtect(bool topOn);
@@ -52,10 +62,13 @@ public:
     void setMaxDanmuCount(int count);
     void setMergeCountPos(int pos);
     void setEnlargeMerged(bool enlarge);
+    void setGlyphAtlas(bool on);
 signals:
     void cacheDanmu(PrepareList *newDanmu);
+    void cachePrefetch(const QList<QSharedPointer<DanmuComment> > &danmus);
+    void dropPrefetch();
     void danmuStyleChanged();
-    void refCountChanged(QList<DanmuDrawInfo *> *descList);
+    void refCountChanged(QVector<DanmuDrawInfo *> *descList);
 public slots:
     void prepareDanmu(PrepareList *prepareList);
     void addDanmu(PrepareList *newDanmu);
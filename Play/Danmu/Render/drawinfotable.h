@@ -0,0 +1,80 @@
+#ifndef DRAWINFOTABLE_H
+#define DRAWINFOTABLE_H
+#include <QVector>
+class DanmuDrawInfo;
+/*
+ * Open addressing(linear probing) table from the 64-bit cache key to the draw info.
+ * Key 0 marks an empty slot, the load factor is kept under 1/2.
+ * Only used in the cache thread.
+ */
+class DrawInfoTable
+{
+public:
+    explicit DrawInfoTable(int capacity=1024):used(0)
+    {
+        int c=16;
+        while(c<capacity) c<<=1;
+        table.fill(Slot{0,nullptr},c);
+    }
+
+    inline int size() const {return used;}
+    DanmuDrawInfo *value(quint64 key) const
+    {
+        key=validKey(key);
+        const int mask=table.size()-1;
+        for(int i=int(key&quint64(mask));;i=(i+1)&mask)
+        {
+            const Slot &slot=table.at(i);
+            if(slot.key==key) return slot.value;
+            if(slot.key==0) return nullptr;
+        }
+    }
+    //the key must not be in the table
+    void insert(quint64 key, DanmuDrawInfo *drawInfo)
+    {
+        if((used+1)*2>table.size()) rehash(table.size()*2);
+        place(validKey(key),drawInfo);
+        ++used;
+    }
+    //removes the items pred returns true for, in one pass
+    template<typename Pred>
+    void removeIf(Pred pred)
+    {
+        QVector<Slot> old(table);
+        table.fill(Slot{0,nullptr});
+        used=0;
+        for(const Slot &slot:old)
+        {
+            if(slot.key==0 || pred(slot.value)) continue;
+            place(slot.key,slot.value);
+            ++used;
+        }
+    }
+private:
+    struct Slot
+    {
+        quint64 key;
+        DanmuDrawInfo *value;
+    };
+    QVector<Slot> table;
+    int used;
+
+    static inline quint64 validKey(quint64 key) {return key?key:1;}
+    void place(quint64 key, DanmuDrawInfo *drawInfo)
+    {
+        const int mask=table.size()-1;
+        int i=int(key&quint64(mask));
+        while(table.at(i).key!=0) i=(i+1)&mask;
+        table[i]={key,drawInfo};
+    }
+    void rehash(int capacity)
+    {
+        QVector<Slot> old(table);
+        table.fill(Slot{0,nullptr},capacity);
+        for(const Slot &slot:old)
+        {
+            if(slot.key!=0) place(slot.key,slot.value);
+        }
+    }
+};
+#endif // DRAWINFOTABLE_H
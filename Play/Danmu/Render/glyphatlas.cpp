@@ -0,0 +1,181 @@
+#include "glyphatlas.h"
+namespace
+{
+    //dst is ARGB32(not premultiplied), color is drawn over it with coverage alpha
+    inline void blendPixel(QRgb &dst, QRgb color, int alpha)
+    {
+        int dw=qAlpha(dst)*(255-alpha)/255;
+        int oa=alpha+dw;
+        if(oa==0) return;
+        dst=qRgba((qRed(color)*alpha+qRed(dst)*dw)/oa,
+                  (qGreen(color)*alpha+qGreen(dst)*dw)/oa,
+                  (qBlue(color)*alpha+qBlue(dst)*dw)/oa,
+                  oa);
+    }
+}
+GlyphAtlas::GlyphAtlas(int pageSize, int maxPages):pageSize(pageSize),maxPages(maxPages),strokeWidth(0),
+    shelfX(0),shelfY(0),shelfHeight(0),hits(0),misses(0)
+{
+
+}
+
+void GlyphAtlas::clear()
+{
+    pages.clear();
+    glyphs.clear();
+    fontIds.clear();
+    shelfX=shelfY=shelfHeight=0;
+}
+
+void GlyphAtlas::setStrokeWidth(float width)
+{
+    if(width==strokeWidth) return;
+    strokeWidth=width;
+    clear();
+}
+
+bool GlyphAtlas::layoutText(const QPointF &pos, const QFont &font, const QString &text, QVector<GlyphQuad> &quads)
+{
+    QTextLayout layout(text,font);
+    QTextOption option;
+    option.setWrapMode(QTextOption::NoWrap);
+    layout.setTextOption(option);
+    layout.beginLayout();
+    QTextLine line(layout.createLine());
+    layout.endLayout();
+    if(!line.isValid()) return true;
+    //pos is on the baseline, same as QPainterPath::addText
+    const QPointF origin(pos.x(),pos.y()-line.ascent());
+    const QList<QGlyphRun> runs(layout.glyphRuns());
+    for(const QGlyphRun &run:runs)
+    {
+        const QRawFont rawFont(run.rawFont());
+        const quint32 id=fontId(rawFont);
+        const QVector<quint32> indexes(run.glyphIndexes());
+        const QVector<QPointF> positions(run.positions());
+        for(int i=0;i<indexes.count();++i)
+        {
+            Glyph g;
+            if(!glyph(rawFont,id,indexes.at(i),g)) return false;
+            if(g.page<0) continue;
+            const QPointF pen(origin+positions.at(i));
+            quads.append({g.page,g.rect,QPoint(qRound(pen.x()),qRound(pen.y()))+g.offset});
+        }
+    }
+    return true;
+}
+
+void GlyphAtlas::compose(QImage &img, const QVector<GlyphQuad> &quads, QRgb fillColor, QRgb strokeColor) const
+{
+    const QRect bounds(img.rect());
+    for(int pass=0;pass<2;++pass)
+    {
+        const bool strokePass=(pass==0);
+        if(strokePass && strokeWidth<=0) continue;
+        const QRgb color=strokePass?strokeColor:fillColor;
+        for(const GlyphQuad &quad:quads)
+        {
+            const QRect dstRect(QRect(quad.dst,quad.src.size()).intersected(bounds));
+            if(dstRect.isEmpty()) continue;
+            const QImage &page=pages.at(quad.page);
+            const int sx=quad.src.x()+dstRect.left()-quad.dst.x();
+            for(int y=dstRect.top();y<=dstRect.bottom();++y)
+            {
+                const QRgb *src=reinterpret_cast<const QRgb *>(page.constScanLine(quad.src.y()+y-quad.dst.y()))+sx;
+                QRgb *dst=reinterpret_cast<QRgb *>(img.scanLine(y))+dstRect.left();
+                for(int x=0;x<dstRect.width();++x)
+                {
+                    const int alpha=strokePass?qGreen(src[x]):qRed(src[x]);
+                    if(alpha) blendPixel(dst[x],color,alpha);
+                }
+            }
+        }
+    }
+}
+
+quint32 GlyphAtlas::fontId(const QRawFont &rawFont)
+{
+    const QString key(QString("%1|%2|%3|%4").arg(rawFont.familyName(),rawFont.styleName(),
+                                                 QString::number(rawFont.pixelSize()),QString::number(rawFont.weight())));
+    auto iter=fontIds.constFind(key);
+    if(iter!=fontIds.cend()) return iter.value();
+    const quint32 id=fontIds.count();
+    fontIds.insert(key,id);
+    return id;
+}
+
+bool GlyphAtlas::glyph(const QRawFont &rawFont, quint32 fontId, quint32 glyphIndex, Glyph &g)
+{
+    const quint64 key=(quint64(fontId)<<32)|glyphIndex;
+    auto iter=glyphs.constFind(key);
+    if(iter!=glyphs.cend())
+    {
+        ++hits;
+        g=iter.value();
+        return true;
+    }
+    ++misses;
+    const QPainterPath path(rawFont.pathForGlyph(glyphIndex));
+    const qreal pad=strokeWidth/2+1;
+    const QRect box(path.boundingRect().adjusted(-pad,-pad,pad,pad).toAlignedRect());
+    //blank glyphs(e.g. space) and glyphs larger than a page only move the pen
+    g.page=-1;
+    if(!path.isEmpty() && box.width()<=pageSize && box.height()<=pageSize)
+    {
+        QPoint at;
+        if(!allocate(box.size(),g.page,at)) return false;
+        QImage fillMask(box.size(),QImage::Format_Alpha8), strokeMask(box.size(),QImage::Format_Alpha8);
+        fillMask.fill(0);
+        strokeMask.fill(0);
+        QPainter painter(&fillMask);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.translate(-box.topLeft());
+        painter.fillPath(path,Qt::black);
+        painter.end();
+        if(strokeWidth>0)
+        {
+            QPen strokePen;
+            strokePen.setWidthF(strokeWidth);
+            painter.begin(&strokeMask);
+            painter.setRenderHint(QPainter::Antialiasing);
+            painter.translate(-box.topLeft());
+            painter.strokePath(path,strokePen);
+            painter.end();
+        }
+        QImage &page=pages[g.page];
+        for(int y=0;y<box.height();++y)
+        {
+            const uchar *f=fillMask.constScanLine(y), *s=strokeMask.constScanLine(y);
+            QRgb *dst=reinterpret_cast<QRgb *>(page.scanLine(at.y()+y))+at.x();
+            for(int x=0;x<box.width();++x)
+                dst[x]=qRgb(f[x],s[x],0);
+        }
+        g.rect=QRect(at,box.size());
+        g.offset=box.topLeft();
+    }
+    glyphs.insert(key,g);
+    return true;
+}
+
+bool GlyphAtlas::allocate(const QSize &size, int &page, QPoint &pos)
+{
+    if(shelfX+size.width()>pageSize)
+    {
+        shelfY+=shelfHeight;
+        shelfX=0;
+        shelfHeight=0;
+    }
+    if(pages.isEmpty() || shelfY+size.height()>pageSize)
+    {
+        if(pages.count()>=maxPages) return false;
+        QImage newPage(pageSize,pageSize,QImage::Format_RGB32);
+        newPage.fill(0);
+        pages.append(newPage);
+        shelfX=shelfY=shelfHeight=0;
+    }
+    page=pages.count()-1;
+    pos=QPoint(shelfX,shelfY);
+    shelfX+=size.width();
+    shelfHeight=qMax(shelfHeight,size.height());
+    return true;
+}
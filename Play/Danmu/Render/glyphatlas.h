@@ -0,0 +1,53 @@
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+#include <QtGui>
+/*
+ * CPU side glyph cache for CacheWorker.
+ * Every (font, glyph, stroke width) is rasterized once into a long-lived atlas page,
+ * red channel holds the fill coverage and green channel the stroke coverage.
+ * A comment is laid out into glyph quads by QTextLayout(so shaping, kerning and font
+ * fallback stay the same as QPainterPath::addText) and composed by blending the quads
+ * with the comment colors, all strokes first and then all fills, like strokePath+fillPath.
+ * Only used in the cache thread.
+ */
+class GlyphAtlas
+{
+public:
+    struct GlyphQuad
+    {
+        int page;
+        QRect src;
+        QPoint dst;
+    };
+    explicit GlyphAtlas(int pageSize=1024, int maxPages=4);
+    void clear();
+    void setStrokeWidth(float width);
+    //returns false when the atlas is full, clear it and lay out again
+    bool layoutText(const QPointF &pos, const QFont &font, const QString &text, QVector<GlyphQuad> &quads);
+    void compose(QImage &img, const QVector<GlyphQuad> &quads, QRgb fillColor, QRgb strokeColor) const;
+
+    inline int glyphCount() const {return glyphs.count();}
+    inline int pageCount() const {return pages.count();}
+    inline qint64 hitCount() const {return hits;}
+    inline qint64 missCount() const {return misses;}
+private:
+    struct Glyph
+    {
+        int page;
+        QRect rect;
+        QPoint offset; //top left relative to the pen position on the baseline
+    };
+    const int pageSize, maxPages;
+    float strokeWidth;
+    QVector<QImage> pages;
+    int shelfX, shelfY, shelfHeight;
+    QHash<quint64, Glyph> glyphs;
+    QHash<QString, quint32> fontIds;
+    qint64 hits, misses;
+
+    quint32 fontId(const QRawFont &rawFont);
+    bool glyph(const QRawFont &rawFont, quint32 fontId, quint32 glyphIndex, Glyph &g);
+    bool allocate(const QSize &size, int &page, QPoint &pos);
+};
+
+#endif // GLYPHATLAS_H
@@ -0,0 +1,163 @@
+#include "textureatlas.h"
+
+TextureAtlas::TextureAtlas(int pageSize, int softMaxPages):size(pageSize),softMaxPages(softMaxPages),nextPageId(0)
+{
+
+}
+
+bool TextureAtlas::allocate(int width, int height, TextureAtlas::Region &region, bool allowOverflow)
+{
+    if(width<=0 || height<=0 || width>size || height>size) return false;
+    QPoint pos;
+    for(auto iter=pages.begin();iter!=pages.end();++iter)
+    {
+        if(allocateInPage(iter.value(),width,height,pos))
+        {
+            region={iter.key(),pos.x(),pos.y(),width,height};
+            return true;
+        }
+    }
+    if(pages.count()>=softMaxPages && !allowOverflow) return false;
+    const int id=nextPageId++;
+    Page &page=pages[id];
+    page.top=0;
+    page.regionCount=0;
+    page.usedArea=0;
+    newPages.append(id);
+    bool ret=allocateInPage(page,width,height,pos);
+    Q_ASSERT(ret);
+    Q_UNUSED(ret)
+    region={id,pos.x(),pos.y(),width,height};
+    return true;
+}
+
+void TextureAtlas::release(const TextureAtlas::Region &region)
+{
+    auto iter=pages.find(region.page);
+    Q_ASSERT(iter!=pages.end());
+    if(iter==pages.end()) return;
+    Page &page=iter.value();
+    int s=0;
+    while(s<page.shelves.count() && page.shelves.at(s).y!=region.y) ++s;
+    Q_ASSERT(s<page.shelves.count());
+    if(s==page.shelves.count()) return;
+    Shelf &shelf=page.shelves[s];
+    //put the span back and merge it with its neighbours
+    auto &spans=shelf.freeSpans;
+    int i=0;
+    while(i<spans.count() && spans.at(i).first<region.x) ++i;
+    QPair<int,int> span(region.x,region.x+region.width);
+    if(i<spans.count() && spans.at(i).first==span.second)
+    {
+        span.second=spans.at(i).second;
+        spans.removeAt(i);
+    }
+    if(i>0 && spans.at(i-1).second==span.first)
+    {
+        spans[i-1].second=span.second;
+    }
+    else
+    {
+        spans.insert(i,span);
+    }
+    shelf.usedWidth-=region.width;
+    page.usedArea-=qint64(region.width)*region.height;
+    --page.regionCount;
+    //empty shelves at the end give their height back to the page
+    while(!page.shelves.isEmpty() && page.shelves.last().usedWidth==0)
+    {
+        page.top=page.shelves.last().y;
+        page.shelves.removeLast();
+    }
+    if(page.regionCount==0 && pages.count()>softMaxPages)
+    {
+        droppedPages.append(iter.key());
+        pages.erase(iter);
+    }
+}
+
+QList<int> TextureAtlas::takeNewPages()
+{
+    QList<int> ret;
+    ret.swap(newPages);
+    return ret;
+}
+
+QList<int> TextureAtlas::takeDroppedPages()
+{
+    QList<int> ret;
+    ret.swap(droppedPages);
+    return ret;
+}
+
+TextureAtlas::Stats TextureAtlas::stats() const
+{
+    Stats s{pages.count(),0,0,0,qint64(pages.count())*size*size};
+    for(const Page &page:pages)
+    {
+        s.regions+=page.regionCount;
+        s.usedArea+=page.usedArea;
+        for(const Shelf &shelf:page.shelves)
+            s.shelfArea+=qint64(shelf.height)*size;
+    }
+    return s;
+}
+
+bool TextureAtlas::allocateInPage(TextureAtlas::Page &page, int width, int height, QPoint &pos)
+{
+    //the lowest shelf that fits, a used shelf may only be a little taller than the rectangle
+    int best=-1;
+    for(int i=0;i<page.shelves.count();++i)
+    {
+        const Shelf &shelf=page.shelves.at(i);
+        if(shelf.height<height) continue;
+        if(shelf.usedWidth>0 && shelf.height>height+height/4+4) continue;
+        if(best!=-1 && page.shelves.at(best).height<=shelf.height) continue;
+        for(const auto &span:shelf.freeSpans)
+        {
+            if(span.second-span.first>=width)
+            {
+                best=i;
+                break;
+            }
+        }
+    }
+    if(best==-1)
+    {
+        //open a new shelf, heights are rounded up so that the shelf can be reused
+        int shelfHeight=qMin((height+3)&~3,size-page.top);
+        if(shelfHeight<height) return false;
+        Shelf shelf;
+        shelf.y=page.top;
+        shelf.height=shelfHeight;
+        shelf.usedWidth=0;
+        shelf.freeSpans.append(qMakePair(0,size));
+        page.shelves.append(shelf);
+        page.top+=shelfHeight;
+        best=page.shelves.count()-1;
+    }
+    Shelf &shelf=page.shelves[best];
+    int x=0;
+    bool ret=takeSpan(shelf,width,x);
+    Q_ASSERT(ret);
+    Q_UNUSED(ret)
+    pos=QPoint(x,shelf.y);
+    page.usedArea+=qint64(width)*height;
+    ++page.regionCount;
+    return true;
+}
+
+bool TextureAtlas::takeSpan(TextureAtlas::Shelf &shelf, int width, int &x)
+{
+    for(int i=0;i<shelf.freeSpans.count();++i)
+    {
+        QPair<int,int> &span=shelf.freeSpans[i];
+        if(span.second-span.first<width) continue;
+        x=span.first;
+        span.first+=width;
+        if(span.first==span.second) shelf.freeSpans.removeAt(i);
+        shelf.usedWidth+=width;
+        return true;
+    }
+    return false;
+}
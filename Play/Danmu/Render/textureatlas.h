@@ -0,0 +1,65 @@
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+#include <QtCore>
+/*
+ * Rectangle allocator for the danmu texture pages, no GL calls here.
+ * Each page is split into horizontal shelves, a shelf keeps a list of free spans
+ * so a released rectangle can be reused by any later one of similar height.
+ * Up to softMaxPages pages are kept for the whole session, pages above the limit
+ * are only created when everything else is in use and are dropped once empty.
+ */
+class TextureAtlas
+{
+public:
+    struct Region
+    {
+        int page;
+        int x, y;
+        int width, height;
+    };
+    struct Stats
+    {
+        int pages;
+        int regions;
+        qint64 usedArea;
+        qint64 shelfArea;
+        qint64 pageArea;
+        //used part of all pages
+        inline double occupancy() const {return pageArea?double(usedArea)/pageArea:0;}
+        //unusable part of the shelves
+        inline double fragmentation() const {return shelfArea?1-double(usedArea)/shelfArea:0;}
+    };
+    explicit TextureAtlas(int pageSize=2048, int softMaxPages=4);
+
+    inline int pageSize() const {return size;}
+    bool allocate(int width, int height, Region &region, bool allowOverflow);
+    void release(const Region &region);
+    //pages created/dropped since the last call, the owner creates/deletes their textures
+    QList<int> takeNewPages();
+    QList<int> takeDroppedPages();
+    Stats stats() const;
+private:
+    struct Shelf
+    {
+        int y;
+        int height;
+        int usedWidth;
+        QVector<QPair<int,int> > freeSpans; //[begin, end), sorted
+    };
+    struct Page
+    {
+        QVector<Shelf> shelves; //sorted by y
+        int top;
+        int regionCount;
+        qint64 usedArea;
+    };
+    const int size, softMaxPages;
+    QMap<int, Page> pages;
+    int nextPageId;
+    QList<int> newPages, droppedPages;
+
+    bool allocateInPage(Page &page, int width, int height, QPoint &pos);
+    static bool takeSpan(Shelf &shelf, int width, int &x);
+};
+
+#endif // TEXTUREATLAS_H
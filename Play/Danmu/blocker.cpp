@@ -4,7 +4,30 @@
 #include <QLineEdit>
 #include "globalobjects.h"
 #include "Play/Danmu/danmupool.h"
+#include "danmustore.h"
 #include "Common/network.h"
+namespace
+{
+    //interned texts/senders share an id in the store, each distinct string is only tested once per rule
+    bool storeTest(BlockRule *rule, const DanmuStore &store, DanmuStore::Handle h, QVector<qint8> &cache)
+    {
+        int id;
+        switch (rule->blockField)
+        {
+        case BlockRule::DanmuText:
+            id=store.textId(h);
+            break;
+        case BlockRule::DanmuSender:
+            id=store.senderId(h);
+            break;
+        default:
+            return rule->blockTest(QString::number(store.color(h),16));
+        }
+        qint8 &result=cache[id];
+        if(result==-1) result=rule->blockTest(store.string(id))?1:0;
+        return result==1;
+    }
+}
 #define BlockNameRole Qt::UserRole+1
 QWidget *ComboBoxDelegate::createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const
 {
@@ -186,6 +209,52 @@ void Blocker::checkDanmu(QList<QSharedPointer<DanmuComment> > &danmuList)
     }
 }
 
+void Blocker::checkDanmu(DanmuStore &store)
+{
+    QVector<QVector<qint8> > ruleCache(blockList.count(),QVector<qint8>(store.stringCount(),-1));
+    for(DanmuStore::Handle h=0;h<store.count();++h)
+    {
+        for(int i=0;i<blockList.count();++i)
+        {
+            if(storeTest(blockList.at(i),store,h,ruleCache[i]))
+            {
+                store.setBlockBy(h,blockList.at(i)->id);
+                break;
+            }
+        }
+    }
+}
+
+int Blocker::testBlockRule(DanmuStore &store, BlockRule *rule)
+{
+    QVector<qint8> cache(store.stringCount(),-1);
+    int blockCount=0;
+    for(DanmuStore::Handle h=0;h<store.count();++h)
+    {
+        if(store.blockBy(h)==-1)
+        {
+            if(storeTest(rule,store,h,cache))
+                store.setBlockBy(h,rule->id);
+        }
+        else if(store.blockBy(h)==rule->id)
+        {
+            if(!storeTest(rule,store,h,cache))
+                store.setBlockBy(h,-1);
+        }
+        blockCount+=(store.blockBy(h)==-1?0:1);
+    }
+    return blockCount;
+}
+
+BlockRule *Blocker::blockRule(int id) const
+{
+    for(BlockRule *rule:blockList)
+    {
+        if(rule->id==id) return rule;
+    }
+    return nullptr;
+}
+
 bool Blocker::isBlocked(DanmuComment *danmu)
 {
     for(BlockRule *rule:blockList)
@@ -3,6 +3,7 @@
 #include <QAbstractItemModel>
 #include <QStyledItemDelegate>
 #include "common.h"
+class DanmuStore;
 class ComboBoxDelegate : public QStyledItemDelegate
 {
     Q_OBJECT
@@ -40,6 +41,9 @@ public slots:
     void removeBlockRule(const QModelIndexList &deleteIndexes);
 	void checkDanmu(QList<DanmuComment *> &danmuList);
 	void checkDanmu(QList<QSharedPointer<DanmuComment> > &danmuList);
+    void checkDanmu(DanmuStore &store);
+    int testBlockRule(DanmuStore &store, BlockRule *rule);
+    BlockRule *blockRule(int id) const;
     bool isBlocked(DanmuComment *danmu);
     void save();
     void preFilter(QList<DanmuComment *> &danmuList);
@@ -1,27 +1,32 @@
 #include "common.h"
 #include "globalobjects.h"
 #include "Render/danmurender.h"
-#define MAX_POOL_COUNT 100
-DanmuObject *DanmuObject::head=nullptr;
-int DanmuObject::poolCount=0;
+namespace
+{
+    ObjectPool<DanmuObject> danmuObjectPool;
+    ObjectPool<DanmuDrawInfo> drawInfoPool;
+}
 
 bool BlockRule::blockTest(DanmuComment *comment)
 {
     if(!enable)return false;
-    QString *testStr;
-    bool testResult(false);
     switch (blockField)
     {
     case DanmuText:
-        testStr=&comment->text;
-        break;
+        return blockTest(comment->text);
     case DanmuSender:
-        testStr=&comment->sender;
-        break;
+        return blockTest(comment->sender);
     case DanmuColor:
-        testStr=new QString(QString::number(comment->color,16));
-        break;
+        return blockTest(QString::number(comment->color,16));
     }
+    return false;
+}
+
+bool BlockRule::blockTest(const QString &str)
+{
+    if(!enable)return false;
+    const QString *testStr=&str;
+    bool testResult(false);
     switch (relation)
     {
     case Equal:
@@ -58,7 +63,6 @@ bool BlockRule::blockTest(DanmuComment *comment)
     default:
         break;
     }
-    if(blockField==DanmuColor)delete testStr;
     return testResult;
 }
 
@@ -69,45 +73,41 @@ DanmuObject::~DanmuObject()
 
 void *DanmuObject::operator new(size_t sz)
 {
-    if(head)
-    {
-        void *tmp=(void *)head;
-        head=head->next;
-        poolCount--;
-        return tmp;
-    }
-    else
-    {
-        void *tmp=malloc(sz);
-        if(!tmp) throw std::bad_alloc();
-        return tmp;
-    }
+    Q_ASSERT(sz==sizeof(DanmuObject));
+    Q_UNUSED(sz)
+    return danmuObjectPool.allocate();
 }
 
 void DanmuObject::operator delete(void *p)
 {
-    if(poolCount>MAX_POOL_COUNT)
-    {
-        free(p);
-    }
-    else
-    {
-        DanmuObject *obj=static_cast<DanmuObject *>(p);
-        obj->next=head;
-        head=obj;
-        poolCount++;
-    }
+    danmuObjectPool.deallocate(p);
 }
 
 void DanmuObject::DeleteObjPool()
 {
-    DanmuObject *p;
-    for(p=head;p!=nullptr;p=head)
-    {
-        head=head->next;
-        free((void *)p);
-    }
-    poolCount=0;
+    danmuObjectPool.releaseSlabs();
+}
+
+AllocationStats DanmuObject::allocationStats()
+{
+    return danmuObjectPool.stats();
+}
+
+void *DanmuDrawInfo::operator new(size_t sz)
+{
+    Q_ASSERT(sz==sizeof(DanmuDrawInfo));
+    Q_UNUSED(sz)
+    return drawInfoPool.allocate();
+}
+
+void DanmuDrawInfo::operator delete(void *p)
+{
+    drawInfoPool.deallocate(p);
+}
+
+AllocationStats DanmuDrawInfo::allocationStats()
+{
+    return drawInfoPool.stats();
 }
 
 void DanmuSourceInfo::setTimeline(const QString &timelineStr)
@@ -127,6 +127,18 @@ void DanmuSourceInfo::setTimeline(const QString &timelineStr)
     });
 }
 
+int DanmuSourceInfo::playTime(int originTime) const
+{
+    int shift=0;
+    for(auto &spaceItem:timelineInfo)
+    {
+        if(originTime>spaceItem.first)shift+=spaceItem.second;
+        else break;
+    }
+    shift+=delay;
+    return originTime+shift<0?originTime:originTime+shift;
+}
+
 QString DanmuSourceInfo::getTimelineStr() const
 {
     QString timelineStr;
@@ -2,10 +2,11 @@
 #define DANMUCOMMENT_H
 #include <QtCore>
 #include <QtGui>
+#include "objectpool.h"
 class DanmuComment
 {
 public:
-    DanmuComment():time(0),originTime(0),blockBy(-1),mergedList(nullptr),m_parent(nullptr){}
+    DanmuComment():time(0),originTime(0),blockBy(-1),textHash(0),mergedList(nullptr),m_parent(nullptr){}
     ~DanmuComment(){if(mergedList)delete mergedList;}
 
     enum DanmuType
@@ -51,10 +52,13 @@ public:
     int originTime;
     int blockBy;
     int source;
+    //hash of text for the render cache key, 0 until the cache thread computes it
+    quint64 textHash;
 
     QList<QSharedPointer<DanmuComment> > *mergedList;
     DanmuComment *m_parent;
 };
+Q_DECLARE_METATYPE(QSharedPointer<DanmuComment>)
 QDataStream &operator<<(QDataStream &stream, const DanmuComment &danmu);
 QDataStream &operator>>(QDataStream &stream, DanmuComment &danmu);
 
@@ -72,17 +76,18 @@ public:
     int height;
     int useCount;
     GLuint texture;
+    int atlasPage, texX, texY; //region in the texture atlas
     GLfloat l,r,t,b;
     //QMutex useCountLock;
     //QImage *img=nullptr;
     //~DanmuDrawInfo(){if(img)delete img;}
+    //allocated and freed in the cache thread only
+    void *operator new(size_t sz);
+    void  operator delete(void * p);
+    static AllocationStats allocationStats();
 };
 class DanmuObject
 {
-private:
-    static DanmuObject *head;
-    static int poolCount;
-    DanmuObject *next=nullptr;
 public:   
     DanmuDrawInfo *drawInfo;
     QSharedPointer<DanmuComment> src;
@@ -90,10 +95,20 @@ public:
     float y;
     float extraData;
      ~DanmuObject();
+    //allocated and freed in the main thread only
     void *operator new(size_t sz);
     void  operator delete(void * p);
     static void DeleteObjPool();
+    static AllocationStats allocationStats();
+};
+//a danmu to draw this frame, layouts emit it from their own storage
+struct DanmuInstance
+{
+    float x;
+    float y;
+    const DanmuDrawInfo *drawInfo;
 };
+Q_DECLARE_TYPEINFO(DanmuInstance, Q_PRIMITIVE_TYPE);
 struct MatchInfo
 {
     bool success;
@@ -124,6 +139,8 @@ struct DanmuSourceInfo
     QList<QPair<int,int> >timelineInfo;
     void setTimeline(const QString &timelineStr);
     QString getTimelineStr() const;
+    //playback time of a comment of this source, after the delay and the timeline spaces
+    int playTime(int originTime) const;
 };
 QDataStream &operator<<(QDataStream &stream, const DanmuSourceInfo &src);
 QDataStream &operator>>(QDataStream &stream, DanmuSourceInfo &src);
@@ -152,8 +169,10 @@ struct BlockRule
     QString content;
     QScopedPointer<QRegExp> re;
     bool blockTest(DanmuComment *comment);
+    //test the field value picked by blockField
+    bool blockTest(const QString &str);
 };
-typedef QLinkedList<QPair<QSharedPointer<DanmuComment>,DanmuDrawInfo *> > PrepareList;
+typedef QVector<QPair<QSharedPointer<DanmuComment>,DanmuDrawInfo *> > PrepareList;
 struct DanmuEvent
 {
     int start;
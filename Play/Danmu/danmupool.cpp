@@ -4,7 +4,8 @@
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QMessageBox>
-#include "eventanalyzer.h"
+#include <numeric>
+#include <limits>
 #include "Render/danmurender.h"
 #include "globalobjects.h"
 #include "blocker.h"
@@ -13,6 +14,13 @@
 #include "Play/Playlist/playlist.h"
 namespace
 {
+    const int PrepareListBundleSize=32;
+    //prefetch keeps about this much rasterization(us) queued ahead of playback,
+    //the look-ahead shrinks when images get expensive and grows when they are cheap
+    const int PrefetchBudget=100*1000;
+    const int DefaultRasterCost=500;
+    const int MaxPrefetchCount=256;
+    const int MaxLookAhead=10*1000;
     struct
     {
         inline bool operator ()(const QSharedPointer<DanmuComment> &danmu,int time) const
@@ -29,14 +37,25 @@ namespace
     } DanmuSPCompare;
 }
 DanmuPool::DanmuPool(QObject *parent) : QAbstractItemModel(parent),curPool(nullptr), emptyPool(new Pool("","","",this)),
-    currentPosition(0),currentTime(0),enableAnalyze(true),enableMerged(true),mergeInterval(15*1000),maxContentUnsimCount(4),minMergeCount(3)
+    prepareListCount(0),poolVersion(0),taskRunning(false),hasPendingTask(false),
+    currentPosition(0),prefetchPosition(0),currentTime(0),enableAnalyze(true),enableMerged(true),enableIncrementalMerge(true),
+    mergeInterval(15*1000),maxContentUnsimCount(4),minMergeCount(3)
 {
-    analyzer=new EventAnalyzer(this);
+    qRegisterMetaType<QSharedPointer<DanmuComment> >("QSharedPointer<DanmuComment>");
+    qRegisterMetaType<QList<QSharedPointer<DanmuComment> > >("QList<QSharedPointer<DanmuComment> >");
+    worker=new DanmuPoolWorker;
+    poolThread=new QThread(this);
+    poolThread->setObjectName(QStringLiteral("poolThread"));
+    worker->moveToThread(poolThread);
+    QObject::connect(poolThread,&QThread::finished,worker,&QObject::deleteLater);
+    poolThread->start();
 	setConnect(emptyPool);
 }
 
 DanmuPool::~DanmuPool()
 {
+    poolThread->quit();
+    poolThread->wait();
     qDeleteAll(prepareListPool);
     delete emptyPool;
 }
@@ -65,31 +84,22 @@ void DanmuPool::cleanUp()
 
 void DanmuPool::testBlockRule(BlockRule *rule)
 {
-    statisInfo.blockCount=0;
-    for(QSharedPointer<DanmuComment> &danmu:danmuPool)
-    {
-        if(danmu->blockBy==-1)
-        {
-            if(rule->blockTest(danmu.data()))
-                danmu->blockBy=rule->id;
-        }
-        else if(danmu->blockBy==rule->id)
-        {
-            if(!rule->blockTest(danmu.data()))
-                danmu->blockBy=-1;
-        }
-        statisInfo.blockCount+=(danmu->blockBy==-1?0:1);
-    }
+    statisInfo.blockCount=GlobalObjects::blocker->testBlockRule(danmuStore,rule);
+    //the store of the running task is built from the comments before this test
+    if(taskRunning && !testedRules.contains(rule->id)) testedRules.append(rule->id);
     GlobalObjects::danmuRender->removeBlocked();
 }
 
 void DanmuPool::deleteDanmu(QSharedPointer<DanmuComment> danmu)
 {
+    //the published pool may still hold comments removed after the running task started
+    if(!danmuPool.contains(danmu)) return;
     if(!danmu->m_parent)
     {
         int row = finalPool.indexOf(danmu);
         beginRemoveRows(QModelIndex(), row, row);
         finalPool.removeAt(row);
+        finalHandles.removeAt(row);
         endRemoveRows();
         if(danmu->mergedList)
         {
@@ -114,116 +124,135 @@ void DanmuPool::deleteDanmu(QSharedPointer<DanmuComment> danmu)
 	beginRemoveRows(QModelIndex(), row, row);
     danmuPool.removeAt(row);
     endRemoveRows();
-    setStatisInfo();
+    requestUpdate(DanmuPoolTask::IncrementalMerge,false,QList<QSharedPointer<DanmuComment> >(),
+                  QList<QSharedPointer<DanmuComment> >({danmu}));
 }
-void DanmuPool::setMerged()
+void DanmuPool::requestUpdate(DanmuPoolTask::MergeMode mode, bool analyze, const QList<QSharedPointer<DanmuComment> > &addedList, const QList<QSharedPointer<DanmuComment> > &removedList)
 {
-#ifdef QT_DEBUG
-    qDebug()<<"merge start";
-    QElapsedTimer timer;
-    timer.start();
-#endif
-    for(auto iter=danmuPool.cbegin();iter!=danmuPool.cend();++iter)
+    if(mode==DanmuPoolTask::IncrementalMerge && !enableIncrementalMerge)
+        mode=DanmuPoolTask::FullMerge;
+    if(!hasPendingTask)
     {
-        if((*iter)->mergedList)
+        pendingTask.mode=mode;
+        pendingTask.analyze=analyze;
+        pendingTask.addedList=addedList;
+        pendingTask.removedList=removedList;
+        pendingTask.minChangedTime=std::numeric_limits<int>::max();
+        pendingTask.maxChangedTime=std::numeric_limits<int>::min();
+        hasPendingTask=true;
+    }
+    else
+    {
+        //changes arriving while the worker is busy are coalesced into one task
+        pendingTask.mode=qMax(pendingTask.mode,mode);
+        pendingTask.analyze=pendingTask.analyze || analyze;
+        pendingTask.addedList.append(addedList);
+        pendingTask.removedList.append(removedList);
+    }
+    for(const auto &changedList:{addedList,removedList})
+    {
+        for(const auto &dm:changedList)
         {
-            delete (*iter)->mergedList;
-            (*iter)->mergedList=nullptr;
+            pendingTask.minChangedTime=qMin(pendingTask.minChangedTime,dm->time);
+            pendingTask.maxChangedTime=qMax(pendingTask.maxChangedTime,dm->time);
         }
-        if((*iter)->m_parent) (*iter)->m_parent=nullptr;
     }
-    statisInfo.mergeCount=0;
-    if(enableMerged)
+    if(!taskRunning) submitTask();
+}
+
+void DanmuPool::submitTask()
+{
+    if(!hasPendingTask) return;
+    DanmuPoolTask task(pendingTask);
+    task.version=poolVersion;
+    task.comments=danmuPool;
+    task.times.reserve(danmuPool.count());
+    task.blockBys.reserve(danmuPool.count());
+    for(const auto &dm:danmuPool)
+    {
+        task.times.append(dm->time);
+        task.blockBys.append(dm->blockBy);
+    }
+    task.finalPool=finalPool;
+    task.finalHandles=finalHandles;
+    task.enableMerged=enableMerged;
+    task.mergeInterval=mergeInterval;
+    task.maxUnsimCount=maxContentUnsimCount;
+    task.minMergeCount=minMergeCount;
+    task.analyze=task.analyze && enableAnalyze;
+    hasPendingTask=false;
+    pendingTask.addedList.clear();
+    pendingTask.removedList.clear();
+    taskRunning=true;
+    QMetaObject::invokeMethod(worker,[this,task](){
+        QSharedPointer<DanmuPoolSnapshot> snapshot(worker->process(task));
+        QMetaObject::invokeMethod(this,[this,snapshot](){
+            publishSnapshot(snapshot);
+        },Qt::QueuedConnection);
+    },Qt::QueuedConnection);
+}
+
+void DanmuPool::publishSnapshot(QSharedPointer<DanmuPoolSnapshot> snapshot)
+{
+    taskRunning=false;
+    const bool retestRules=!testedRules.isEmpty();
+    //results of the previous pool are dropped
+    if(snapshot->version==poolVersion)
     {
-        finalPool.clear();
-        QList<QSharedPointer<DanmuComment> > slideWindow;
-        for(auto iter=danmuPool.cbegin();iter!=danmuPool.cend();++iter)
+        if(snapshot->merged)
         {
-            DanmuComment *cc((*iter).data());
-            while(!slideWindow.isEmpty() && cc->time-slideWindow.first()->time>mergeInterval)
+            beginResetModel();
+            for(auto &dm:snapshot->resetList)
             {
-                auto c(slideWindow.takeFirst());
-                if(c->mergedList)
+                if(dm->mergedList)
                 {
-                    if(c->mergedList->count()<minMergeCount)
-                    {
-                        finalPool.append(*c->mergedList);
-                        for(auto &cc:*c->mergedList)
-                            cc->m_parent=nullptr;
-                        delete c->mergedList;
-                        c->mergedList=nullptr;
-                    }
-                    else
-                    {
-                        statisInfo.mergeCount+=c->mergedList->count();
-                    }
+                    delete dm->mergedList;
+                    dm->mergedList=nullptr;
                 }
-                finalPool.append(c);
+                dm->m_parent=nullptr;
             }
-            bool merged=false;
-            for(int i=0;i<slideWindow.length();++i)
+            for(auto &group:snapshot->mergedGroups)
             {
-                DanmuComment *sw(slideWindow.at(i).data());
-                if(sw->type!=cc->type || qAbs(cc->text.length()-sw->text.length())>maxContentUnsimCount) continue;
-                if((cc->text==sw->text) || contentSimilar(cc,sw))
-                {
-                    Q_ASSERT(!(*iter)->mergedList);
-                    cc->m_parent=sw;
-                    if(!sw->mergedList) sw->mergedList=new QList<QSharedPointer<DanmuComment> >();
-                    sw->mergedList->append((*iter));
-                    merged=true;
-                    break;
-                }
+                group.first->mergedList=new QList<QSharedPointer<DanmuComment> >(group.second);
+                for(auto &c:group.second)
+                    c->m_parent=group.first.data();
             }
-            if(!merged)
+            finalPool=snapshot->finalPool;
+            danmuStore=snapshot->store;
+            finalHandles=snapshot->finalHandles;
+            if(retestRules)
             {
-                slideWindow.append((*iter));
+                danmuStore.syncBlockBy();
+                //comments added while the task ran were not in the store the rules were tested on
+                for(int ruleId:testedRules)
+                {
+                    BlockRule *rule=GlobalObjects::blocker->blockRule(ruleId);
+                    if(rule)
+                    {
+                        GlobalObjects::blocker->testBlockRule(danmuStore,rule);
+                        continue;
+                    }
+                    for(DanmuStore::Handle h=0;h<danmuStore.count();++h)
+                    {
+                        if(danmuStore.blockBy(h)==ruleId) danmuStore.setBlockBy(h,-1);
+                    }
+                }
             }
+            currentPosition = std::lower_bound(finalPool.begin(), finalPool.end(), currentTime, DanmuComparer) - finalPool.begin();
+            //the positions are in the new pool, the prefetched items are only held a while
+            prefetchPosition=currentPosition;
+            endResetModel();
         }
-        finalPool.append(slideWindow);
-        std::sort(finalPool.begin(),finalPool.end(),DanmuSPCompare);
-    }
-    else
-    {
-        finalPool=danmuPool;
+        statisInfo=snapshot->statisInfo;
+        //counted by the worker before the tests
+        if(retestRules)
+            statisInfo.blockCount=danmuStore.count()-danmuStore.blockByList().count(-1);
+        emit statisInfoChange();
+        if(snapshot->analyzed && enableAnalyze)
+            emit eventAnalyzeFinished(snapshot->events);
     }
-    currentPosition = std::lower_bound(finalPool.begin(), finalPool.end(), currentTime, DanmuComparer) - finalPool.begin();
-#ifdef QT_DEBUG
-    qDebug()<<"merge done:"<<timer.elapsed()<<"ms";
-#endif
-}
-
-bool DanmuPool::contentSimilar(const DanmuComment *dm1, const DanmuComment *dm2)
-{
-    static QVector<int> charSpace(1<<16);
-    int sz1=dm1->text.length(),sz2=dm2->text.length();
-    for(int i=0;i<sz1;++i) charSpace[dm1->text.at(i).unicode()]++;
-    for(int i=0;i<sz2;++i) charSpace[dm2->text.at(i).unicode()]--;
-    int diff=0;
-    for(int i=0;i<sz1;++i)
-    {
-        diff+=qAbs(charSpace[dm1->text.at(i).unicode()]);
-        charSpace[dm1->text.at(i).unicode()]=0;
-    }
-    for(int i=0;i<sz2;++i)
-    {
-        diff+=qAbs(charSpace[dm2->text.at(i).unicode()]);
-        charSpace[dm2->text.at(i).unicode()]=0;
-    }
-    return  diff<=maxContentUnsimCount;
-
-}
-
-void DanmuPool::setAnalyzation()
-{
-#ifdef QT_DEBUG
-    QElapsedTimer timer;
-    timer.start();
-#endif
-    emit eventAnalyzeFinished(enableAnalyze?analyzer->analyze(curPool):QList<DanmuEvent>());
-#ifdef QT_DEBUG
-    qDebug()<<"Analyze time:"<<timer.elapsed();
-#endif
+    testedRules.clear();
+    submitTask();
 }
 
 void DanmuPool::setConnect(Pool *pool)
@@ -237,64 +266,50 @@ void DanmuPool::setConnect(Pool *pool)
     //poolID=curPool->id();
     reset();
     curPool->setUsed(true);
+    ++poolVersion;
+    hasPendingTask=false;
     beginResetModel();
     danmuPool=curPool->comments();
-    setMerged();
-    setStatisInfo();
-    setAnalyzation();
+    for(auto iter=danmuPool.cbegin();iter!=danmuPool.cend();++iter)
+    {
+        if((*iter)->mergedList)
+        {
+            delete (*iter)->mergedList;
+            (*iter)->mergedList=nullptr;
+        }
+        (*iter)->m_parent=nullptr;
+    }
+    //shown unmerged until the worker publishes the merged pool
+    finalPool=danmuPool;
+    danmuStore.build(danmuPool);
+    finalHandles.resize(danmuStore.count());
+    std::iota(finalHandles.begin(),finalHandles.end(),0);
     endResetModel();
+    setStatisInfo();
+    requestUpdate(DanmuPoolTask::FullMerge,true);
     QObject::connect(curPool,&Pool::poolChanged,this,[this](bool ){
-        beginResetModel();
         danmuPool=curPool->comments();
-        setMerged();
-        setAnalyzation();
-        setStatisInfo();
-        endResetModel();
-        currentPosition = std::lower_bound(finalPool.begin(), finalPool.end(), currentTime, DanmuComparer) - finalPool.begin();
+        requestUpdate(DanmuPoolTask::FullMerge,true);
+    });
+    QObject::connect(curPool,&Pool::poolDanmuChanged,this,[this](const QList<QSharedPointer<DanmuComment> > &addedList, const QList<QSharedPointer<DanmuComment> > &removedList){
+        danmuPool=curPool->comments();
+        requestUpdate(DanmuPoolTask::IncrementalMerge,true,addedList,removedList);
     });
 }
 
 void DanmuPool::setStatisInfo()
 {
-    statisInfo.countOfMinute.clear();
-    statisInfo.maxCountOfMinute=0;
-    statisInfo.blockCount=0;
-    statisInfo.mergeCount=0;
-    statisInfo.totalCount=danmuPool.count();
-    int curMinuteCount=0;
-    int startTime=0;
-    for(auto iter=danmuPool.cbegin();iter!=danmuPool.cend();++iter)
-    {
-        if(iter==danmuPool.cbegin())
-        {
-            startTime=(*iter)->time;
-        }
-        if((*iter)->time-startTime<1000)
-            curMinuteCount++;
-        else
-        {
-            statisInfo.countOfMinute.append(QPair<int,int>(startTime/1000,curMinuteCount));
-            if(curMinuteCount>statisInfo.maxCountOfMinute)
-                statisInfo.maxCountOfMinute=curMinuteCount;
-            curMinuteCount=1;
-            startTime=(*iter)->time;
-        }
-        if((*iter)->blockBy!=-1)
-            statisInfo.blockCount++;
-        if((*iter)->mergedList)
-            statisInfo.mergeCount+=(*iter)->mergedList->count();
-    }
-	statisInfo.countOfMinute.append(QPair<int, int>(startTime / 1000, curMinuteCount));
-	if (curMinuteCount>statisInfo.maxCountOfMinute)
-		statisInfo.maxCountOfMinute = curMinuteCount;
+    DanmuPoolWorker::setStatisInfo(danmuStore.timeList(),danmuStore.blockByList(),finalPool.count(),statisInfo);
     emit statisInfoChange();
-
 }
 
 void DanmuPool::setAnalyzeEnable(bool enable)
 {
     enableAnalyze = enable;
-    setAnalyzation();
+    if(enableAnalyze)
+        requestUpdate(DanmuPoolTask::KeepMerged,true);
+    else
+        emit eventAnalyzeFinished(QList<DanmuEvent>());
 }
 
 void DanmuPool::setMergeEnable(bool enable)
@@ -302,20 +317,21 @@ void DanmuPool::setMergeEnable(bool enable)
     if(enable!=enableMerged)
     {
         enableMerged=enable;
-        beginResetModel();
-        setMerged();
-        endResetModel();
+        requestUpdate(DanmuPoolTask::FullMerge,false);
     }
 }
 
+void DanmuPool::setIncrementalMergeEnable(bool enable)
+{
+    enableIncrementalMerge=enable;
+}
+
 void DanmuPool::setMergeInterval(int val)
 {
     if(val!=mergeInterval)
     {
         mergeInterval=val;
-        beginResetModel();
-        setMerged();
-        endResetModel();
+        requestUpdate(DanmuPoolTask::FullMerge,false);
     }
 }
 
@@ -324,9 +340,7 @@ void DanmuPool::setMaxUnSimCount(int val)
     if(val!=maxContentUnsimCount)
     {
         maxContentUnsimCount=val;
-        beginResetModel();
-        setMerged();
-        endResetModel();
+        requestUpdate(DanmuPoolTask::FullMerge,false);
     }
 }
 
@@ -335,18 +349,29 @@ void DanmuPool::setMinMergeCount(int val)
     if(val!=minMergeCount)
     {
         minMergeCount=val;
-        beginResetModel();
-        setMerged();
-        endResetModel();
+        requestUpdate(DanmuPoolTask::FullMerge,false);
     }
 }
 
 void DanmuPool::setPoolID(const QString &pid)
 {
+    if(!loadingPoolId.isEmpty())
+    {
+        if(pid==loadingPoolId) return;
+        //the pool still being read is dropped when it comes
+        loadingPoolId.clear();
+    }
     if(pid==curPool->id()) return;
-    Pool *pool = GlobalObjects::danmuManager->getPool(pid);
-    if(pool) setConnect(pool);
-    else if(curPool!=emptyPool) setConnect(emptyPool);
+    //the comments of the last file are not shown while the pool is read
+    if(curPool!=emptyPool) setConnect(emptyPool);
+    if(pid.isEmpty()) return;
+    loadingPoolId=pid;
+    //a resumed position comes as a jump and moves the load focus
+    GlobalObjects::danmuManager->getPoolWindowed(pid, 0, this, [this,pid](Pool *pool){
+        if(pid!=loadingPoolId) return;
+        loadingPoolId.clear();
+        if(pool) setConnect(pool);
+    });
 }
 
 void DanmuPool::mediaTimeElapsed(int newTime)
@@ -356,26 +381,25 @@ void DanmuPool::mediaTimeElapsed(int newTime)
         QCoreApplication::instance()->processEvents();
         currentTime=newTime;
         currentPosition=std::lower_bound(finalPool.begin(),finalPool.end(),currentTime,DanmuComparer)-finalPool.begin();
+        prefetchPosition=currentPosition;
         return;
     }
     currentTime=newTime;
-    PrepareList *prepareList(nullptr);
-    prepareList=prepareListPool.isEmpty()?new PrepareList:prepareListPool.takeFirst();
-    const int bundleSize=32;
-    for(;currentPosition<finalPool.length();++currentPosition)
+    PrepareList *prepareList(takePrepareList());
+    for(;currentPosition<finalHandles.count();++currentPosition)
     {
-        int curTime=finalPool.at(currentPosition)->time;
+        DanmuStore::Handle h=finalHandles.at(currentPosition);
+        int curTime=danmuStore.time(h);
         if(curTime<0)continue;
         if(curTime<newTime)
         {
-            auto dm=finalPool.at(currentPosition);
-            if (dm->blockBy == -1 && curPool->sources()[dm->source].show)
+            if (danmuStore.blockBy(h) == -1 && curPool->sources()[danmuStore.source(h)].show)
 			{
-                prepareList->append(QPair<QSharedPointer<DanmuComment>,DanmuDrawInfo*>(dm,nullptr));
-                if(prepareList->size()>=bundleSize)
+                prepareList->append(QPair<QSharedPointer<DanmuComment>,DanmuDrawInfo*>(danmuStore.comment(h),nullptr));
+                if(prepareList->size()>=PrepareListBundleSize)
                 {
                     GlobalObjects::danmuRender->prepareDanmu(prepareList);
-                    prepareList=prepareListPool.isEmpty()?new PrepareList :prepareListPool.takeFirst();
+                    prepareList=takePrepareList();
                 }
 			}
         }
@@ -390,6 +414,36 @@ void DanmuPool::mediaTimeElapsed(int newTime)
 	{
 		recyclePrepareList(prepareList);
 	}
+    prefetch();
+}
+
+void DanmuPool::prefetch()
+{
+    if(prefetchPosition<currentPosition) prefetchPosition=currentPosition;
+    const int rasterCost=GlobalObjects::danmuRender->rasterCost();
+    const int maxCount=qBound(1,PrefetchBudget/(rasterCost>0?rasterCost:DefaultRasterCost),MaxPrefetchCount);
+    const int end=qMin(finalHandles.count(),currentPosition+maxCount);
+    QList<QSharedPointer<DanmuComment> > prefetchList;
+    for(;prefetchPosition<end;++prefetchPosition)
+    {
+        DanmuStore::Handle h=finalHandles.at(prefetchPosition);
+        int curTime=danmuStore.time(h);
+        if(curTime>=currentTime+MaxLookAhead) break;
+        if(curTime<0) continue;
+        if(danmuStore.blockBy(h)==-1 && curPool->sources()[danmuStore.source(h)].show)
+            prefetchList.append(danmuStore.comment(h));
+    }
+    if(!prefetchList.isEmpty())
+        GlobalObjects::danmuRender->prefetchDanmu(prefetchList);
+}
+
+PrepareList *DanmuPool::takePrepareList()
+{
+    if(!prepareListPool.isEmpty()) return prepareListPool.takeLast();
+    PrepareList *list=new PrepareList;
+    list->reserve(PrepareListBundleSize);
+    ++prepareListCount;
+    return list;
 }
 
 void DanmuPool::mediaTimeJumped(int newTime)
@@ -399,6 +453,8 @@ void DanmuPool::mediaTimeJumped(int newTime)
 #endif
     currentTime=newTime;
     currentPosition=std::lower_bound(finalPool.begin(),finalPool.end(),newTime,DanmuComparer)-finalPool.begin();
+    prefetchPosition=currentPosition;
+    curPool->setLoadFocus(newTime);
     GlobalObjects::danmuRender->cleanup();
 #ifdef QT_DEBUG
     qDebug()<<"pool:media time jumped,currentPos"<<currentPosition;
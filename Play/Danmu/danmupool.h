@@ -3,16 +3,8 @@
 
 #include <QAbstractItemModel>
 #include "common.h"
-struct StatisInfo
-{
-    QList<QPair<int,int> > countOfMinute;
-    int maxCountOfMinute;
-    int totalCount;
-    int blockCount;
-    int mergeCount;
-};
+#include "danmupoolworker.h"
 class Pool;
-class EventAnalyzer;
 class DanmuPool : public QAbstractItemModel
 {
     Q_OBJECT
@@ -20,14 +12,15 @@ public:
     explicit DanmuPool(QObject *parent = nullptr);
     virtual ~DanmuPool();
 
-    inline bool hasPool() const {return curPool!=emptyPool;}
+    inline bool hasPool() const {return curPool!=emptyPool || !loadingPoolId.isEmpty();}
     //inline QString getPoolID() const { return poolID; }
     inline QModelIndex getCurrentIndex(){return (currentPosition >= 0 && currentPosition < finalPool.count())?createIndex(currentPosition, 0,finalPool.at(currentPosition).data()):QModelIndex();}
     inline void recyclePrepareList(PrepareList *list){list->clear();prepareListPool.append(list);}
+    inline int prepareListAllocCount() const {return prepareListCount;}
     inline bool isEmpty() const{return danmuPool.isEmpty();}
     inline int totalCount() const {return danmuPool.count();}
     inline const StatisInfo &getStatisInfo(){return statisInfo;}
-    inline void reset(){currentTime=0;currentPosition=0;}
+    inline void reset(){currentTime=0;currentPosition=0;prefetchPosition=0;}
     inline Pool *getPool() {return curPool;}
 
     QSharedPointer<DanmuComment> getDanmu(const QModelIndex &index);
@@ -35,29 +28,52 @@ public:
 
 private:
     Pool *curPool,*emptyPool;
+    //set while the pool is read, it is connected once loaded
+    QString loadingPoolId;
     QList<QSharedPointer<DanmuComment> > danmuPool;
     QList<QSharedPointer<DanmuComment> > finalPool;
-    QLinkedList<PrepareList *> prepareListPool;
+    //columns of the published comments, finalHandles runs parallel to finalPool
+    DanmuStore danmuStore;
+    QVector<DanmuStore::Handle> finalHandles;
+    //ids of the rules tested while a task runs, tested again on the store it publishes
+    QList<int> testedRules;
+    //recycled lists keep their capacity, new lists are only created when all are in flight
+    QVector<PrepareList *> prepareListPool;
+    int prepareListCount;
     StatisInfo statisInfo;
-    EventAnalyzer *analyzer;
+    QThread *poolThread;
+    DanmuPoolWorker *worker;
+    int poolVersion;
+    bool taskRunning;
+    bool hasPendingTask;
+    DanmuPoolTask pendingTask;
     int currentPosition;
+    //next comment to prefetch, never behind currentPosition
+    int prefetchPosition;
     int currentTime;
    // QString poolID;
 
     bool enableAnalyze;
     bool enableMerged;
+    bool enableIncrementalMerge;
     int mergeInterval; //ms
     int maxContentUnsimCount;
     int minMergeCount;
-    void setMerged();
-    bool contentSimilar(const DanmuComment *dm1, const DanmuComment *dm2);
-    void setAnalyzation();
+    void requestUpdate(DanmuPoolTask::MergeMode mode, bool analyze,
+                       const QList<QSharedPointer<DanmuComment> > &addedList=QList<QSharedPointer<DanmuComment> >(),
+                       const QList<QSharedPointer<DanmuComment> > &removedList=QList<QSharedPointer<DanmuComment> >());
+    void submitTask();
+    void publishSnapshot(QSharedPointer<DanmuPoolSnapshot> snapshot);
     void setConnect(Pool *pool);
+    PrepareList *takePrepareList();
+    void prefetch();
 
     void setStatisInfo();
+    friend class DanmuBenchmark;
 public:
     void setAnalyzeEnable(bool enable);
     void setMergeEnable(bool enable);
+    void setIncrementalMergeEnable(bool enable);
     void setMergeInterval(int val);
     void setMaxUnSimCount(int val);
     void setMinMergeCount(int val);
@@ -0,0 +1,297 @@
+#include "danmupoolworker.h"
+#include <limits>
+#include <numeric>
+#include "eventanalyzer.h"
+#include "mergewindow.h"
+
+DanmuPoolWorker::DanmuPoolWorker(QObject *parent) : QObject(parent),
+    lastVersion(-1),lastMerged(false)
+{
+    analyzer=new EventAnalyzer(this);
+}
+
+QSharedPointer<DanmuPoolSnapshot> DanmuPoolWorker::process(const DanmuPoolTask &task)
+{
+    QSharedPointer<DanmuPoolSnapshot> snapshot(new DanmuPoolSnapshot);
+    snapshot->version=task.version;
+    snapshot->merged=false;
+    snapshot->analyzed=false;
+    snapshot->finalPool=task.finalPool;
+    snapshot->finalHandles=task.finalHandles;
+    DanmuPoolTask::MergeMode mode=task.mode;
+    int changedBegin=0, changedEnd=0;
+    if(mode==DanmuPoolTask::IncrementalMerge)
+    {
+        //fall back to the full merge when the merge state is not built from the previous comments
+        //or when most of the pool is touched anyway
+        const int count=task.comments.count();
+        const int lastCount=lastStore.count();
+        int changedCount=task.addedList.count()+task.removedList.count();
+        if(task.version!=lastVersion || !task.enableMerged || !lastMerged
+                || count!=lastCount+task.addedList.count()-task.removedList.count()
+                || changedCount*2>=qMax(lastCount,count)
+                || !mergeIncremental(task,*snapshot,changedBegin,changedEnd))
+            mode=DanmuPoolTask::FullMerge;
+    }
+    if(mode!=DanmuPoolTask::KeepMerged)
+    {
+        if(mode==DanmuPoolTask::FullMerge)
+        {
+            merge(task,*snapshot);
+            snapshot->store.build(task.comments,task.times,task.blockBys);
+        }
+        else
+        {
+            const int delta=task.comments.count()-lastStore.count();
+            snapshot->store.splice(lastStore,changedBegin,changedEnd-delta,task.comments,changedEnd,task.times,task.blockBys);
+        }
+        snapshot->merged=true;
+        lastStore=snapshot->store;
+        lastVersion=task.version;
+        lastMerged=task.enableMerged;
+    }
+    setStatisInfo(task.times,task.blockBys,snapshot->finalPool.count(),snapshot->statisInfo);
+    if(task.analyze)
+    {
+#ifdef QT_DEBUG
+        QElapsedTimer timer;
+        timer.start();
+#endif
+        snapshot->events=analyzer->analyze(task.comments,task.times,task.blockBys);
+        snapshot->analyzed=true;
+#ifdef QT_DEBUG
+        qDebug()<<"Analyze time:"<<timer.elapsed();
+#endif
+    }
+    return snapshot;
+}
+
+void DanmuPoolWorker::setStatisInfo(const QVector<int> &times, const QVector<int> &blockBys, int finalCount, StatisInfo &statisInfo)
+{
+    statisInfo.countOfMinute.clear();
+    statisInfo.maxCountOfMinute=0;
+    statisInfo.blockCount=0;
+    statisInfo.mergeCount=times.count()-finalCount;
+    statisInfo.totalCount=times.count();
+    int curMinuteCount=0;
+    int startTime=times.isEmpty()?0:times.first();
+    for(int i=0;i<times.count();++i)
+    {
+        if(times.at(i)-startTime<1000)
+            curMinuteCount++;
+        else
+        {
+            statisInfo.countOfMinute.append(QPair<int,int>(startTime/1000,curMinuteCount));
+            if(curMinuteCount>statisInfo.maxCountOfMinute)
+                statisInfo.maxCountOfMinute=curMinuteCount;
+            curMinuteCount=1;
+            startTime=times.at(i);
+        }
+        if(blockBys.at(i)!=-1)
+            statisInfo.blockCount++;
+    }
+    statisInfo.countOfMinute.append(QPair<int, int>(startTime / 1000, curMinuteCount));
+    if (curMinuteCount>statisInfo.maxCountOfMinute)
+        statisInfo.maxCountOfMinute = curMinuteCount;
+}
+
+void DanmuPoolWorker::merge(const DanmuPoolTask &task, DanmuPoolSnapshot &snapshot)
+{
+#ifdef QT_DEBUG
+    qDebug()<<"merge start";
+    QElapsedTimer timer;
+    timer.start();
+#endif
+    const int count=task.comments.count();
+    keptRoots.clear();
+    mergeRoots.fill(-1,count);
+    snapshot.finalPool.clear();
+    snapshot.finalHandles.clear();
+    if(task.enableMerged)
+    {
+        MergeWindow slideWindow(task.maxUnsimCount);
+        mergeForward(task,0,slideWindow,std::numeric_limits<int>::max());
+        regroup(task,0,count,count,snapshot,snapshot.finalPool,snapshot.finalHandles);
+    }
+    else
+    {
+        //every comment is a root now, clear the groups left in the published pool
+        snapshot.resetList=task.comments;
+        snapshot.finalPool=task.comments;
+        snapshot.finalHandles.resize(count);
+        std::iota(snapshot.finalHandles.begin(),snapshot.finalHandles.end(),0);
+    }
+#ifdef QT_DEBUG
+    qDebug()<<"merge done:"<<timer.elapsed()<<"ms";
+#endif
+}
+
+bool DanmuPoolWorker::mergeIncremental(const DanmuPoolTask &task, DanmuPoolSnapshot &snapshot, int &changedBegin, int &changedEnd)
+{
+    changedBegin=changedEnd=0;
+    if(task.addedList.isEmpty() && task.removedList.isEmpty()) return true;
+    const QList<QSharedPointer<DanmuComment> > &comments=task.comments;
+    const QVector<int> &times=task.times;
+    const int count=comments.count();
+    const int delta=count-lastStore.count();
+    const int minTime=task.minChangedTime, maxTime=task.maxChangedTime;
+    const int start=std::lower_bound(times.begin(), times.end(), minTime) - times.begin();
+    changedBegin=start;
+    changedEnd=std::upper_bound(times.begin()+start, times.end(), maxTime) - times.begin();
+    //merge roots and handles outside the changed range are carried over by position, the comments
+    //there have to be the same ones in the same order as last time
+    if(changedEnd-delta<start || !sameComments(task,0,0,start)
+            || !sameComments(task,changedEnd,changedEnd-delta,count-changedEnd))
+        return false;
+#ifdef QT_DEBUG
+    qDebug()<<"incremental merge start, add:"<<task.addedList.count()<<"remove:"<<task.removedList.count();
+    QElapsedTimer timer;
+    timer.start();
+#endif
+    const int mergeInterval=task.mergeInterval;
+    for(const auto &dm:task.removedList)
+        keptRoots.remove(dm.data());
+    snapshot.resetList=task.removedList;
+
+    //decisions in the changed range are unknown, they are all made again below
+    const int oldChangedEnd=changedEnd-delta;
+    QVector<int> roots(count);
+    std::copy(mergeRoots.cbegin(), mergeRoots.cbegin()+start, roots.begin());
+    std::fill(roots.begin()+start, roots.begin()+changedEnd, -1);
+    for(int i=changedEnd;i<count;++i)
+    {
+        const int root=mergeRoots.at(i-delta);
+        roots[i]=root>=oldChangedEnd?root+delta:root;
+    }
+    mergeRoots.swap(roots);
+
+    //Comments before minTime keep their merge decision, roots in [minTime-mergeInterval, minTime)
+    //are still in the slide window when the first dirty comment arrives
+    const int begin=std::lower_bound(times.begin(), times.begin()+start, minTime-mergeInterval) - times.begin();
+    MergeWindow slideWindow(task.maxUnsimCount);
+    for(int i=begin;i<start;++i)
+    {
+        if(mergeRoots.at(i)==-1) slideWindow.append(comments.at(i).data(),times.at(i),i);
+    }
+    int rootEnd=mergeForward(task,start,slideWindow,maxTime);
+    //groups of roots before rootEnd may have changed, their members are all before boundTime
+    int boundTime=rootEnd<count?times.at(rootEnd)+mergeInterval+1:std::numeric_limits<int>::max();
+    int end=rootEnd<count?std::lower_bound(times.begin()+rootEnd, times.end(), boundTime) - times.begin():count;
+    QList<QSharedPointer<DanmuComment> > segment;
+    QVector<DanmuStore::Handle> segmentHandles;
+    regroup(task,begin,rootEnd,end,snapshot,segment,segmentHandles);
+
+    //the published pool is located by the times of the last merge, the same for comments outside the changed range
+    const QVector<DanmuStore::Handle> &finalHandles=task.finalHandles;
+    const auto handleTimeLess=[this](DanmuStore::Handle h, int time){return lastStore.time(h)<time;};
+    int fBegin=std::lower_bound(finalHandles.begin(), finalHandles.end(), minTime-mergeInterval, handleTimeLess) - finalHandles.begin();
+    int fEnd=rootEnd<count?std::lower_bound(finalHandles.begin()+fBegin, finalHandles.end(), boundTime, handleTimeLess) - finalHandles.begin():finalHandles.count();
+    QList<QSharedPointer<DanmuComment> > newFinalPool;
+    QVector<DanmuStore::Handle> newFinalHandles;
+    const int newCount=fBegin+segment.count()+finalHandles.count()-fEnd;
+    newFinalPool.reserve(newCount);
+    newFinalHandles.reserve(newCount);
+    for(int i=0;i<fBegin;++i)
+    {
+        newFinalPool.append(task.finalPool.at(i));
+        newFinalHandles.append(finalHandles.at(i));
+    }
+    newFinalPool.append(segment);
+    newFinalHandles.append(segmentHandles);
+    for(int i=fEnd;i<finalHandles.count();++i)
+    {
+        newFinalPool.append(task.finalPool.at(i));
+        newFinalHandles.append(finalHandles.at(i)+delta);
+    }
+    snapshot.finalPool.swap(newFinalPool);
+    snapshot.finalHandles.swap(newFinalHandles);
+#ifdef QT_DEBUG
+    qDebug()<<"incremental merge done:"<<timer.elapsed()<<"ms, re-merged:"<<rootEnd-start<<", spliced:"<<segment.count();
+#endif
+    return true;
+}
+
+int DanmuPoolWorker::mergeForward(const DanmuPoolTask &task, int start, MergeWindow &slideWindow, int dirtyEndTime)
+{
+    //Once we are past dirtyEndTime and the roots in the whole window are the same as last time,
+    //the remaining decisions can not change any more
+    const QList<QSharedPointer<DanmuComment> > &comments=task.comments;
+    const QVector<int> &times=task.times;
+    int lastChangedTime=dirtyEndTime;
+    for(int i=start;i<comments.count();++i)
+    {
+        const int time=times.at(i);
+        if(time>dirtyEndTime && time-lastChangedTime>task.mergeInterval) return i;
+        slideWindow.evict(time,task.mergeInterval);
+        const DanmuComment *cc(comments.at(i).data());
+        const int root=slideWindow.findSimilar(cc);
+        if((mergeRoots.at(i)==-1)!=(root==-1)) lastChangedTime=qMax(lastChangedTime,time);
+        mergeRoots[i]=root;
+        if(root==-1) slideWindow.append(cc,time,i);
+    }
+    return comments.count();
+}
+
+void DanmuPoolWorker::regroup(const DanmuPoolTask &task, int begin, int rootEnd, int end, DanmuPoolSnapshot &snapshot,
+                              QList<QSharedPointer<DanmuComment> > &segment, QVector<DanmuStore::Handle> &segmentHandles)
+{
+    const QList<QSharedPointer<DanmuComment> > &comments=task.comments;
+    QHash<int, QList<QSharedPointer<DanmuComment> > > groups;
+    for(int i=begin;i<rootEnd;++i)
+    {
+        if(mergeRoots.at(i)==-1)
+        {
+            groups.insert(i,QList<QSharedPointer<DanmuComment> >());
+            keptRoots.remove(comments.at(i).data());
+        }
+    }
+    //only the recomputed roots and their members need to be reset, comments merged into
+    //earlier roots keep their groups
+    for(int i=begin;i<end;++i)
+    {
+        const QSharedPointer<DanmuComment> &dm=comments.at(i);
+        const int root=mergeRoots.at(i);
+        if(root==-1)
+        {
+            if(groups.contains(i)) snapshot.resetList.append(dm);
+            continue;
+        }
+        auto iter=groups.find(root);
+        if(iter!=groups.end())
+        {
+            iter.value().append(dm);
+            snapshot.resetList.append(dm);
+        }
+    }
+    for(int i=begin;i<rootEnd;++i)
+    {
+        if(mergeRoots.at(i)!=-1) continue;
+        const QSharedPointer<DanmuComment> &dm=comments.at(i);
+        const QList<QSharedPointer<DanmuComment> > &members=groups[i];
+        if(!members.isEmpty() && members.count()>=task.minMergeCount)
+        {
+            keptRoots.insert(dm.data());
+            snapshot.mergedGroups.append(qMakePair(dm,members));
+        }
+    }
+    segment.reserve(segment.count()+end-begin);
+    segmentHandles.reserve(segmentHandles.count()+end-begin);
+    for(int i=begin;i<end;++i)
+    {
+        const int root=mergeRoots.at(i);
+        if(root==-1 || !keptRoots.contains(comments.at(root).data()))
+        {
+            segment.append(comments.at(i));
+            segmentHandles.append(i);
+        }
+    }
+}
+
+bool DanmuPoolWorker::sameComments(const DanmuPoolTask &task, int begin, int oldBegin, int count) const
+{
+    for(int i=0;i<count;++i)
+    {
+        if(task.comments.at(begin+i)!=lastStore.comment(oldBegin+i)) return false;
+    }
+    return true;
+}
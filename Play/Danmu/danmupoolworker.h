@@ -0,0 +1,92 @@
+#ifndef DANMUPOOLWORKER_H
+#define DANMUPOOLWORKER_H
+#include <QObject>
+#include <QSet>
+#include "common.h"
+#include "danmustore.h"
+struct StatisInfo
+{
+    QList<QPair<int,int> > countOfMinute;
+    int maxCountOfMinute;
+    int totalCount;
+    int blockCount;
+    int mergeCount;
+};
+struct DanmuPoolTask
+{
+    //ordered by cost, pending tasks are coalesced to the larger mode
+    enum MergeMode
+    {
+        KeepMerged,
+        IncrementalMerge,
+        FullMerge
+    };
+    int version;
+    MergeMode mode;
+    QList<QSharedPointer<DanmuComment> > comments;
+    //time and blockBy of comments taken when the task is submitted, the main thread keeps changing
+    //them on the comments(delay, timeline, block rules), the worker only reads these copies
+    QVector<int> times;
+    QVector<int> blockBys;
+    QList<QSharedPointer<DanmuComment> > finalPool; //currently published
+    QVector<DanmuStore::Handle> finalHandles;       //of finalPool, in the store of the last merge
+    QList<QSharedPointer<DanmuComment> > addedList;
+    QList<QSharedPointer<DanmuComment> > removedList;
+    //time range of the added and removed comments
+    int minChangedTime;
+    int maxChangedTime;
+    bool enableMerged;
+    int mergeInterval;
+    int maxUnsimCount;
+    int minMergeCount;
+    bool analyze;
+};
+/*
+ * Result of a DanmuPoolTask. The worker never touches the comments, only reads the fields that do
+ * not change(text, type...), the main thread resets mergedList/m_parent of the comments in resetList
+ * and applies mergedGroups when the snapshot is published
+ */
+struct DanmuPoolSnapshot
+{
+    int version;
+    bool merged;
+    QList<QSharedPointer<DanmuComment> > finalPool;
+    //columns of the comments and the handle of each finalPool item, only built when merged
+    DanmuStore store;
+    QVector<DanmuStore::Handle> finalHandles;
+    QList<QSharedPointer<DanmuComment> > resetList;
+    QList<QPair<QSharedPointer<DanmuComment>,QList<QSharedPointer<DanmuComment> > > > mergedGroups;
+    StatisInfo statisInfo;
+    bool analyzed;
+    QList<DanmuEvent> events;
+};
+class EventAnalyzer;
+class MergeWindow;
+class DanmuPoolWorker : public QObject
+{
+public:
+    explicit DanmuPoolWorker(QObject *parent = nullptr);
+    QSharedPointer<DanmuPoolSnapshot> process(const DanmuPoolTask &task);
+    //times and blockBys are sorted by time
+    static void setStatisInfo(const QVector<int> &times, const QVector<int> &blockBys, int finalCount, StatisInfo &statisInfo);
+private:
+    EventAnalyzer *analyzer;
+    //merge state of the last processed task
+    int lastVersion;
+    bool lastMerged;
+    QSet<DanmuComment *> keptRoots;
+    //comments of the last merge, the handles of the next task are positions in it
+    DanmuStore lastStore;
+    //parallel to the comments of the last merge, position of the comment each one was merged into,
+    //kept even if the group is dissolved later(less than minMergeCount), -1 for a window root
+    QVector<int> mergeRoots;
+
+    void merge(const DanmuPoolTask &task, DanmuPoolSnapshot &snapshot);
+    //[changedBegin, changedEnd): comments that are not carried over from the last merge
+    bool mergeIncremental(const DanmuPoolTask &task, DanmuPoolSnapshot &snapshot, int &changedBegin, int &changedEnd);
+    int mergeForward(const DanmuPoolTask &task, int start, MergeWindow &slideWindow, int dirtyEndTime);
+    void regroup(const DanmuPoolTask &task, int begin, int rootEnd, int end, DanmuPoolSnapshot &snapshot,
+                 QList<QSharedPointer<DanmuComment> > &segment, QVector<DanmuStore::Handle> &segmentHandles);
+    bool sameComments(const DanmuPoolTask &task, int begin, int oldBegin, int count) const;
+};
+#endif // DANMUPOOLWORKER_H
@@ -0,0 +1,131 @@
+#include "danmustore.h"
+#include <algorithm>
+namespace
+{
+    template<typename T>
+    void copyHead(QVector<T> &column, const QVector<T> &base, int begin, int capacity)
+    {
+        column=base.mid(0,begin);
+        column.reserve(capacity);
+    }
+    template<typename T>
+    void copyTail(QVector<T> &column, const QVector<T> &base, int baseEnd)
+    {
+        if(baseEnd<base.count()) column.append(base.mid(baseEnd));
+    }
+}
+
+void DanmuStore::clear()
+{
+    times.clear();
+    colors.clear();
+    sources.clear();
+    blockBys.clear();
+    types.clear();
+    fontSizeLevels.clear();
+    textIds.clear();
+    senderIds.clear();
+    strings.clear();
+    stringIds.clear();
+    refs.clear();
+}
+
+void DanmuStore::build(const QList<QSharedPointer<DanmuComment> > &comments)
+{
+    clear();
+    reserve(comments.count());
+    for(const auto &danmu:comments)
+        append(danmu);
+}
+
+void DanmuStore::build(const QList<QSharedPointer<DanmuComment> > &comments, const QVector<int> &timeList, const QVector<int> &blockByList)
+{
+    Q_ASSERT(timeList.count()==comments.count() && blockByList.count()==comments.count());
+    clear();
+    reserve(comments.count());
+    for(const auto &danmu:comments)
+        appendFixed(danmu);
+    times=timeList;
+    blockBys=blockByList;
+}
+
+void DanmuStore::splice(const DanmuStore &base, int begin, int baseEnd, const QList<QSharedPointer<DanmuComment> > &comments, int end,
+                        const QVector<int> &timeList, const QVector<int> &blockByList)
+{
+    Q_ASSERT(timeList.count()==comments.count() && comments.count()-end==base.count()-baseEnd);
+    //strings of removed rows are kept until the next build
+    strings=base.strings;
+    stringIds=base.stringIds;
+    copyHead(colors,base.colors,begin,comments.count());
+    copyHead(sources,base.sources,begin,comments.count());
+    copyHead(types,base.types,begin,comments.count());
+    copyHead(fontSizeLevels,base.fontSizeLevels,begin,comments.count());
+    copyHead(textIds,base.textIds,begin,comments.count());
+    copyHead(senderIds,base.senderIds,begin,comments.count());
+    copyHead(refs,base.refs,begin,comments.count());
+    for(int i=begin;i<end;++i)
+        appendFixed(comments.at(i));
+    copyTail(colors,base.colors,baseEnd);
+    copyTail(sources,base.sources,baseEnd);
+    copyTail(types,base.types,baseEnd);
+    copyTail(fontSizeLevels,base.fontSizeLevels,baseEnd);
+    copyTail(textIds,base.textIds,baseEnd);
+    copyTail(senderIds,base.senderIds,baseEnd);
+    copyTail(refs,base.refs,baseEnd);
+    times=timeList;
+    blockBys=blockByList;
+}
+
+DanmuStore::Handle DanmuStore::append(const QSharedPointer<DanmuComment> &danmu)
+{
+    times.append(danmu->time);
+    blockBys.append(danmu->blockBy);
+    appendFixed(danmu);
+    return refs.count()-1;
+}
+
+int DanmuStore::lowerBound(int time) const
+{
+    return std::lower_bound(times.cbegin(),times.cend(),time)-times.cbegin();
+}
+
+void DanmuStore::syncBlockBy()
+{
+    for(int i=0;i<refs.count();++i)
+        blockBys[i]=refs.at(i)->blockBy;
+}
+
+int DanmuStore::stringId(const QString &str)
+{
+    auto iter=stringIds.constFind(str.constData());
+    if(iter!=stringIds.cend()) return iter.value();
+    int id=strings.count();
+    strings.append(str);
+    stringIds.insert(str.constData(),id);
+    return id;
+}
+
+void DanmuStore::reserve(int count)
+{
+    times.reserve(count);
+    colors.reserve(count);
+    sources.reserve(count);
+    blockBys.reserve(count);
+    types.reserve(count);
+    fontSizeLevels.reserve(count);
+    textIds.reserve(count);
+    senderIds.reserve(count);
+    refs.reserve(count);
+}
+
+void DanmuStore::appendFixed(const QSharedPointer<DanmuComment> &danmu)
+{
+    //fields that do not change once the comment is in a pool, safe to read from any thread
+    colors.append(danmu->color);
+    sources.append(danmu->source);
+    types.append(quint8(danmu->type));
+    fontSizeLevels.append(quint8(danmu->fontSizeLevel));
+    textIds.append(stringId(danmu->text));
+    senderIds.append(stringId(danmu->sender));
+    refs.append(danmu);
+}
@@ -0,0 +1,93 @@
+#ifndef DANMUSTORE_H
+#define DANMUSTORE_H
+#include "common.h"
+/*
+ * Interned text/sender strings of a Pool. Comments with the same text or sender
+ * share one string buffer, which is also what DanmuStore uses to number strings
+ */
+class DanmuStringPool
+{
+public:
+    inline QString intern(const QString &str)
+    {
+        auto iter=strings.constFind(str);
+        if(iter!=strings.cend()) return *iter;
+        strings.insert(str);
+        return str;
+    }
+    inline void intern(DanmuComment *danmu)
+    {
+        danmu->text=intern(danmu->text);
+        danmu->sender=intern(danmu->sender);
+    }
+    inline int count() const {return strings.count();}
+    inline void clear() {strings.clear();}
+private:
+    QSet<QString> strings;
+};
+/*
+ * Read-optimised index kept next to a time-ordered comment list, the comments stay the owners
+ * of their data. Scans(block rules, statistics, the event analyzer) read the columns here instead
+ * of chasing comment pointers, at the cost of a second copy of the scanned fields.
+ * It does not replace the shared comments: Pool, DanmuPool and the renderer still keep and pass
+ * QSharedPointer<DanmuComment>, so the store adds memory, only DanmuStringPool saves some.
+ * A handle is the position of a comment in the store and stays valid until the store is rebuilt.
+ * Text and sender are numbered by their string buffer, so interned duplicates get the same id
+ * and per-string work(e.g. block rules) only needs to be done once for each id
+ */
+class DanmuStore
+{
+public:
+    typedef int Handle;
+
+    void clear();
+    void build(const QList<QSharedPointer<DanmuComment> > &comments);
+    //time and blockBy are taken from the lists instead of the comments, they run parallel to comments
+    void build(const QList<QSharedPointer<DanmuComment> > &comments, const QVector<int> &timeList, const QVector<int> &blockByList);
+    //comments outside [begin, end) are the rows of base outside [begin, baseEnd), only the rows between are built
+    void splice(const DanmuStore &base, int begin, int baseEnd, const QList<QSharedPointer<DanmuComment> > &comments, int end,
+                const QVector<int> &timeList, const QVector<int> &blockByList);
+    Handle append(const QSharedPointer<DanmuComment> &danmu);
+    int lowerBound(int time) const;
+
+    inline int count() const {return refs.count();}
+    inline bool isEmpty() const {return refs.isEmpty();}
+    inline int time(Handle h) const {return times.at(h);}
+    inline int color(Handle h) const {return colors.at(h);}
+    inline int source(Handle h) const {return sources.at(h);}
+    inline int blockBy(Handle h) const {return blockBys.at(h);}
+    inline DanmuComment::DanmuType type(Handle h) const {return DanmuComment::DanmuType(types.at(h));}
+    inline DanmuComment::FontSizeLevel fontSizeLevel(Handle h) const {return DanmuComment::FontSizeLevel(fontSizeLevels.at(h));}
+    inline int textId(Handle h) const {return textIds.at(h);}
+    inline int senderId(Handle h) const {return senderIds.at(h);}
+    inline const QString &text(Handle h) const {return strings.at(textIds.at(h));}
+    inline const QString &sender(Handle h) const {return strings.at(senderIds.at(h));}
+    inline const QSharedPointer<DanmuComment> &comment(Handle h) const {return refs.at(h);}
+    inline const QVector<int> &timeList() const {return times;}
+    inline const QVector<int> &blockByList() const {return blockBys;}
+
+    inline int stringCount() const {return strings.count();}
+    inline const QString &string(int id) const {return strings.at(id);}
+
+    inline void setBlockBy(Handle h, int ruleId) {blockBys[h]=ruleId; refs.at(h)->blockBy=ruleId;}
+    //pick up blockBy changed on the comments after the store was built
+    void syncBlockBy();
+private:
+    QVector<int> times;
+    QVector<int> colors;
+    QVector<int> sources;
+    QVector<int> blockBys;
+    QVector<quint8> types;
+    QVector<quint8> fontSizeLevels;
+    QVector<int> textIds;
+    QVector<int> senderIds;
+    QVector<QString> strings;
+    QHash<const QChar *, int> stringIds;
+    QVector<QSharedPointer<DanmuComment> > refs;
+
+    int stringId(const QString &str);
+    void reserve(int count);
+    void appendFixed(const QSharedPointer<DanmuComment> &danmu);
+};
+
+#endif // DANMUSTORE_H
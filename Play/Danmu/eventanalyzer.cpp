@@ -1,5 +1,4 @@
 #include "eventanalyzer.h"
-#include "Manager/pool.h"
 #include <algorithm>
 namespace
 {
@@ -16,42 +15,47 @@ namespace
         std_dev = std::sqrt(sq_sum / slice_size);
     }
 }
-EventAnalyzer::EventAnalyzer(QObject *parent):QObject(parent),curPool(nullptr),lag(30),threshold(3.f),influence(0.1f),
+EventAnalyzer::EventAnalyzer(QObject *parent):QObject(parent),curComments(nullptr),curTimes(nullptr),curBlockBys(nullptr),lag(30),threshold(3.f),influence(0.1f),
     iterations(20),c(1e-4f),d(0.85f)
 {
     qRegisterMetaType<DanmuEvent>("DanmuEvent");
     qRegisterMetaType<QList<DanmuEvent> >("QList<DanmuEvent>");
 }
 
-QList<DanmuEvent> EventAnalyzer::analyze(Pool *pool)
+QList<DanmuEvent> EventAnalyzer::analyze(const QList<QSharedPointer<DanmuComment> > &comments, const QVector<int> &times, const QVector<int> &blockBys)
 {
-    if(!pool) return QList<DanmuEvent>();
-    // Assert that the pool has been sorted
-    curPool = pool;
-    int count = curPool->comments().count();
+    // Assert that the comments have been sorted
+    curComments = &comments;
+    curTimes = &times;
+    curBlockBys = &blockBys;
+    int count = comments.count();
     do
     {
         if(count == 0) break;
-        int duration = curPool->comments().last()->time / 1000;
+        int duration = times.last() / 1000;
         // if there is not enough danmu, we do not perform analyzing
         if(count < duration) break;
         moveAverage();
-        return postProcess(zScoreThresholding());
+        QList<DanmuEvent> eventList(postProcess(zScoreThresholding()));
+        curComments = nullptr;
+        curTimes = curBlockBys = nullptr;
+        return eventList;
     }while(false);
-    curPool = nullptr;
+    curComments = nullptr;
+    curTimes = curBlockBys = nullptr;
     return QList<DanmuEvent>();
 }
 
 void EventAnalyzer::moveAverage()
 {
-    auto &comments = curPool->comments();
-    int count = comments.size();
+    auto &times = *curTimes;
+    int count = times.size();
     const int mergeInterval = 1000;
     QVector<int> countSerise;
     int i = 0, curCount=0, curTime=0;
     while(i<count)
     {
-        if(comments.at(i)->time - curTime < mergeInterval)
+        if(times.at(i) - curTime < mergeInterval)
         {
             ++curCount;
             ++i;
@@ -165,16 +169,16 @@ void EventAnalyzer::setEventDescription(QList<DanmuEvent> &eventList)
 
 QStringList EventAnalyzer::getDanmuRange(const DanmuEvent &dmEvent)
 {
-    Q_ASSERT(curPool);
+    Q_ASSERT(curComments);
     QStringList dmList;
-    auto &comments = curPool->comments();
-    int position=std::lower_bound(comments.begin(),comments.end(),dmEvent.start,
-                 [](const QSharedPointer<DanmuComment> &danmu,int time){return danmu->time<time;})-comments.begin();
+    auto &comments = *curComments;
+    auto &times = *curTimes;
+    int position=std::lower_bound(times.begin(),times.end(),dmEvent.start)-times.begin();
     int m_t = dmEvent.start+dmEvent.duration;
     for (;position<comments.count();++position)
     {
         auto &dm = comments.at(position);
-        if(dm->time<m_t && !dm->text.isEmpty() && dm->blockBy==-1)
+        if(times.at(position)<m_t && !dm->text.isEmpty() && curBlockBys->at(position)==-1)
         {
             dmList<<dm->text;
         }
@@ -249,7 +253,7 @@ QString EventAnalyzer::textRank(const QStringList &dmList)
 
 float EventAnalyzer::getSimilarity(const QString &t1, const QString &t2)
 {
-    static QVector<int> charSpace(1<<16);
+    static thread_local QVector<int> charSpace(1<<16);
     int l1=t1.length(),l2=t2.length();
     int numIntersection=0,numUnion=0;
     for(int i=0;i<l1;++i) charSpace[t1.at(i).unicode()]++;
@@ -3,14 +3,16 @@
 #include <QVector>
 #include <QObject>
 #include "common.h"
-class Pool;
 class EventAnalyzer : public QObject
 {
 public:
     EventAnalyzer(QObject *parent = nullptr);
-    QList<DanmuEvent> analyze(Pool *pool);
+    //times and blockBys run parallel to comments, only text is read from the comments
+    QList<DanmuEvent> analyze(const QList<QSharedPointer<DanmuComment> > &comments, const QVector<int> &times, const QVector<int> &blockBys);
 private:
-    Pool *curPool;
+    const QList<QSharedPointer<DanmuComment> > *curComments;
+    const QVector<int> *curTimes;
+    const QVector<int> *curBlockBys;
     QVector<float> timeSeries;
     int lag;
     float threshold, influence;
@@ -0,0 +1,112 @@
+#include "mergewindow.h"
+namespace
+{
+    inline quint64 mix(quint64 x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+}
+MergeWindow::MergeWindow(int maxUnsimCount):maxUnsimCount(qMax(maxUnsimCount,0)),frontSeq(0)
+{
+
+}
+
+void MergeWindow::append(const DanmuComment *root, int time, int index)
+{
+    SignatureKeys keys;
+    signature(root,keys);
+    qint64 seq=frontSeq+window.count();
+    for(quint64 key:keys)
+    {
+        buckets[key].append(seq);
+    }
+    window.append({root,time,index});
+}
+
+void MergeWindow::evict(int time, int interval)
+{
+    SignatureKeys keys;
+    while(!window.isEmpty() && time-window.first().time>interval)
+    {
+        signature(window.first().danmu,keys);
+        for(quint64 key:keys)
+        {
+            auto iter=buckets.find(key);
+            if(iter==buckets.end()) continue;
+            //roots leave in the same order they come, so it's always the first one
+            if(iter.value().first()==frontSeq) iter.value().removeFirst();
+            else iter.value().removeOne(frontSeq);
+            if(iter.value().isEmpty()) buckets.erase(iter);
+        }
+        window.removeFirst();
+        ++frontSeq;
+    }
+}
+
+int MergeWindow::findSimilar(const DanmuComment *dm) const
+{
+    if(window.isEmpty()) return -1;
+    SignatureKeys keys;
+    signature(dm,keys);
+    qint64 best=-1;
+    for(quint64 key:keys)
+    {
+        auto iter=buckets.constFind(key);
+        if(iter==buckets.cend()) continue;
+        for(qint64 seq:iter.value())
+        {
+            if(best!=-1 && seq>=best) break;
+            const DanmuComment *sw(window.at(seq-frontSeq).danmu);
+            if(sw->type!=dm->type || qAbs(dm->text.length()-sw->text.length())>maxUnsimCount) continue;
+            if((dm->text==sw->text) || contentSimilar(dm,sw,maxUnsimCount))
+            {
+                best=seq;
+                break;
+            }
+        }
+    }
+    return best==-1?-1:window.at(best-frontSeq).index;
+}
+
+bool MergeWindow::contentSimilar(const DanmuComment *dm1, const DanmuComment *dm2, int maxUnsimCount)
+{
+    static thread_local QVector<int> charSpace(1<<16);
+    int sz1=dm1->text.length(),sz2=dm2->text.length();
+    for(int i=0;i<sz1;++i) charSpace[dm1->text.at(i).unicode()]++;
+    for(int i=0;i<sz2;++i) charSpace[dm2->text.at(i).unicode()]--;
+    int diff=0;
+    for(int i=0;i<sz1;++i)
+    {
+        diff+=qAbs(charSpace[dm1->text.at(i).unicode()]);
+        charSpace[dm1->text.at(i).unicode()]=0;
+    }
+    for(int i=0;i<sz2;++i)
+    {
+        diff+=qAbs(charSpace[dm2->text.at(i).unicode()]);
+        charSpace[dm2->text.at(i).unicode()]=0;
+    }
+    return  diff<=maxUnsimCount;
+}
+
+void MergeWindow::signature(const DanmuComment *dm, SignatureKeys &keys) const
+{
+    const int groups=maxUnsimCount+1;
+    keys.resize(groups);
+    std::fill(keys.begin(),keys.end(),0);
+    const QChar *data=dm->text.constData();
+    for(int i=0,sz=dm->text.length();i<sz;++i)
+    {
+        quint64 h=mix(data[i].unicode());
+        //the bag hash is a sum, so it doesn't depend on the order of characters
+        keys[(h>>32)%groups]+=h;
+    }
+    for(int g=0;g<groups;++g)
+    {
+        keys[g]=mix(keys[g]^(quint64(dm->type)<<56)^(quint64(g)<<40));
+    }
+}
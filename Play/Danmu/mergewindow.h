@@ -0,0 +1,39 @@
+#ifndef MERGEWINDOW_H
+#define MERGEWINDOW_H
+#include <QVarLengthArray>
+#include "common.h"
+/*
+ * Slide window of merge roots used by DanmuPool.
+ * Two comments are similar when their character bags differ by at most maxUnsimCount,
+ * so if characters are split into maxUnsimCount+1 groups, at least one group of a similar
+ * pair has exactly the same sub-bag. Every root is indexed by the hash of each sub-bag,
+ * a query only verifies the roots sharing one of its sub-bags instead of the whole window.
+ */
+class MergeWindow
+{
+public:
+    explicit MergeWindow(int maxUnsimCount);
+    inline bool isEmpty() const {return window.isEmpty();}
+    inline int count() const {return window.count();}
+    //index: position of the root in the comment list, time: its time when the task was submitted
+    void append(const DanmuComment *root, int time, int index);
+    void evict(int time, int interval);
+    //returns the index of the earliest root similar to dm, same as scanning the window in order, -1 if none
+    int findSimilar(const DanmuComment *dm) const;
+    static bool contentSimilar(const DanmuComment *dm1, const DanmuComment *dm2, int maxUnsimCount);
+private:
+    typedef QVarLengthArray<quint64,8> SignatureKeys;
+    struct Root
+    {
+        const DanmuComment *danmu;
+        int time;
+        int index;
+    };
+    int maxUnsimCount;
+    qint64 frontSeq;
+    QList<Root> window;
+    QHash<quint64, QList<qint64> > buckets;
+    void signature(const DanmuComment *dm, SignatureKeys &keys) const;
+};
+
+#endif // MERGEWINDOW_H
@@ -0,0 +1,77 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+#include <QtGlobal>
+#include <QVector>
+#include <type_traits>
+struct AllocationStats
+{
+    qint64 acquired;    //objects handed out
+    qint64 released;    //objects given back
+    qint64 heapAllocs;  //slabs requested from the heap
+    int capacity;       //objects all slabs can hold
+    inline qint64 live() const {return acquired-released;}
+};
+/*
+ * Slab pool for objects created and destroyed at a high rate on the render path.
+ * Memory is taken from the heap SlabSize objects at a time and never returned until
+ * releaseSlabs, so once the slabs cover the peak count, allocation is only a free-list pop.
+ * Not thread safe, every pool belongs to one thread.
+ */
+template<typename T, int SlabSize=256>
+class ObjectPool
+{
+public:
+    ObjectPool():freeHead(nullptr),acquired(0),released(0),heapAllocs(0){}
+    ~ObjectPool(){releaseSlabs();}
+
+    void *allocate()
+    {
+        if(!freeHead) addSlab();
+        Slot *slot=freeHead;
+        freeHead=slot->next;
+        ++acquired;
+        return slot;
+    }
+    void deallocate(void *p)
+    {
+        if(!p) return;
+        Slot *slot=static_cast<Slot *>(p);
+        slot->next=freeHead;
+        freeHead=slot;
+        ++released;
+    }
+    //only when every object has been given back
+    void releaseSlabs()
+    {
+        if(acquired!=released) return;
+        for(Slot *slab:slabs)
+            ::operator delete(slab);
+        slabs.clear();
+        freeHead=nullptr;
+    }
+    AllocationStats stats() const
+    {
+        return {acquired,released,heapAllocs,slabs.count()*SlabSize};
+    }
+private:
+    union Slot
+    {
+        Slot *next;
+        typename std::aligned_storage<sizeof(T),alignof(T)>::type storage;
+    };
+    Slot *freeHead;
+    QVector<Slot *> slabs;
+    qint64 acquired, released, heapAllocs;
+
+    void addSlab()
+    {
+        Slot *slab=static_cast<Slot *>(::operator new(sizeof(Slot)*SlabSize));
+        for(int i=0;i<SlabSize-1;++i)
+            slab[i].next=&slab[i+1];
+        slab[SlabSize-1].next=nullptr;
+        freeHead=slab;
+        slabs.append(slab);
+        ++heapAllocs;
+    }
+};
+#endif // OBJECTPOOL_H
@@ -161,3 +161,13 @@ QString ProviderManager::downloadBySourceURL(const QString &url, QList<DanmuComm
     }
     return tr("Unsupported Source");
 }
+
+QString ProviderManager::getSourceProvider(const QString &url)
+{
+    for(auto iter=providers.cbegin();iter!=providers.cend();++iter)
+    {
+        if(iter.value()->supportSourceURL(url))
+            return iter.key();
+    }
+    return QString();
+}
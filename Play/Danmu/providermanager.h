@@ -21,6 +21,8 @@ public:
     DanmuAccessResult *getURLInfo(QString &url);
     QString downloadDanmu(QString &providerId,DanmuSourceItem *item,QList<DanmuComment *> &danmuList);
     QString downloadBySourceURL(const QString &url,QList<DanmuComment *> &danmuList);
+    //id of the provider supporting the source url, empty if unsupported
+    QString getSourceProvider(const QString &url);
 private:
     QMap<QString,ProviderBase *> providers;
     QList<ProviderBase *> orderedProviders;
@@ -0,0 +1,158 @@
+#include "framepacer.h"
+#include <cmath>
+
+namespace
+{
+    const double DefaultInterval=1000.0/60;
+    //swap intervals outside are not vsync(minimized window, a stall), they do not train the estimate
+    const double MinInterval=2.0;
+    const double MaxInterval=100.0;
+    const int WarmupSamples=8;
+    const double IntervalAlpha=0.05;
+    //part of the error to the mpv clock corrected in a frame, a frame advances at most this much more or less
+    const double ErrorGain=0.1;
+    const double MaxCorrection=0.5;
+    //media ms, beyond it the frame clock jumps to the mpv clock(seek, buffering)
+    const double ResyncError=250.0;
+    //ms, mpv reports playback-time every frame, without a report for longer playback is stalled
+    const double MaxExtrapolation=1000.0;
+    const float MaxStep=250.f;
+
+    void meanDeviation(const float *values, int count, double &mean, double &deviation)
+    {
+        mean=deviation=0;
+        if(count==0) return;
+        for(int i=0;i<count;++i) mean+=values[i];
+        mean/=count;
+        for(int i=0;i<count;++i) deviation+=(values[i]-mean)*(values[i]-mean);
+        deviation=std::sqrt(deviation/count);
+    }
+}
+
+FramePacer::FramePacer():playSpeed(1.0),anchorValid(false),anchorMedia(0),anchorHost(0),
+    frameValid(false),frameMediaTime(0),lastSwap(-1),refreshInterval(DefaultInterval),intervalSamples(0),
+    lastError(0),droppedFrames(0),historyHead(0),historyCount(0)
+{
+
+}
+
+void FramePacer::reset()
+{
+    anchorValid=false;
+    frameValid=false;
+    lastSwap=-1;
+    lastError=0;
+}
+
+void FramePacer::setSpeed(double speed)
+{
+    //the anchor keeps the old speed until the next report, the error is corrected like any other
+    playSpeed=qMax(speed,0.01);
+}
+
+void FramePacer::sync(double mediaTime, qint64 hostTime)
+{
+    anchorMedia=mediaTime;
+    anchorHost=hostTime;
+    anchorValid=true;
+}
+
+float FramePacer::swapped(qint64 hostTime)
+{
+    const bool hadSwap=lastSwap>=0;
+    float swap=0.f;
+    int frames=1;
+    if(hadSwap)
+    {
+        const double delta=(hostTime-lastSwap)/1e6;
+        swap=delta;
+        if(intervalSamples<WarmupSamples)
+        {
+            if(delta>=MinInterval && delta<=MaxInterval)
+            {
+                refreshInterval=intervalSamples==0?delta:(refreshInterval*intervalSamples+delta)/(intervalSamples+1);
+                ++intervalSamples;
+            }
+        }
+        else if(delta>=refreshInterval*0.5 && delta<=refreshInterval*1.5)
+        {
+            refreshInterval+=IntervalAlpha*(delta-refreshInterval);
+        }
+        frames=qMax(1,qRound(delta/refreshInterval));
+        droppedFrames+=frames-1;
+    }
+    lastSwap=hostTime;
+
+    float step=0.f;
+    if(!anchorValid)
+    {
+        //nothing from mpv yet, the swaps alone pace the frames
+        frameValid=false;
+        if(hadSwap) step=frames*refreshInterval;
+    }
+    else if(!frameValid)
+    {
+        frameMediaTime=mediaTimeAt(hostTime+qint64(refreshInterval*1e6));
+        frameValid=true;
+        lastError=0;
+    }
+    else
+    {
+        //the frame drawn now is presented one refresh interval after this swap
+        const double target=mediaTimeAt(hostTime+qint64(refreshInterval*1e6));
+        const double advance=frames*refreshInterval*playSpeed;
+        const double error=target-(frameMediaTime+advance);
+        lastError=error;
+        if(qAbs(error)>ResyncError)
+        {
+            //the danmu pool repositions on the jump by itself, the danmu on the screen keep moving
+            frameMediaTime=target;
+            step=frames*refreshInterval;
+        }
+        else
+        {
+            const double next=frameMediaTime+advance+qBound(-advance*MaxCorrection,error*ErrorGain,advance*MaxCorrection);
+            //danmu move in display time as before, a faster playback does not make them faster
+            step=(next-frameMediaTime)/playSpeed;
+            frameMediaTime=next;
+        }
+    }
+    step=qBound(0.f,step,MaxStep);
+    if(hadSwap) record(step,swap);
+    return step;
+}
+
+FramePacer::Stats FramePacer::stats() const
+{
+    Stats s;
+    s.refreshInterval=refreshInterval;
+    double swapMean;
+    meanDeviation(steps,historyCount,s.stepMean,s.stepDeviation);
+    meanDeviation(swaps,historyCount,swapMean,s.swapDeviation);
+    s.clockError=lastError;
+    s.droppedFrames=droppedFrames;
+    return s;
+}
+
+QVector<float> FramePacer::stepHistory() const
+{
+    QVector<float> history;
+    history.reserve(historyCount);
+    const int first=(historyHead-historyCount+HistorySize)%HistorySize;
+    for(int i=0;i<historyCount;++i)
+        history.append(steps[(first+i)%HistorySize]);
+    return history;
+}
+
+double FramePacer::mediaTimeAt(qint64 hostTime) const
+{
+    return anchorMedia+qMin((hostTime-anchorHost)/1e6,MaxExtrapolation)*playSpeed;
+}
+
+void FramePacer::record(float step, float swap)
+{
+    steps[historyHead]=step;
+    swaps[historyHead]=swap;
+    historyHead=(historyHead+1)%HistorySize;
+    if(historyCount<HistorySize) ++historyCount;
+}
@@ -0,0 +1,62 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+#include <QtCore>
+/*
+ * One clock for the danmu of a frame, no GL or mpv calls here.
+ * The mpv playback clock is anchored whenever mpv reports playback-time and extrapolated with the
+ * playback speed. Every swap the pacer predicts when the next frame reaches the screen (last swap
+ * plus the refresh interval, learnt from the swap timestamps) and reads the clock there.
+ * The result is smoothed: it advances by whole refresh intervals and only a part of the error to
+ * the mpv clock is corrected every frame, so a late swap or a late mpv event does not show up as a
+ * jump in the danmu. Times are in ms, host timestamps in ns.
+ */
+class FramePacer
+{
+public:
+    struct Stats
+    {
+        double refreshInterval;     //ms
+        double stepMean;            //ms of display time the danmu moved per frame
+        double stepDeviation;
+        double swapDeviation;       //of the raw swap intervals, what the danmu moved by before
+        double clockError;          //media ms the frame clock is behind the mpv clock
+        int droppedFrames;
+    };
+    static const int HistorySize=120;
+
+    FramePacer();
+    //forget the frame clock, the next swap starts from the mpv clock again (pause, seek)
+    void reset();
+    void setSpeed(double playSpeed);
+    inline double speed() const {return playSpeed;}
+    //mpv reported mediaTime at hostTime
+    void sync(double mediaTime, qint64 hostTime);
+    //called after a swap, returns how far(ms of display time) the danmu move for the next frame
+    float swapped(qint64 hostTime);
+    //media time of the next frame, valid after swapped()
+    inline double frameTime() const {return frameMediaTime;}
+    inline bool isValid() const {return frameValid;}
+
+    Stats stats() const;
+    //the last HistorySize steps, oldest first
+    QVector<float> stepHistory() const;
+private:
+    double playSpeed;
+    bool anchorValid;
+    double anchorMedia;
+    qint64 anchorHost;
+    bool frameValid;
+    double frameMediaTime;
+    qint64 lastSwap;
+    double refreshInterval;
+    int intervalSamples;
+    double lastError;
+    int droppedFrames;
+    float steps[HistorySize];
+    float swaps[HistorySize];
+    int historyHead, historyCount;
+
+    double mediaTimeAt(qint64 hostTime) const;
+    void record(float step, float swap);
+};
+#endif // FRAMEPACER_H
@@ -16,14 +16,14 @@ namespace
 const char *vShaderDanmu =
         "attribute mediump vec4 a_VtxCoord;\n"
         "attribute mediump vec2 a_TexCoord;\n"
-        "attribute mediump float a_Tex;\n"
+        "attribute lowp float a_Alpha;\n"
         "varying mediump vec2 v_vTexCoord;\n"
-        "varying float texId;\n"
+        "varying lowp float v_Alpha;\n"
         "void main(void)\n"
         "{\n"
         "    gl_Position = a_VtxCoord;\n"
         "    v_vTexCoord = a_TexCoord;\n"
-        "    texId = a_Tex;\n"
+        "    v_Alpha = a_Alpha;\n"
         "}\n";
 
 const char *fShaderDanmu =
@@ -31,36 +31,13 @@ const char *fShaderDanmu =
         "precision lowp float;\n"
         "#endif\n"
         "varying mediump vec2 v_vTexCoord;\n"
-        "varying float texId;\n"
-        "uniform sampler2D u_SamplerD[16];\n"
-        "uniform float alpha;\n"
-        "void main(void)\n"
-        "{\n"
-        "    gl_FragColor.rgba = texture2D(u_SamplerD[int(texId)], v_vTexCoord).bgra;\n"
-        "    gl_FragColor.a *= alpha;\n"
-        "}\n";
-const char *vShaderDanmu_Old =
-        "attribute mediump vec4 a_VtxCoord;\n"
-        "attribute mediump vec2 a_TexCoord;\n"
-        "varying mediump vec2 v_vTexCoord;\n"
-        "void main(void)\n"
-        "{\n"
-        "    gl_Position = a_VtxCoord;\n"
-        "    v_vTexCoord = a_TexCoord;\n"
-        "}\n";
-
-const char *fShaderDanmu_Old =
-        "#ifdef GL_ES\n"
-        "precision lowp float;\n"
-        "#endif\n"
-        "varying mediump vec2 v_vTexCoord;\n"
+        "varying lowp float v_Alpha;\n"
         "uniform sampler2D u_SamplerD;\n"
-        "uniform float alpha;\n"
         "void main(void)\n"
         "{\n"
         "    gl_FragColor.rgba = texture2D(u_SamplerD, v_vTexCoord).bgra;\n"
-        "    gl_FragColor.a *= alpha;\n"
-"}\n";
+        "    gl_FragColor.a *= v_Alpha;\n"
+        "}\n";
 #ifdef Q_OS_WIN
 #pragma comment (lib,"user32.lib")
 #pragma comment (lib,"gdi32.lib")
@@ -88,7 +65,7 @@ static QString get_color_profile(HWND hwnd)
 }
 
 MPVPlayer::MPVPlayer(QWidget *parent) : QOpenGLWidget(parent),state(PlayState::Stop),
-    mute(false),danmuHide(false),oldOpenGLVersion(false),currentDuration(0)
+    mute(false),danmuHide(false),danmuVBO(QOpenGLBuffer::VertexBuffer),currentDuration(0)
 {
     std::setlocale(LC_NUMERIC, "C");
     mpv = mpv_create();
@@ -133,6 +110,9 @@ MPVPlayer::MPVPlayer(QWidget *parent) : QOpenGLWidget(parent),state(PlayState::S
     mpv_observe_property(mpv, 0, "playback-time", MPV_FORMAT_DOUBLE);
     mpv_observe_property(mpv, 0, "pause", MPV_FORMAT_FLAG);
     mpv_observe_property(mpv, 0, "eof-reached", MPV_FORMAT_FLAG);
+    mpv_observe_property(mpv, 0, "speed", MPV_FORMAT_DOUBLE);
+    hostClock.start();
+    pacingOverlay=GlobalObjects::appSetting->value("Play/FramePacingOverlay",false).toBool();
 
     mpv_set_wakeup_callback(mpv, MPVPlayer::wakeup, this);
     QObject::connect(&refreshTimer,&QTimer::timeout,[this](){
@@ -144,6 +124,7 @@ MPVPlayer::MPVPlayer(QWidget *parent) : QOpenGLWidget(parent),state(PlayState::S
 MPVPlayer::~MPVPlayer()
 {
     makeCurrent();
+    danmuVBO.destroy();
     if (mpv_gl) mpv_render_context_free(mpv_gl);
     mpv_terminate_destroy(mpv);
 }
@@ -231,92 +212,48 @@ void MPVPlayer::setOptions()
     }
 }
 
-void MPVPlayer::drawTexture(QList<const DanmuObject *> &objList, float alpha)
+void MPVPlayer::drawTexture(QVector<DanmuInstance> &objList, float alpha)
 {
-    static QVector<GLfloat> vtx(6*2*64),tex(6*2*64),texId(6*64);
-    static int Textures[] ={GL_TEXTURE0,GL_TEXTURE1,GL_TEXTURE2,GL_TEXTURE3,
-                            GL_TEXTURE4,GL_TEXTURE5,GL_TEXTURE6,GL_TEXTURE7,
-                           GL_TEXTURE8,GL_TEXTURE9,GL_TEXTURE10,GL_TEXTURE11,
-                           GL_TEXTURE12,GL_TEXTURE13,GL_TEXTURE14,GL_TEXTURE15};
-    static GLuint u_SamplerD[16]={0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15};
-    static QHash<GLuint, int> texHash;
-    if(objList.size()>vtx.size()/12)
-    {
-        vtx.resize(objList.size()*12);
-        tex.resize(objList.size()*12);
-        texId.resize(objList.size()*6);
-    }
+    danmuBatch.build(objList,width(),height(),alpha);
+    //keeps the capacity for the next frame
+    objList.resize(0);
+    const int bytes=danmuBatch.vertexBytes();
+    danmuBatch.lastFrame={danmuBatch.vertices().size()/DanmuBatchBuilder::VerticesPerDanmu,0,0};
+    if(bytes==0) return;
+
     QOpenGLFunctions *glFuns=context()->functions();
-    GLfloat h = 2.f / width(), v = 2.f / height();
-    int allowTexCount=oldOpenGLVersion?0:15;
-    while(!objList.isEmpty())
+    danmuVBO.bind();
+    //orphan the old storage so the driver does not wait for the last frame
+    if(danmuVBO.size()<bytes)
+        danmuVBO.allocate(qMax(bytes,danmuVBO.size()*2));
+    else
+        danmuVBO.allocate(danmuVBO.size());
+    danmuVBO.write(0,danmuBatch.vertices().constData(),bytes);
+
+    const int stride=sizeof(DanmuBatchBuilder::Vertex);
+    danmuShader.bind();
+    danmuShader.setUniformValue("u_SamplerD", 0);
+    danmuShader.setAttributeBuffer(0, GL_FLOAT, offsetof(DanmuBatchBuilder::Vertex,x), 2, stride);
+    danmuShader.setAttributeBuffer(1, GL_FLOAT, offsetof(DanmuBatchBuilder::Vertex,u), 2, stride);
+    danmuShader.setAttributeBuffer(2, GL_FLOAT, offsetof(DanmuBatchBuilder::Vertex,alpha), 1, stride);
+    danmuShader.enableAttributeArray(0);
+    danmuShader.enableAttributeArray(1);
+    danmuShader.enableAttributeArray(2);
+
+    glFuns->glEnable(GL_BLEND);
+    glFuns->glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glFuns->glActiveTexture(GL_TEXTURE0);
+    for(const DanmuBatchBuilder::Batch &batch:danmuBatch.batches())
     {
-        texHash.clear();
-        int i=0;
-        int textureId=0;
-        while(!objList.isEmpty())
-        {
-            if(textureId>allowTexCount) break;
-            const DanmuObject *obj=objList.takeFirst();
-
-            GLfloat l = obj->x*h - 1,r = (obj->x+obj->drawInfo->width)*h - 1,
-                    t = 1 - obj->y*v,b = 1 - (obj->y+obj->drawInfo->height)*v;
-            vtx[i]=l;     vtx[i+1]=t;
-            vtx[i+2] = r; vtx[i+3] = t;
-            vtx[i+4] = l; vtx[i+5] = b;
-
-            vtx[i+6] = r;  vtx[i+7] = t;
-            vtx[i+8] = l;  vtx[i+9] = b;
-            vtx[i+10] = r; vtx[i+11] = b;
-
-            tex[i]=obj->drawInfo->l;     tex[i+1]=obj->drawInfo->t;
-            tex[i+2] = obj->drawInfo->r; tex[i+3] = obj->drawInfo->t;
-            tex[i+4] = obj->drawInfo->l; tex[i+5] = obj->drawInfo->b;
-
-            tex[i+6] = obj->drawInfo->r;  tex[i+7] = obj->drawInfo->t;
-            tex[i+8] = obj->drawInfo->l;  tex[i+9] = obj->drawInfo->b;
-            tex[i+10] = obj->drawInfo->r; tex[i+11] = obj->drawInfo->b;
-
-            int texIndex=texHash.value(obj->drawInfo->texture,-1);
-            if(texIndex<0)
-            {
-                texIndex=textureId++;
-                glFuns->glActiveTexture(Textures[texIndex]);
-                glFuns->glBindTexture(GL_TEXTURE_2D, obj->drawInfo->texture);
-                texHash.insert(obj->drawInfo->texture, texIndex);
-            }
-
-            texId[i/2]=texIndex;
-            texId[i/2+1]=texIndex;
-            texId[i/2+2]=texIndex;
-            texId[i/2+3]=texIndex;
-            texId[i/2+4]=texIndex;
-            texId[i/2+5]=texIndex;
-
-            i+=12;
-        }
-
-        danmuShader.bind();
-        danmuShader.setUniformValue("alpha", alpha);
-        danmuShader.setAttributeArray(0, vtx.constData(), 2);
-        danmuShader.setAttributeArray(1, tex.constData(), 2);
-        danmuShader.enableAttributeArray(0);
-        danmuShader.enableAttributeArray(1);
-        if(oldOpenGLVersion)
-        {
-            danmuShader.setUniformValue("u_SamplerD", 0);
-        }
-        else
-        {
-            danmuShader.setUniformValueArray("u_SamplerD", u_SamplerD,16);
-            danmuShader.setAttributeArray(2,texId.constData(),1);
-            danmuShader.enableAttributeArray(2);
-        }
-
-        glFuns->glEnable(GL_BLEND);
-        glFuns->glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-        glFuns->glDrawArrays(GL_TRIANGLES, 0, i/2);
+        glFuns->glBindTexture(GL_TEXTURE_2D, batch.texture);
+        glFuns->glDrawArrays(GL_TRIANGLES, batch.first, batch.count);
     }
+    danmuShader.disableAttributeArray(0);
+    danmuShader.disableAttributeArray(1);
+    danmuShader.disableAttributeArray(2);
+    danmuVBO.release();
+    danmuBatch.lastFrame.drawCalls=danmuBatch.batches().size();
+    danmuBatch.lastFrame.uploadBytes=bytes;
 }
 
 void MPVPlayer::setMedia(QString file)
@@ -325,6 +262,7 @@ void MPVPlayer::setMedia(QString file)
     {
         currentFile=file;
 		state = PlayState::Play;
+        framePacer.reset();
         refreshTimer.start(timeRefreshInterval);
         QCoreApplication::processEvents();
 		emit stateChanged(state);
@@ -362,6 +300,8 @@ void MPVPlayer::setState(MPVPlayer::PlayState newState)
 void MPVPlayer::seek(int pos,bool relative)
 {
     QCoreApplication::instance()->processEvents();
+    //the old anchor must not be extrapolated past the seek
+    framePacer.reset();
 	if (relative)
 	{
 		setMPVCommand(QVariantList() << "seek" << pos);
@@ -460,29 +400,14 @@ void MPVPlayer::initializeGL()
     QOpenGLFunctions *glFuns=context()->functions();
     const char *version = reinterpret_cast<const char*>(glFuns->glGetString(GL_VERSION));
     qDebug()<<"OpenGL Version:"<<version;
-    oldOpenGLVersion = !(version[0]<='9' &&  version[0]>='4');
-    if(oldOpenGLVersion)qDebug()<<"Unsupport sampler2D Array";
-    bool useSample2DArray = GlobalObjects::appSetting->value("Play/Sampler2DArray",true).toBool();
-	if (!oldOpenGLVersion && !useSample2DArray) oldOpenGLVersion = true;
-    if(oldOpenGLVersion)
-    {
-        danmuShader.addShaderFromSourceCode(QOpenGLShader::Vertex, vShaderDanmu_Old);
-        danmuShader.addShaderFromSourceCode(QOpenGLShader::Fragment, fShaderDanmu_Old);
-        danmuShader.link();
-        danmuShader.bind();
-        danmuShader.bindAttributeLocation("a_VtxCoord", 0);
-        danmuShader.bindAttributeLocation("a_TexCoord", 1);
-    }
-    else
-    {
-        danmuShader.addShaderFromSourceCode(QOpenGLShader::Vertex, vShaderDanmu);
-        danmuShader.addShaderFromSourceCode(QOpenGLShader::Fragment, fShaderDanmu);
-        danmuShader.link();
-        danmuShader.bind();
-        danmuShader.bindAttributeLocation("a_VtxCoord", 0);
-        danmuShader.bindAttributeLocation("a_TexCoord", 1);
-        danmuShader.bindAttributeLocation("a_Tex", 2);
-    }
+    danmuShader.addShaderFromSourceCode(QOpenGLShader::Vertex, vShaderDanmu);
+    danmuShader.addShaderFromSourceCode(QOpenGLShader::Fragment, fShaderDanmu);
+    danmuShader.bindAttributeLocation("a_VtxCoord", 0);
+    danmuShader.bindAttributeLocation("a_TexCoord", 1);
+    danmuShader.bindAttributeLocation("a_Alpha", 2);
+    danmuShader.link();
+    danmuVBO.create();
+    danmuVBO.setUsagePattern(QOpenGLBuffer::StreamDraw);
     emit initContext();
 }
 
@@ -499,26 +424,56 @@ void MPVPlayer::paintGL()
     // See render_gl.h on what OpenGL environment mpv expects, and
     // other API details.
     mpv_render_context_render(mpv_gl, params);
-    if(!danmuHide)
+    if(!danmuHide || pacingOverlay)
     {
         QOpenGLFramebufferObject::bindDefault();
         QOpenGLPaintDevice fboPaintDevice(width(), height());
         QPainter painter(&fboPaintDevice);
-        painter.beginNativePainting();
-        GlobalObjects::danmuRender->drawDanmu();
-        painter.endNativePainting();
+        if(!danmuHide)
+        {
+            painter.beginNativePainting();
+            GlobalObjects::danmuRender->drawDanmu();
+            painter.endNativePainting();
+        }
+        if(pacingOverlay) drawPacingOverlay(painter);
     }
 }
 
+void MPVPlayer::drawPacingOverlay(QPainter &painter)
+{
+    const FramePacer::Stats stats(framePacer.stats());
+    const QVector<float> history(framePacer.stepHistory());
+    const QRectF panel(8, 8, 280, 100);
+    painter.fillRect(panel, QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    painter.drawText(panel.adjusted(6, 4, -6, -4), Qt::AlignLeft|Qt::AlignTop,
+                     QString("refresh %1 ms, dropped %2\nstep %3 ms, deviation %4 ms\nswap deviation %5 ms, clock error %6 ms")
+                     .arg(stats.refreshInterval,0,'f',2).arg(stats.droppedFrames)
+                     .arg(stats.stepMean,0,'f',2).arg(stats.stepDeviation,0,'f',2)
+                     .arg(stats.swapDeviation,0,'f',2).arg(stats.clockError,0,'f',1));
+    //every step against the refresh interval, the middle line is a step of exactly one interval
+    const QRectF graph(panel.left()+6, panel.bottom()-40, panel.width()-12, 34);
+    painter.setPen(QColor(255, 255, 255, 80));
+    painter.drawLine(QPointF(graph.left(), graph.center().y()), QPointF(graph.right(), graph.center().y()));
+    if(history.size()<2) return;
+    const double interval=qMax(stats.refreshInterval, 1.0);
+    QPolygonF line;
+    line.reserve(history.size());
+    for(int i=0;i<history.size();++i)
+    {
+        const double deviation=qBound(-1.0, (history.at(i)-interval)/interval, 1.0);
+        line.append(QPointF(graph.left()+i*graph.width()/(FramePacer::HistorySize-1), graph.center().y()-deviation*graph.height()/2));
+    }
+    painter.setPen(QColor(0, 220, 120));
+    painter.drawPolyline(line);
+}
+
 void MPVPlayer::swapped()
 {
     if(state==PlayState::Play)
     {
-        float step(0.f);
-        if(elapsedTimer.isValid())
-            step=elapsedTimer.restart();
-        else
-            elapsedTimer.start();
+        const float step=framePacer.swapped(hostClock.nsecsElapsed());
+        if(framePacer.isValid()) emit frameTimeChanged(framePacer.frameTime());
         GlobalObjects::danmuRender->moveDanmu(step);
     }
 }
@@ -562,7 +517,15 @@ void MPVPlayer::handle_mpv_event(mpv_event *event)
             if (prop->format == MPV_FORMAT_DOUBLE)
             {
                 double time = *(double *)prop->data;
-                if(state==PlayState::Pause) emit positionChanged(time*1000);
+                if(state==PlayState::Pause)
+                {
+                    emit positionChanged(time*1000);
+                    emit frameTimeChanged(time*1000);
+                }
+                else
+                {
+                    framePacer.sync(time*1000, hostClock.nsecsElapsed());
+                }
             }
         }
         else if (strcmp(prop->name, "duration") == 0)
@@ -582,7 +545,7 @@ void MPVPlayer::handle_mpv_event(mpv_event *event)
                 state=flag?PlayState::Pause:PlayState::Play;
                 if(state==PlayState::Pause)
                 {
-                    elapsedTimer.invalidate();
+                    framePacer.reset();
                     refreshTimer.stop();
                 }
                 else
@@ -592,6 +555,13 @@ void MPVPlayer::handle_mpv_event(mpv_event *event)
                 emit stateChanged(state);
             }
         }
+        else if (strcmp(prop->name, "speed") == 0)
+        {
+            if (prop->format == MPV_FORMAT_DOUBLE)
+            {
+                framePacer.setSpeed(*(double *)prop->data);
+            }
+        }
         else if (strcmp(prop->name, "eof-reached") == 0)
         {
             if (prop->format == MPV_FORMAT_FLAG)
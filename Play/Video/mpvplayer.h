@@ -8,6 +8,8 @@
 #include <mpv/render_gl.h>
 #include <mpv/qthelper.hpp>
 #include "Play/Danmu/common.h"
+#include "Play/Danmu/Render/danmubatch.h"
+#include "framepacer.h"
 
 class DanmuRender;
 class MPVPlayer : public QOpenGLWidget
@@ -51,12 +53,15 @@ public:
     VideoSizeInfo getVideoSizeInfo();
     QMap<QString,QMap<QString,QString> > getMediaInfo();
     void setOptions();
-    void drawTexture(QList<const DanmuObject *> &objList, float alpha);
+    void drawTexture(QVector<DanmuInstance> &objList, float alpha);
+    inline const DanmuBatchBuilder::FrameStats &getDanmuFrameStats() const{return danmuBatch.lastFrame;}
 
 signals:
     void fileChanged();
     void durationChanged(int value);
     void positionChanged(int value);
+    //media time of the next frame, every frame while playing, the danmu pool follows it
+    void frameTimeChanged(int value);
     void positionJumped(int value);
     void stateChanged(PlayState state);
     void trackInfoChange(int type);
@@ -106,16 +111,20 @@ private:
     bool mute;
     bool danmuHide;
     int volume;
-    bool oldOpenGLVersion;
     QString currentFile;
     QOpenGLShaderProgram danmuShader;
+    QOpenGLBuffer danmuVBO;
+    DanmuBatchBuilder danmuBatch;
     QTimer refreshTimer;
-    QElapsedTimer elapsedTimer;
+    QElapsedTimer hostClock;
+    FramePacer framePacer;
+    bool pacingOverlay;
     QMap<QString, QString> optionsMap;
 
     int currentDuration;
     TrackInfo audioTrack,subtitleTrack;
     void loadTracks();
+    void drawPacingOverlay(QPainter &painter);
 
     inline int setMPVCommand(const QVariant& params);
     inline void setMPVProperty(const QString& name, const QVariant& value);
@@ -13,7 +13,7 @@
 #include "matcheditor.h"
 #include "blockeditor.h"
 #include "inputdialog.h"
-#include "Play/Danmu/Provider/localprovider.h"
+#include "Play/Danmu/Manager/danmuimporter.h"
 #include "Play/Video/mpvplayer.h"
 #include "Play/Playlist/playlist.h"
 #include "Play/Danmu/blocker.h"
@@ -595,23 +595,10 @@ void ListWindow::initActions()
             restorePlayState = true;
             GlobalObjects::mpvplayer->setState(MPVPlayer::Pause);
         }
-        QString file = QFileDialog::getOpenFileName(this,tr("Select Xml File"),"","Xml File(*.xml) ");
-        if(!file.isNull())
+        QStringList files = QFileDialog::getOpenFileNames(this,tr("Select Xml File"),"","Xml File(*.xml) ");
+        if(!files.isEmpty())
         {
-            QList<DanmuComment *> tmplist;
-            LocalProvider::LoadXmlDanmuFile(file,tmplist);
-            DanmuSourceInfo sourceInfo;
-            sourceInfo.delay=0;
-            sourceInfo.name=file.mid(file.lastIndexOf('/')+1);
-            sourceInfo.show=true;
-            sourceInfo.url=file;
-            sourceInfo.count=tmplist.count();
-            if(GlobalObjects::danmuPool->getPool()->addSource(sourceInfo,tmplist,true)==-1)
-            {
-                qDeleteAll(tmplist);
-                showMessage(tr("Add Failed: Pool is busy"),PopMessageFlag::PM_INFO|PopMessageFlag::PM_HIDE);
-            }
-            //GlobalObjects::danmuPool->addDanmu(sourceInfo,tmplist);
+            addLocalDanmu(files);
         }
         if(restorePlayState)GlobalObjects::mpvplayer->setState(MPVPlayer::Play);
     });
@@ -1069,35 +1056,41 @@ void ListWindow::dropEvent(QDropEvent *event)
     }
     else if(danmulistPageButton->isChecked())
     {
+        QStringList danmuFileList;
         for(QUrl &url:urls)
         {
             if(url.isLocalFile())
             {
                 QFileInfo fi(url.toLocalFile());
-                if(fi.isFile())
+                if(fi.isFile() && DanmuImporter::isSupported(fi.filePath()))
                 {
-                    if("xml"==fi.suffix())
-                    {
-                        QList<DanmuComment *> tmplist;
-                        LocalProvider::LoadXmlDanmuFile(fi.filePath(),tmplist);
-                        DanmuSourceInfo sourceInfo;
-                        sourceInfo.delay=0;
-                        sourceInfo.name=fi.fileName();
-                        sourceInfo.show=true;
-                        sourceInfo.url=fi.filePath();
-                        sourceInfo.count=tmplist.count();
-                        if(GlobalObjects::danmuPool->getPool()->addSource(sourceInfo,tmplist,true)==-1)
-                        {
-                            qDeleteAll(tmplist);
-                            showMessage(tr("Add Failed: Pool is busy"),PopMessageFlag::PM_INFO|PopMessageFlag::PM_HIDE);
-                        }
-                    }
+                    danmuFileList.append(fi.filePath());
                 }
             }
         }
+        if(!danmuFileList.isEmpty()) addLocalDanmu(danmuFileList);
     }
 }
 
+void ListWindow::addLocalDanmu(const QStringList &files)
+{
+    DanmuImporter *importer=new DanmuImporter(GlobalObjects::danmuPool->getPool());
+    if(files.count()>1)
+    {
+        QObject::connect(importer,&DanmuImporter::fileParsed,this,[this](const QString &fileName, int, int parsedFiles, int totalFiles){
+            showMessage(tr("Parsing(%1/%2): %3").arg(parsedFiles).arg(totalFiles).arg(QFileInfo(fileName).fileName()),PopMessageFlag::PM_PROCESS);
+        });
+    }
+    QObject::connect(importer,&DanmuImporter::finished,this,[this,files](const QList<int> &sources, bool cancelled){
+        if(cancelled) return;
+        if(sources.isEmpty())
+            showMessage(tr("Add Failed: Pool is busy"),PopMessageFlag::PM_INFO|PopMessageFlag::PM_HIDE);
+        else if(files.count()>1)
+            showMessage(tr("Added %1 Danmu Files").arg(files.count()),PopMessageFlag::PM_OK|PopMessageFlag::PM_HIDE);
+    });
+    importer->start(files);
+}
+
 void ListWindow::enterEvent(QEvent *)
 {
     playlistView->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
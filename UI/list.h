@@ -67,6 +67,7 @@ private:
             *act_copyDanmuText,*act_copyDanmuColor,*act_copyDanmuSender,
             *act_blockText,*act_blockColor,*act_blockSender,
             *act_jumpToTime, *act_deleteDanmu;
+    void addLocalDanmu(const QStringList &files);
 
 protected:
     virtual void resizeEvent(QResizeEvent *event);
@@ -16,6 +16,7 @@
 #include "Play/Playlist/playlist.h"
 #include "Play/Danmu/danmupool.h"
 #include "Play/Danmu/Render/danmurender.h"
+#include "Play/Danmu/Manager/danmuimporter.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : CFramelessWindow(parent),listWindowWidth(0)
@@ -425,6 +426,7 @@ void MainWindow::closeEvent(QCloseEvent *event)
     GlobalObjects::playlist->setCurrentPlayTime(playTime);
     QWidget::closeEvent(event);
     playerWindow->close();
+    DanmuImporter::cancelAll();
     GlobalObjects::clear();
     QCoreApplication::instance()->exit();
 }
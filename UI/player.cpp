@@ -20,7 +20,7 @@
 #include "mpvlog.h"
 #include "Play/Playlist/playlist.h"
 #include "Play/Danmu/Render/danmurender.h"
-#include "Play/Danmu/Provider/localprovider.h"
+#include "Play/Danmu/Manager/danmuimporter.h"
 #include "Play/Danmu/danmupool.h"
 #include "Play/Danmu/Manager/pool.h"
 #include "Play/Danmu/blocker.h"
@@ -733,6 +733,13 @@ void PlayerWindow::setupDanmuSettingPage()
     });
     randomSize->setChecked(GlobalObjects::appSetting->value("Play/RandomSize",false).toBool());
 
+    glyphAtlas=new QCheckBox(tr("Glyph Cache"),danmuSettingPage);
+    glyphAtlas->setToolTip(tr("Rasterize each character once and reuse it, faster for dense danmu"));
+    QObject::connect(glyphAtlas,&QCheckBox::stateChanged,[](int state){
+        GlobalObjects::danmuRender->setGlyphAtlas(state==Qt::Checked?true:false);
+    });
+    glyphAtlas->setChecked(GlobalObjects::appSetting->value("Play/GlyphAtlas",false).toBool());
+
     QLabel *maxDanmuCountLabel=new QLabel(tr("Max Count"),danmuSettingPage);
     maxDanmuCount=new QSlider(Qt::Horizontal,danmuSettingPage);
     maxDanmuCount->setRange(40,300);
@@ -901,6 +908,7 @@ void PlayerWindow::setupDanmuSettingPage()
     appearanceGLayout->addWidget(alphaSlider,1,1);
     appearanceGLayout->addWidget(bold,2,1);
     appearanceGLayout->addWidget(randomSize,3,1);
+    appearanceGLayout->addWidget(glyphAtlas,4,1);
 
     QWidget *pageAdvanced=new QWidget(danmuSettingPage);
     danmuSettingSLayout->addWidget(pageAdvanced);
@@ -1715,6 +1723,7 @@ void PlayerWindow::closeEvent(QCloseEvent *)
     GlobalObjects::appSetting->setValue("BottomSubProtect",bottomSubtitleProtect->isChecked());
     GlobalObjects::appSetting->setValue("TopSubProtect",topSubtitleProtect->isChecked());
     GlobalObjects::appSetting->setValue("RandomSize",randomSize->isChecked());
+    GlobalObjects::appSetting->setValue("GlyphAtlas",glyphAtlas->isChecked());
     GlobalObjects::appSetting->setValue("DanmuFont",fontFamilyCombo->currentFont().family());
     GlobalObjects::appSetting->setValue("VidoeAspectRatio",aspectRatioCombo->currentIndex());
     GlobalObjects::appSetting->setValue("PlaySpeed",playSpeedCombo->currentIndex());
@@ -1745,7 +1754,7 @@ void PlayerWindow::dragEnterEvent(QDragEnterEvent *event)
 void PlayerWindow::dropEvent(QDropEvent *event)
 {
     QList<QUrl> urls(event->mimeData()->urls());
-    QStringList fileList,dirList;
+    QStringList fileList,dirList,danmuFileList;
     for(QUrl &url:urls)
     {
         if(url.isLocalFile())
@@ -1765,24 +1774,9 @@ void PlayerWindow::dropEvent(QDropEvent *event)
                         showMessage(tr("Subtitle has been added"));
                     }
                 }
-                else if("xml"==fi.suffix())
+                else if(DanmuImporter::isSupported(fi.filePath()))
                 {
-                    QList<DanmuComment *> tmplist;
-                    LocalProvider::LoadXmlDanmuFile(fi.filePath(),tmplist);
-                    DanmuSourceInfo sourceInfo;
-                    sourceInfo.delay=0;
-                    sourceInfo.name=fi.fileName();
-                    sourceInfo.show=true;
-                    sourceInfo.url=fi.filePath();
-                    sourceInfo.count=tmplist.count();
-                    Pool *pool=GlobalObjects::danmuPool->getPool();
-                    if(pool->addSource(sourceInfo,tmplist,true)>=0)
-                        showMessage(tr("Danmu has been added"));
-                    else
-                    {
-                        qDeleteAll(tmplist);
-                        showMessage(tr("Add Faied: Pool is busy"));
-                    }
+                    danmuFileList.append(fi.filePath());
                 }
             }
             else
@@ -1791,6 +1785,22 @@ void PlayerWindow::dropEvent(QDropEvent *event)
             }
         }
     }
+    if(!danmuFileList.isEmpty())
+    {
+        //the danmu goes to the current pool, even if a new file is played below
+        DanmuImporter *importer=new DanmuImporter(GlobalObjects::danmuPool->getPool());
+        if(danmuFileList.count()>1)
+        {
+            QObject::connect(importer,&DanmuImporter::fileParsed,this,[this](const QString &, int, int parsedFiles, int totalFiles){
+                showMessage(tr("Parsing Danmu Files: %1/%2").arg(parsedFiles).arg(totalFiles));
+            });
+        }
+        QObject::connect(importer,&DanmuImporter::finished,this,[this](const QList<int> &sources, bool cancelled){
+            if(cancelled) return;
+            showMessage(sources.isEmpty()?tr("Add Faied: Pool is busy"):tr("Danmu has been added"));
+        });
+        importer->start(danmuFileList);
+    }
     if(!fileList.isEmpty())
     {
         GlobalObjects::playlist->addItems(fileList,QModelIndex());
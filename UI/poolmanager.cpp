@@ -233,15 +233,22 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
         if(QDialog::Accepted==addPool.exec())
         {
             QString opid(poolNode->idInfo);
-            QString npid = GlobalObjects::danmuManager->renamePool(opid,addPool.animeTitle,addPool.epTitle);
-            if(npid.isEmpty())
-            {
-                showMessage(tr("Rename Failed, Try Again?"),1);
-                return;
-            }
-            if(opid==npid) return;
-            managerModel->renamePoolNode(poolNode,addPool.animeTitle,addPool.epTitle,npid);
-            GlobalObjects::playlist->renameItemPoolId(opid,npid,addPool.animeTitle,addPool.epTitle);
+            const QString animeTitle(addPool.animeTitle),epTitle(addPool.epTitle);
+            //the node list must stay as it is until the pool is renamed
+            this->showBusyState(true);
+            this->setEnabled(false);
+            GlobalObjects::danmuManager->renamePool(opid,animeTitle,epTitle,this,[=](const QString &npid){
+                this->showBusyState(false);
+                this->setEnabled(true);
+                if(npid.isEmpty())
+                {
+                    showMessage(tr("Rename Failed, Try Again?"),1);
+                    return;
+                }
+                if(opid==npid) return;
+                managerModel->renamePoolNode(poolNode,animeTitle,epTitle,npid);
+                GlobalObjects::playlist->renameItemPoolId(opid,npid,animeTitle,epTitle);
+            });
         }
 
     });
@@ -482,9 +489,10 @@ PoolManager::PoolManager(QWidget *parent) : CFramelessDialog(tr("Danmu Pool Mana
         this->showBusyState(true);
         importKdFile->setEnabled(false);
         addDanmuPool->setEnabled(false);
-        managerModel->refreshList();
-        this->showBusyState(false);
-        importKdFile->setEnabled(true);
-        addDanmuPool->setEnabled(true);
+        managerModel->refreshList([this,importKdFile,addDanmuPool](){
+            this->showBusyState(false);
+            importKdFile->setEnabled(true);
+            addDanmuPool->setEnabled(true);
+        });
     });
 }
@@ -12,11 +12,13 @@
 #include "Download/Script/scriptmanager.h"
 #include "Download/autodownloadmanager.h"
 #include "Common/kcache.h"
+#include "Common/dbexecutor.h"
 
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QApplication>
 #include <QSqlError>
+#include <QTimer>
 
 
 MPVPlayer *GlobalObjects::mpvplayer=nullptr;
@@ -34,39 +36,109 @@ LANServer *GlobalObjects::lanServer=nullptr;
 ScriptManager *GlobalObjects::scriptManager=nullptr;
 AutoDownloadManager *GlobalObjects::autoDownloadManager=nullptr;
 KCache *GlobalObjects::kCache=nullptr;
+DBExecutor *GlobalObjects::dbExecutor=nullptr;
 QFont GlobalObjects::iconfont;
 QString GlobalObjects::dataPath;
 namespace  {
     const char *mt_db_names[]={"Comment_M", "Bangumi_M","Download_M"};
     const char *wt_db_names[]={"Comment_W", "Bangumi_W","Download_W"};
+    const char *db_files[]={"comment","bangumi","download"};
+    const char *db_base_names[]={"Comment","Bangumi","Download"};
+    const int db_count=3;
+
+    //"Database/<file>/..." settings, cache size in KiB, mmap size in bytes
+    struct DBOptions
+    {
+        QString journalMode;
+        QString synchronous;
+        int cacheSize;
+        qint64 mmapSize;
+        QString tempStore;
+    } db_options[]={
+        {"WAL","NORMAL",32*1024,256ll<<20,"MEMORY"},
+        {"WAL","NORMAL",8*1024,64ll<<20,"MEMORY"},
+        {"WAL","NORMAL",2*1024,0,"MEMORY"}
+    };
+
+    //read once on the main thread, connections are also opened by other threads
+    void loadDBOptions(QSettings *setting)
+    {
+        for(int i=0;i<db_count;++i)
+        {
+            DBOptions &options=db_options[i];
+            setting->beginGroup(QString("Database/%1").arg(db_files[i]));
+            options.journalMode=setting->value("JournalMode",options.journalMode).toString();
+            options.synchronous=setting->value("Synchronous",options.synchronous).toString();
+            options.cacheSize=setting->value("CacheSize",options.cacheSize).toInt();
+            options.mmapSize=setting->value("MmapSize",options.mmapSize).toLongLong();
+            options.tempStore=setting->value("TempStore",options.tempStore).toString();
+            setting->endGroup();
+        }
+    }
+
+    void applyDBOptions(QSqlQuery &query, int db)
+    {
+        const DBOptions &options=db_options[db];
+        //journal_mode is kept in the file, the other ones are per connection
+        query.exec(QString("PRAGMA journal_mode = %1;").arg(options.journalMode));
+        query.exec(QString("PRAGMA synchronous = %1;").arg(options.synchronous));
+        query.exec(QString("PRAGMA cache_size = %1;").arg(-options.cacheSize));
+        query.exec(QString("PRAGMA mmap_size = %1;").arg(options.mmapSize));
+        query.exec(QString("PRAGMA temp_store = %1;").arg(options.tempStore));
+    }
+
+    //the WAL file is folded back without waiting for readers, a truncating checkpoint is done at exit
+    void maintainDatabase(const char *db_names[], bool exiting)
+    {
+        for(int i=0;i<db_count;++i)
+        {
+            QSqlQuery query(QSqlDatabase::database(db_names[i]));
+            query.exec("PRAGMA optimize;");
+            query.exec(exiting?"PRAGMA wal_checkpoint(TRUNCATE);":"PRAGMA wal_checkpoint(PASSIVE);");
+        }
+    }
 }
 
-void GlobalObjects::init()
+void GlobalObjects::init(const QString &dir)
 {
-    dataPath=QCoreApplication::applicationDirPath()+"/data/";
+    dataPath=dir.isEmpty()?QCoreApplication::applicationDirPath()+"/data/":dir;
     QDir dir;
     if(!dir.exists(dataPath))
     {
         dir.mkpath(dataPath);
     }
 
-    initDatabase(mt_db_names);
     appSetting=new QSettings(dataPath+"settings.ini",QSettings::IniFormat);
+    loadDBOptions(appSetting);
+    initDatabase(mt_db_names);
+    dbExecutor=new DBExecutor(qBound(1,appSetting->value("Database/ReaderThreads",2).toInt(),8));
     workThread=new QThread();
     workThread->setObjectName(QStringLiteral("workThread"));
     workThread->start(QThread::NormalPriority);
     mpvplayer=new MPVPlayer();
     danmuPool=new DanmuPool();
     danmuRender=new DanmuRender();
-    QObject::connect(mpvplayer,&MPVPlayer::positionChanged, danmuPool,&DanmuPool::mediaTimeElapsed);
+    QObject::connect(mpvplayer,&MPVPlayer::frameTimeChanged, danmuPool,&DanmuPool::mediaTimeElapsed);
     QObject::connect(mpvplayer,&MPVPlayer::positionJumped,danmuPool,&DanmuPool::mediaTimeJumped);
     playlist=new PlayList();
     QObject::connect(playlist, &PlayList::currentMatchChanged, danmuPool, &DanmuPool::setPoolID);
     blocker=new Blocker();
     QObject *workObj=new QObject();
     workObj->moveToThread(workThread);
-    QMetaObject::invokeMethod(workObj,[workObj](){
+    const int maintainInterval=appSetting->value("Database/MaintainInterval",10).toInt();
+    QMetaObject::invokeMethod(workObj,[workObj,maintainInterval](){
         initDatabase(wt_db_names);
+        if(maintainInterval>0)
+        {
+            QTimer *maintainTimer=new QTimer();
+            QObject::connect(maintainTimer,&QTimer::timeout,[](){
+                maintainDatabase(wt_db_names,false);
+            });
+            QObject::connect(workThread,&QThread::finished,[maintainTimer](){
+                delete maintainTimer;
+            });
+            maintainTimer->start(maintainInterval*60*1000);
+        }
         workObj->deleteLater();
     },Qt::QueuedConnection);
     providerManager=new ProviderManager();
@@ -86,8 +158,16 @@ void GlobalObjects::init()
 
 void GlobalObjects::clear()
 { 
+    //the cached statements of a thread are finished on it, before its connections are checkpointed or dropped
+    QObject::connect(workThread,&QThread::finished,[](){
+        DBExecutor::clearCachedQueries();
+    });
     workThread->quit();
     workThread->wait();
+    dbExecutor->stop();
+    delete dbExecutor;
+    DBExecutor::clearCachedQueries();
+    maintainDatabase(mt_db_names,true);
 	mpvplayer->deleteLater();
 	danmuRender->deleteLater();
 	danmuPool->deleteLater();
@@ -106,25 +186,47 @@ void GlobalObjects::clear()
 
 QSqlDatabase GlobalObjects::getDB(int db)
 {
-    if(QThread::currentThread()->objectName()==QStringLiteral("workThread"))
+    const QString threadName(QThread::currentThread()->objectName());
+    if(threadName==QStringLiteral("workThread"))
     {
         return QSqlDatabase::database(wt_db_names[db]);
     }
+    if(threadName.startsWith(QStringLiteral("db")))
+    {
+        return QSqlDatabase::database(QString("%1_%2").arg(db_base_names[db],threadName));
+    }
     return QSqlDatabase::database(mt_db_names[db]);
 }
 
+void GlobalObjects::addThreadDatabase(const QString &threadName)
+{
+    for(int i=0;i<db_count;++i)
+    {
+        setDatabase(QString("%1_%2").arg(db_base_names[i],threadName),i);
+    }
+}
+
+void GlobalObjects::removeThreadDatabase(const QString &threadName)
+{
+    for(int i=0;i<db_count;++i)
+    {
+        const QString name(QString("%1_%2").arg(db_base_names[i],threadName));
+        QSqlDatabase::database(name,false).close();
+        QSqlDatabase::removeDatabase(name);
+    }
+}
+
 void GlobalObjects::initDatabase(const char *db_names[])
 {
-    const int db_count=3;
-    const char *db_files[]={"comment","bangumi","download"};
     for(int i=0;i<db_count;++i)
     {
-        setDatabase(db_names[i],db_files[i]);
+        setDatabase(db_names[i],i);
     }
 }
 
-void GlobalObjects::setDatabase(const char *name, const char *file)
+void GlobalObjects::setDatabase(const QString &name, int db)
 {
+    const char *file=db_files[db];
     QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE",name);
     QString dbFile(dataPath+file+".db");
     bool dbFileExist = QFile::exists(dbFile);
@@ -132,6 +234,7 @@ void GlobalObjects::setDatabase(const char *name, const char *file)
     database.open();
     QSqlQuery query(database);
     query.exec("PRAGMA foreign_keys = ON;");
+    applyDBOptions(query,db);
     if(!dbFileExist)
     {
         QFile sqlFile(QString(":/res/db/%1.sql").arg(file));
@@ -19,10 +19,12 @@ class LANServer;
 class ScriptManager;
 class AutoDownloadManager;
 class KCache;
+class DBExecutor;
 class GlobalObjects
 {
 public:
-    static void init();
+    //dir: data directory, "<app dir>/data/" if empty
+    static void init(const QString &dir=QString());
     static void clear();
     static MPVPlayer *mpvplayer;
     static DanmuPool *danmuPool;
@@ -40,15 +42,19 @@ public:
     static ScriptManager *scriptManager;
     static AutoDownloadManager *autoDownloadManager;
     static KCache *kCache;
+    static DBExecutor *dbExecutor;
     static QString dataPath;
 
     static const int Comment_DB=0;
     static const int Bangumi_DB=1;
     static const int Download_DB=2;
     static QSqlDatabase getDB(int db);
+    //connections of the DBExecutor threads, named after the thread
+    static void addThreadDatabase(const QString &threadName);
+    static void removeThreadDatabase(const QString &threadName);
 private:
     static void initDatabase(const char *db_names[]);
-    static void setDatabase(const char *name, const char *file);
+    static void setDatabase(const QString &name, int db);
 };
 enum PopMessageFlag
 {
@@ -3,11 +3,13 @@
 #include <QMessageBox>
 #include <QLocalSocket>
 #include <QLocalServer>
+#include <QTemporaryDir>
 #include "globalobjects.h"
 #include "Play/Playlist/playlist.h"
 #include "Play/Video/mpvplayer.h"
 #include "Play/Danmu/danmupool.h"
 #include "Play/Danmu/Render/danmurender.h"
+#include "Play/Danmu/Render/danmubenchmark.h"
 #include <io.h>
 
 #ifdef Q_OS_WIN
@@ -114,6 +116,18 @@ int main(int argc, char *argv[])
     SetUnhandledExceptionFilter((LPTOP_LEVEL_EXCEPTION_FILTER)AppCrashHandler);
 #endif
 
+    QStringList args(QCoreApplication::arguments());
+    int benchmarkPos=args.indexOf("--danmu-benchmark");
+    if(benchmarkPos!=-1)
+    {
+        //settings and databases of the user are not touched, a fresh set is made and removed
+        QTemporaryDir dataDir;
+        if(!dataDir.isValid()) return 1;
+        GlobalObjects::init(dataDir.path()+"/");
+        int ret=DanmuBenchmark(DanmuBenchmark::Config::fromArguments(args.mid(benchmarkPos+1))).run();
+        GlobalObjects::clear();
+        return ret;
+    }
     if(isRunning()) return 0;
     QString qss;
     QFile qssFile(":/res/style.qss");
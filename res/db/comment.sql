@@ -19,8 +19,8 @@ CREATE TABLE "danmu_0" (
 "Text"  TEXT,
 CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
 );
-CREATE INDEX "PoolID_0"
-ON "danmu_0" ("PoolID" ASC);
+CREATE INDEX "PoolSourceTime_0"
+ON "danmu_0" ("PoolID", "Source", "Time");
 
 CREATE TABLE "danmu_1" (
 "PoolID"  TEXT(32) NOT NULL,
@@ -34,8 +34,8 @@ CREATE TABLE "danmu_1" (
 "Text"  TEXT,
 CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
 );
-CREATE INDEX "PoolID_1"
-ON "danmu_1" ("PoolID" ASC);
+CREATE INDEX "PoolSourceTime_1"
+ON "danmu_1" ("PoolID", "Source", "Time");
 
 CREATE TABLE "danmu_2" (
 "PoolID"  TEXT(32) NOT NULL,
@@ -49,8 +49,8 @@ CREATE TABLE "danmu_2" (
 "Text"  TEXT,
 CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
 );
-CREATE INDEX "PoolID_2"
-ON "danmu_2" ("PoolID" ASC);
+CREATE INDEX "PoolSourceTime_2"
+ON "danmu_2" ("PoolID", "Source", "Time");
 
 CREATE TABLE "danmu_3" (
 "PoolID"  TEXT(32) NOT NULL,
@@ -64,8 +64,8 @@ CREATE TABLE "danmu_3" (
 "Text"  TEXT,
 CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
 );
-CREATE INDEX "PoolID_3"
-ON "danmu_3" ("PoolID" ASC);
+CREATE INDEX "PoolSourceTime_3"
+ON "danmu_3" ("PoolID", "Source", "Time");
 
 CREATE TABLE "danmu_4" (
 "PoolID"  TEXT(32) NOT NULL,
@@ -79,8 +79,8 @@ CREATE TABLE "danmu_4" (
 "Text"  TEXT,
 CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
 );
-CREATE INDEX "PoolID_4"
-ON "danmu_4" ("PoolID" ASC);
+CREATE INDEX "PoolSourceTime_4"
+ON "danmu_4" ("PoolID", "Source", "Time");
 
 CREATE TABLE "source" (
 "PoolID"  TEXT(32),
@@ -102,3 +102,20 @@ CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELET
 );
 CREATE UNIQUE INDEX "Match_MD5"
 ON "match" ("MD5" ASC);
+
+CREATE TABLE "danmu_block" (
+"PoolID"  TEXT(32) NOT NULL,
+"Source"  INTEGER NOT NULL,
+"Count"  INTEGER,
+"Data"  BLOB,
+PRIMARY KEY ("PoolID", "Source") ON CONFLICT REPLACE,
+CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
+);
+
+CREATE TABLE "danmu_count" (
+"PoolID"  TEXT(32) NOT NULL,
+"Source"  INTEGER NOT NULL,
+"Count"  INTEGER,
+PRIMARY KEY ("PoolID", "Source"),
+CONSTRAINT "PoolID" FOREIGN KEY ("PoolID") REFERENCES "pool" ("PoolID") ON DELETE CASCADE ON UPDATE CASCADE
+);
@@ -0,0 +1,16 @@
+QT       += core gui testlib
+
+TARGET = tst_danmubatch
+TEMPLATE = app
+CONFIG += C++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_danmubatch.cpp \
+    ../../Play/Danmu/Render/danmubatch.cpp
+
+HEADERS += \
+    ../../Play/Danmu/common.h \
+    ../../Play/Danmu/Render/danmubatch.h
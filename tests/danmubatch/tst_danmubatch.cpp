@@ -0,0 +1,112 @@
+#include <QtTest>
+#include "Play/Danmu/common.h"
+#include "Play/Danmu/Render/danmubatch.h"
+
+class TestDanmuBatch : public QObject
+{
+    Q_OBJECT
+private slots:
+    void emptyFrame();
+    void groupByPage();
+    void vertexValues();
+private:
+    static void setDrawInfo(DanmuDrawInfo &drawInfo, GLuint texture, int width, int height);
+};
+
+void TestDanmuBatch::setDrawInfo(DanmuDrawInfo &drawInfo, GLuint texture, int width, int height)
+{
+    drawInfo.width=width;
+    drawInfo.height=height;
+    drawInfo.useCount=0;
+    drawInfo.texture=texture;
+    drawInfo.atlasPage=int(texture);
+    drawInfo.texX=drawInfo.texY=0;
+    drawInfo.l=0.f;
+    drawInfo.r=1.f;
+    drawInfo.t=0.f;
+    drawInfo.b=1.f;
+}
+
+void TestDanmuBatch::emptyFrame()
+{
+    DanmuBatchBuilder builder;
+    builder.build(QVector<DanmuInstance>(),1920,1080,1.f);
+    QVERIFY(builder.vertices().isEmpty());
+    QVERIFY(builder.batches().isEmpty());
+    QCOMPARE(builder.vertexBytes(),qint64(0));
+    //nothing is left from the frame before
+    DanmuDrawInfo drawInfo;
+    setDrawInfo(drawInfo,1,100,20);
+    builder.build({{0.f,0.f,&drawInfo}},1920,1080,1.f);
+    QCOMPARE(builder.batches().count(),1);
+    builder.build(QVector<DanmuInstance>(),1920,1080,1.f);
+    QVERIFY(builder.vertices().isEmpty());
+    QVERIFY(builder.batches().isEmpty());
+}
+
+void TestDanmuBatch::groupByPage()
+{
+    DanmuDrawInfo page3, page1, page2;
+    setDrawInfo(page3,3,10,10);
+    setDrawInfo(page1,1,10,10);
+    setDrawInfo(page2,2,10,10);
+    //the x of every danmu is its position in the frame
+    const QVector<DanmuInstance> objList={{0.f,0.f,&page3},{1.f,0.f,&page1},{2.f,0.f,&page3},
+                                          {3.f,0.f,&page2},{4.f,0.f,&page1},{5.f,0.f,&page3}};
+    DanmuBatchBuilder builder;
+    builder.build(objList,1000,1000,1.f);
+    const int n=DanmuBatchBuilder::VerticesPerDanmu;
+    QCOMPARE(builder.vertices().count(),objList.count()*n);
+    QCOMPARE(builder.vertexBytes(),qint64(objList.count()*n*sizeof(DanmuBatchBuilder::Vertex)));
+    //one batch per page, in the order the pages first appear
+    const QVector<DanmuBatchBuilder::Batch> &batches=builder.batches();
+    QCOMPARE(batches.count(),3);
+    const GLuint textures[]={3,1,2};
+    const int firsts[]={0,3*n,5*n}, counts[]={3*n,2*n,n};
+    for(int b=0;b<3;++b)
+    {
+        QCOMPARE(batches.at(b).texture,textures[b]);
+        QCOMPARE(batches.at(b).first,firsts[b]);
+        QCOMPARE(batches.at(b).count,counts[b]);
+    }
+    //the danmu of a page keep their order in the frame
+    const int order[]={0,2,5,1,4,3};
+    for(int i=0;i<objList.count();++i)
+    {
+        const GLfloat left=objList.at(order[i]).x*2.f/1000-1;
+        QCOMPARE(builder.vertices().at(i*n).x,left);
+    }
+}
+
+void TestDanmuBatch::vertexValues()
+{
+    //powers of two, the expected values are exact
+    DanmuDrawInfo drawInfo;
+    setDrawInfo(drawInfo,7,64,32);
+    drawInfo.l=0.25f;
+    drawInfo.r=0.5f;
+    drawInfo.t=0.125f;
+    drawInfo.b=0.375f;
+    DanmuBatchBuilder builder;
+    builder.build({{64.f,32.f,&drawInfo}},256,128,0.5f);
+    QCOMPARE(builder.batches().count(),1);
+    QCOMPARE(builder.batches().first().first,0);
+    QCOMPARE(builder.batches().first().count,int(DanmuBatchBuilder::VerticesPerDanmu));
+    const QVector<DanmuBatchBuilder::Vertex> &vtx=builder.vertices();
+    QCOMPARE(vtx.count(),int(DanmuBatchBuilder::VerticesPerDanmu));
+    //two triangles: top left, top right, bottom left / top right, bottom left, bottom right
+    const GLfloat expected[6][4]={{-0.5f,0.5f,0.25f,0.125f},{0.f,0.5f,0.5f,0.125f},{-0.5f,0.f,0.25f,0.375f},
+                                  {0.f,0.5f,0.5f,0.125f},{-0.5f,0.f,0.25f,0.375f},{0.f,0.f,0.5f,0.375f}};
+    for(int i=0;i<vtx.count();++i)
+    {
+        QCOMPARE(vtx.at(i).x,expected[i][0]);
+        QCOMPARE(vtx.at(i).y,expected[i][1]);
+        QCOMPARE(vtx.at(i).u,expected[i][2]);
+        QCOMPARE(vtx.at(i).v,expected[i][3]);
+        QCOMPARE(vtx.at(i).alpha,0.5f);
+    }
+}
+
+QTEST_APPLESS_MAIN(TestDanmuBatch)
+
+#include "tst_danmubatch.moc"
@@ -0,0 +1,16 @@
+QT       += core gui testlib
+
+TARGET = tst_danmublock
+TEMPLATE = app
+CONFIG += C++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_danmublock.cpp \
+    ../../Play/Danmu/Manager/danmublock.cpp
+
+HEADERS += \
+    ../../Play/Danmu/common.h \
+    ../../Play/Danmu/Manager/danmublock.h
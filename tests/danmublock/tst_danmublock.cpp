@@ -0,0 +1,185 @@
+#include <QtTest>
+#include <climits>
+#include "Play/Danmu/common.h"
+#include "Play/Danmu/Manager/danmublock.h"
+
+class TestDanmuBlock : public QObject
+{
+    Q_OBJECT
+private slots:
+    void roundTrip();
+    void skipEmptyText();
+    void segments();
+    void badHeader();
+    void truncated();
+    void corruptSegment();
+private:
+    static QList<DanmuComment *> makeComments(int count);
+    static void compare(const QList<DanmuComment *> &expected, const QList<DanmuComment *> &actual, int source);
+};
+
+QList<DanmuComment *> TestDanmuBlock::makeComments(int count)
+{
+    QList<DanmuComment *> comments;
+    for(int i=0;i<count;++i)
+    {
+        DanmuComment *danmu=new DanmuComment;
+        //out of order and with equal times, encode sorts them stably
+        danmu->originTime=danmu->time=(i*7919)%(count*10)-(i%5==0?500:0);
+        danmu->date=1500000000+i*13-(i%3)*1000;
+        danmu->color=(i%4==0)?0xffffff:(i*2654435761u)&0xffffff;
+        danmu->type=DanmuComment::DanmuType(i%3);
+        danmu->fontSizeLevel=DanmuComment::FontSizeLevel(i%3);
+        danmu->sender=QString("user%1").arg(i%17);
+        danmu->text=(i%11==0)?QString::fromUtf8("\xe5\xbc\xb9\xe5\xb9\x95 %1\n2nd line").arg(i):QString("comment %1").arg(i%50);
+        danmu->source=0;
+        comments.append(danmu);
+    }
+    return comments;
+}
+
+void TestDanmuBlock::compare(const QList<DanmuComment *> &expected, const QList<DanmuComment *> &actual, int source)
+{
+    QList<DanmuComment *> sorted(expected);
+    std::stable_sort(sorted.begin(),sorted.end(),[](const DanmuComment *dm1, const DanmuComment *dm2){
+        return dm1->originTime<dm2->originTime;
+    });
+    QCOMPARE(actual.count(),sorted.count());
+    for(int i=0;i<sorted.count();++i)
+    {
+        const DanmuComment *e=sorted.at(i), *a=actual.at(i);
+        QCOMPARE(a->originTime,e->originTime);
+        QCOMPARE(a->time,e->originTime);
+        QCOMPARE(a->date,e->date);
+        QCOMPARE(a->color,e->color);
+        QCOMPARE(a->type,e->type);
+        QCOMPARE(a->fontSizeLevel,e->fontSizeLevel);
+        QCOMPARE(a->sender,e->sender);
+        QCOMPARE(a->text,e->text);
+        QCOMPARE(a->source,source);
+    }
+}
+
+void TestDanmuBlock::roundTrip()
+{
+    QList<DanmuComment *> comments(makeComments(300));
+    DanmuBlock block(DanmuBlock::encode(comments));
+    QVERIFY(block.isValid());
+    QCOMPARE(block.count(),comments.count());
+    QList<DanmuComment *> decoded;
+    QVERIFY(block.decode(3,decoded));
+    compare(comments,decoded,3);
+    qDeleteAll(comments);
+    qDeleteAll(decoded);
+
+    DanmuBlock empty(DanmuBlock::encode(QList<DanmuComment *>()));
+    QVERIFY(empty.isValid());
+    QCOMPARE(empty.count(),0);
+    QVERIFY(empty.decode(0,decoded));
+    QVERIFY(decoded.isEmpty());
+}
+
+void TestDanmuBlock::skipEmptyText()
+{
+    QList<DanmuComment *> comments(makeComments(20));
+    comments[4]->text.clear();
+    comments[9]->text.clear();
+    DanmuBlock block(DanmuBlock::encode(comments));
+    QVERIFY(block.isValid());
+    QCOMPARE(block.count(),18);
+    QList<DanmuComment *> decoded;
+    QVERIFY(block.decode(0,decoded));
+    QList<DanmuComment *> expected(comments);
+    expected.removeAll(comments[9]);
+    expected.removeAll(comments[4]);
+    compare(expected,decoded,0);
+    qDeleteAll(comments);
+    qDeleteAll(decoded);
+}
+
+void TestDanmuBlock::segments()
+{
+    const int count=DanmuBlock::SegmentSize*2+100;
+    QList<DanmuComment *> comments(makeComments(count));
+    DanmuBlock block(DanmuBlock::encode(comments));
+    QVERIFY(block.isValid());
+    QCOMPARE(block.segments().count(),3);
+    QList<DanmuComment *> decoded;
+    int lastEnd=INT_MIN;
+    for(int i=0;i<block.segments().count();++i)
+    {
+        const DanmuBlock::Segment &seg=block.segments().at(i);
+        QVERIFY(seg.startTime>=lastEnd);
+        QVERIFY(seg.startTime<=seg.endTime);
+        lastEnd=seg.endTime;
+        const int before=decoded.count();
+        QVERIFY(block.decodeSegment(i,1,decoded));
+        QCOMPARE(decoded.count()-before,seg.count);
+        QCOMPARE(decoded.at(before)->originTime,seg.startTime);
+        QCOMPARE(decoded.last()->originTime,seg.endTime);
+    }
+    compare(comments,decoded,1);
+    QVERIFY(!block.decodeSegment(3,1,decoded));
+    qDeleteAll(comments);
+    qDeleteAll(decoded);
+}
+
+void TestDanmuBlock::badHeader()
+{
+    QList<DanmuComment *> comments(makeComments(10));
+    const QByteArray data(DanmuBlock::encode(comments));
+    qDeleteAll(comments);
+    QVERIFY(!DanmuBlock(QByteArray()).isValid());
+    QByteArray badMagic(data);
+    badMagic[0]='X';
+    QVERIFY(!DanmuBlock(badMagic).isValid());
+    QByteArray badVersion(data);
+    badVersion[3]=char(99);
+    QVERIFY(!DanmuBlock(badVersion).isValid());
+    QList<DanmuComment *> decoded;
+    QVERIFY(!DanmuBlock(badMagic).decode(0,decoded));
+    QVERIFY(decoded.isEmpty());
+}
+
+void TestDanmuBlock::truncated()
+{
+    QList<DanmuComment *> comments(makeComments(100));
+    const QByteArray data(DanmuBlock::encode(comments));
+    qDeleteAll(comments);
+    for(int size:{4,8,data.size()/2,data.size()-1})
+    {
+        DanmuBlock block(data.left(size));
+        QVERIFY(!block.isValid());
+        QList<DanmuComment *> decoded;
+        QVERIFY(!block.decode(0,decoded));
+        QVERIFY(decoded.isEmpty());
+    }
+}
+
+void TestDanmuBlock::corruptSegment()
+{
+    const int count=DanmuBlock::SegmentSize*2+100;
+    QList<DanmuComment *> comments(makeComments(count));
+    QByteArray data(DanmuBlock::encode(comments));
+    const DanmuBlock::Segment last(DanmuBlock(data).segments().last());
+    //the compressed texts end the segment, a changed byte fails the zlib checksum
+    data[last.offset+last.size-2]=char(data.at(last.offset+last.size-2)^0x5a);
+    DanmuBlock block(data);
+    QVERIFY(block.isValid());
+    QList<DanmuComment *> decoded;
+    QVERIFY(block.decodeSegment(0,0,decoded));
+    QCOMPARE(decoded.count(),int(DanmuBlock::SegmentSize));
+    qDeleteAll(decoded);
+    decoded.clear();
+    QVERIFY(!block.decodeSegment(2,0,decoded));
+    QVERIFY(decoded.isEmpty());
+    //the segments before the broken one are left in the list, see DanmuManager::loadPool
+    QVERIFY(!block.decode(0,decoded));
+    QCOMPARE(decoded.count(),DanmuBlock::SegmentSize*2);
+    qDeleteAll(comments);
+    qDeleteAll(decoded);
+}
+
+QTEST_APPLESS_MAIN(TestDanmuBlock)
+
+#include "tst_danmublock.moc"
@@ -0,0 +1,16 @@
+QT       += core gui testlib
+
+TARGET = tst_fingerprintindex
+TEMPLATE = app
+CONFIG += C++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_fingerprintindex.cpp \
+    ../../Play/Danmu/Manager/fingerprintindex.cpp
+
+HEADERS += \
+    ../../Play/Danmu/common.h \
+    ../../Play/Danmu/Manager/fingerprintindex.h
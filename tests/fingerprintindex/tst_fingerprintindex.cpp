@@ -0,0 +1,135 @@
+#include <QtTest>
+#include "Play/Danmu/common.h"
+#include "Play/Danmu/Manager/fingerprintindex.h"
+
+class TestFingerprintIndex : public QObject
+{
+    Q_OBJECT
+private slots:
+    void notBuilt();
+    void addRemove();
+    void copies();
+    void eraseKeepsProbeChains();
+    void removeSource();
+private:
+    static QList<DanmuComment *> makeComments(int count, int source);
+};
+
+QList<DanmuComment *> TestFingerprintIndex::makeComments(int count, int source)
+{
+    QList<DanmuComment *> comments;
+    for(int i=0;i<count;++i)
+    {
+        DanmuComment *danmu=new DanmuComment;
+        danmu->originTime=i*37;
+        danmu->color=0xffffff;
+        danmu->sender=QString("user%1").arg(i%13);
+        danmu->text=QString("comment %1").arg(i);
+        danmu->source=source;
+        comments.append(danmu);
+    }
+    return comments;
+}
+
+void TestFingerprintIndex::notBuilt()
+{
+    QList<DanmuComment *> comments(makeComments(10,0));
+    FingerprintIndex index;
+    index.add(comments.first());
+    QVERIFY(!index.isBuilt());
+    QCOMPARE(index.size(),0);
+    QVERIFY(!index.contains(comments.first()));
+    qDeleteAll(comments);
+}
+
+void TestFingerprintIndex::addRemove()
+{
+    QList<DanmuComment *> comments(makeComments(100,0));
+    FingerprintIndex index;
+    index.build(comments);
+    QVERIFY(index.isBuilt());
+    QCOMPARE(index.size(),comments.count());
+    for(const DanmuComment *danmu:comments)
+    {
+        QVERIFY(index.contains(danmu));
+        QVERIFY(index.contains(danmu,0));
+        QVERIFY(!index.contains(danmu,1));
+    }
+    DanmuComment other(*comments.first());
+    other.originTime+=1;
+    QVERIFY(!index.contains(&other));
+    index.remove(comments.first());
+    QVERIFY(!index.contains(comments.first()));
+    QCOMPARE(index.size(),comments.count()-1);
+    //removing what is not there changes nothing
+    index.remove(comments.first());
+    index.remove(&other);
+    QCOMPARE(index.size(),comments.count()-1);
+    qDeleteAll(comments);
+}
+
+void TestFingerprintIndex::copies()
+{
+    QList<DanmuComment *> comments(makeComments(3,0));
+    DanmuComment copy(*comments.at(1));
+    DanmuComment otherSource(*comments.at(1));
+    otherSource.source=2;
+    FingerprintIndex index;
+    index.build(comments);
+    index.add(&copy);
+    index.add(&otherSource);
+    //one slot per source, copies in the same source are counted
+    QCOMPARE(index.size(),4);
+    index.remove(&copy);
+    QVERIFY(index.contains(comments.at(1),0));
+    index.remove(comments.at(1));
+    QVERIFY(!index.contains(comments.at(1),0));
+    QVERIFY(index.contains(comments.at(1)));
+    QVERIFY(index.contains(comments.at(1),2));
+    QCOMPARE(index.size(),3);
+    qDeleteAll(comments);
+}
+
+void TestFingerprintIndex::eraseKeepsProbeChains()
+{
+    //about half full, long probe chains that wrap around and cross each other
+    QList<DanmuComment *> comments(makeComments(4000,0));
+    FingerprintIndex index;
+    index.build(comments);
+    QSet<int> removed;
+    for(int i=0;i<comments.count();i+=3)
+    {
+        index.remove(comments.at(i));
+        removed.insert(i);
+    }
+    QCOMPARE(index.size(),comments.count()-removed.count());
+    for(int i=0;i<comments.count();++i)
+        QCOMPARE(index.contains(comments.at(i)),!removed.contains(i));
+    //added again into the shifted table
+    for(int i:removed)
+        index.add(comments.at(i));
+    QCOMPARE(index.size(),comments.count());
+    for(const DanmuComment *danmu:comments)
+        QVERIFY(index.contains(danmu));
+    qDeleteAll(comments);
+}
+
+void TestFingerprintIndex::removeSource()
+{
+    QList<DanmuComment *> source0(makeComments(500,0)), source1(makeComments(500,1));
+    FingerprintIndex index;
+    index.build(source0+source1);
+    QCOMPARE(index.size(),1000);
+    index.removeSource(0);
+    QCOMPARE(index.size(),500);
+    for(const DanmuComment *danmu:source0)
+        QVERIFY(!index.contains(danmu,0));
+    for(const DanmuComment *danmu:source1)
+        QVERIFY(index.contains(danmu,1));
+    qDeleteAll(source0);
+    qDeleteAll(source1);
+}
+
+QTEST_APPLESS_MAIN(TestFingerprintIndex)
+
+#include "tst_fingerprintindex.moc"
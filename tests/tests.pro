@@ -0,0 +1,8 @@
+# Unit tests of the parts that do not need the player or the databases.
+# Build and run from this directory: qmake && make check
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    danmublock \
+    danmubatch \
+    fingerprintindex